@@ -0,0 +1,41 @@
+# bubble: bubble sort of 1024 words in descending order, 3 times.
+# Result: s0 = first element, s1 = last element, s2 = 0 if sorted
+        lui   s3, 0x1001          # array
+        addiu s4, zero, 3         # repetitions
+rep:    addiu t0, zero, 1024
+        addu  t1, s3, zero
+fill:   sw    t0, 0(t1)           # 1024, 1023, ..., 1
+        addiu t1, t1, 4
+        addiu t0, t0, -1
+        bne   t0, zero, fill
+        addiu t5, zero, 1023      # passes left
+outer:  addu  t1, s3, zero
+        addu  t6, t5, zero        # compares this pass
+inner:  lw    t2, 0(t1)
+        lw    t3, 4(t1)
+        slt   t4, t3, t2
+        beq   t4, zero, noswap
+        sw    t3, 0(t1)
+        sw    t2, 4(t1)
+noswap: addiu t1, t1, 4
+        addiu t6, t6, -1
+        bne   t6, zero, inner
+        addiu t5, t5, -1
+        bne   t5, zero, outer
+        addiu s4, s4, -1
+        bne   s4, zero, rep
+        lw    s0, 0(s3)
+        addiu t1, s3, 4092
+        lw    s1, 0(t1)
+        addu  s2, zero, zero      # count inversions between neighbours
+        addu  t1, s3, zero
+        addiu t6, zero, 1023
+check:  lw    t2, 0(t1)
+        lw    t3, 4(t1)
+        slt   t4, t3, t2
+        addu  s2, s2, t4
+        addiu t1, t1, 4
+        addiu t6, t6, -1
+        bne   t6, zero, check
+        addiu v0, zero, 10
+        syscall
@@ -0,0 +1,27 @@
+# fib: recursive Fibonacci with JAL/JR and a stack frame per call, fib(27).
+# Result: s0 = fib(27) = 196418
+        lui   sp, 0x7fff
+        ori   sp, sp, 0xf000
+        addiu a0, zero, 27
+        jal   fib
+        addu  s0, v0, zero
+        addiu v0, zero, 10
+        syscall
+fib:    slti  t0, a0, 2
+        beq   t0, zero, recurse
+        addu  v0, a0, zero
+        jr    ra
+recurse: addiu sp, sp, -12
+        sw    ra, 0(sp)
+        sw    a0, 4(sp)
+        addiu a0, a0, -1
+        jal   fib
+        sw    v0, 8(sp)
+        lw    a0, 4(sp)
+        addiu a0, a0, -2
+        jal   fib
+        lw    t1, 8(sp)
+        addu  v0, v0, t1
+        lw    ra, 0(sp)
+        addiu sp, sp, 12
+        jr    ra
@@ -0,0 +1,63 @@
+# matmul: C = A * B for 32x32 word matrices with MULT/MFLO, 40 times.
+# A at 0x10010000, B at 0x10011000, C at 0x10012000, A[i][j] = i + j, B[i][j] = i ^ j
+# Result: s0 = trace of C
+        lui   s1, 0x1001
+        addiu s2, s1, 0x1000
+        addiu s3, s1, 0x2000
+        addu  t0, zero, zero      # i
+        addu  t9, zero, zero      # element pointer offset
+init_i: addu  t1, zero, zero      # j
+init_j: addu  t2, t0, t1
+        addu  t3, s1, t9
+        sw    t2, 0(t3)
+        xor   t2, t0, t1
+        addu  t3, s2, t9
+        sw    t2, 0(t3)
+        addiu t9, t9, 4
+        addiu t1, t1, 1
+        slti  t4, t1, 32
+        bne   t4, zero, init_j
+        addiu t0, t0, 1
+        slti  t4, t0, 32
+        bne   t4, zero, init_i
+        addiu s4, zero, 40        # repetitions
+rep:    addu  t0, zero, zero      # i
+loop_i: addu  t1, zero, zero      # j
+loop_j: addu  t5, zero, zero      # sum
+        sll   t6, t0, 7           # &A[i][0]
+        addu  t6, t6, s1
+        sll   t7, t1, 2           # &B[0][j]
+        addu  t7, t7, s2
+        addiu t2, zero, 32        # k
+loop_k: lw    t3, 0(t6)
+        lw    t4, 0(t7)
+        mult  t3, t4
+        mflo  t8
+        addu  t5, t5, t8
+        addiu t6, t6, 4
+        addiu t7, t7, 128
+        addiu t2, t2, -1
+        bne   t2, zero, loop_k
+        sll   t8, t0, 7           # &C[i][j]
+        sll   t9, t1, 2
+        addu  t8, t8, t9
+        addu  t8, t8, s3
+        sw    t5, 0(t8)
+        addiu t1, t1, 1
+        slti  t4, t1, 32
+        bne   t4, zero, loop_j
+        addiu t0, t0, 1
+        slti  t4, t0, 32
+        bne   t4, zero, loop_i
+        addiu s4, s4, -1
+        bne   s4, zero, rep
+        addu  s0, zero, zero
+        addu  t8, s3, zero
+        addiu t0, zero, 32
+trace:  lw    t3, 0(t8)
+        addu  s0, s0, t3
+        addiu t8, t8, 132
+        addiu t0, t0, -1
+        bne   t0, zero, trace
+        addiu v0, zero, 10
+        syscall
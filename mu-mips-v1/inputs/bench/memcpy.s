@@ -0,0 +1,34 @@
+# memcpy: copy a 64 KB buffer word by word, 200 times.
+# Result: s0 = sum of the last copy (checked against the source)
+        lui   s1, 0x1001          # src = 0x10010000
+        lui   s2, 0x1002          # dst = 0x10020000
+        addiu t0, zero, 16384     # words
+        addu  t1, s1, zero
+        addiu t2, zero, 7
+fill:   sw    t2, 0(t1)
+        addiu t2, t2, 13
+        addiu t1, t1, 4
+        addiu t0, t0, -1
+        bne   t0, zero, fill
+        addiu s3, zero, 200       # repetitions
+rep:    addu  t1, s1, zero
+        addu  t3, s2, zero
+        addiu t0, zero, 16384
+copy:   lw    t4, 0(t1)
+        sw    t4, 0(t3)
+        addiu t1, t1, 4
+        addiu t3, t3, 4
+        addiu t0, t0, -1
+        bne   t0, zero, copy
+        addiu s3, s3, -1
+        bne   s3, zero, rep
+        addu  t3, s2, zero
+        addiu t0, zero, 16384
+        addu  s0, zero, zero
+sum:    lw    t4, 0(t3)
+        addu  s0, s0, t4
+        addiu t3, t3, 4
+        addiu t0, t0, -1
+        bne   t0, zero, sum
+        addiu v0, zero, 10
+        syscall
@@ -0,0 +1,31 @@
+# strscan: build a 64 KB string with SB, then scan it byte by byte with LB,
+# counting 'e' characters and measuring its length, 50 times.
+# Result: s0 = length, s1 = 'e' count of the last scan
+        lui   s2, 0x1001          # string
+        ori   t0, zero, 65535     # characters
+        addu  t1, s2, zero
+        addiu t2, zero, 97        # 'a'
+build:  sb    t2, 0(t1)
+        addiu t2, t2, 1
+        slti  t3, t2, 123         # past 'z'?
+        bne   t3, zero, next
+        addiu t2, zero, 97
+next:   addiu t1, t1, 1
+        addiu t0, t0, -1
+        bne   t0, zero, build
+        sb    zero, 0(t1)         # terminator
+        addiu s3, zero, 50        # repetitions
+        addiu t5, zero, 101       # 'e'
+rep:    addu  t1, s2, zero
+        addu  s1, zero, zero
+scan:   lb    t2, 0(t1)
+        beq   t2, zero, done
+        bne   t2, t5, skip
+        addiu s1, s1, 1
+skip:   addiu t1, t1, 1
+        j     scan
+done:   subu  s0, t1, s2
+        addiu s3, s3, -1
+        bne   s3, zero, rep
+        addiu v0, zero, 10
+        syscall
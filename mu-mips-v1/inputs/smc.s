@@ -0,0 +1,17 @@
+# smc: self-modifying code. A loop patches its own add after 500 of its
+# 1000 iterations, so the translated block it is running in goes stale.
+# Result: s0 = 500 * 1 + 500 * 100 = 50500
+        addu  s0, zero, zero
+        addiu s1, zero, 1000      # iterations left
+        lui   t3, 0x0040
+        ori   t3, t3, 0x0018      # address of loop
+        lui   t2, 0x2610          # addiu s0, s0, 100
+        ori   t2, t2, 0x0064
+loop:   addiu s0, s0, 1           # patched to addiu s0, s0, 100
+        addiu s1, s1, -1
+        addiu t4, zero, 500
+        bne   s1, t4, next
+        sw    t2, 0(t3)
+next:   bgtz  s1, loop
+        addiu v0, zero, 10
+        syscall
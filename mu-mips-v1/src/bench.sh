@@ -0,0 +1,69 @@
+#!/bin/sh
+#
+# Simulator throughput benchmarks.
+# Runs every kernel in ../inputs/bench under every execution engine and
+# the pipeline model, and prints host time, guest instructions, MIPS/s
+# and peak RSS. The results are written to bench.out; when bench.baseline
+# exists (make bench-baseline) each run is also compared against it.
+#
+# usage: ./bench.sh [kernel ...]
+
+SIM=./mu-mips
+DIR=../inputs/bench
+MODES="switch table threaded jit pipeline"
+OUT=bench.out
+BASE=bench.baseline
+
+if [ $# -eq 0 ]; then
+	set -- $(ls $DIR/*.in | sed 's|.*/||; s|\.in$||')
+fi
+
+printf "%-10s %-10s %12s %10s %10s %10s" kernel mode instructions "time(s)" "MIPS/s" "RSS(KB)"
+[ -f $BASE ] && printf " %10s" "vs base"
+printf "\n"
+: > $OUT.tmp
+
+fields() {
+	n=$1 pc=$2 time=$3 mips=$4 rss=$5
+}
+
+status=0
+for kernel in "$@"; do
+	expect=""
+	for mode in $MODES; do
+		if [ $mode = pipeline ]; then
+			args="-m pipeline"
+		else
+			args="-e $mode"
+		fi
+		result=$(printf 'sim\nq\n' | $SIM -q $args $DIR/$kernel.in | awk -F'\t: ' '
+			/^# Instructions Executed/ { n = $2 }
+			/^PC/ { pc = $2 }
+			/^Host time/ { split($2, t, " "); time = t[1]; mips = substr(t[3], 2) }
+			/^Peak RSS/ { split($2, r, " "); rss = r[1] }
+			END { if (n != "") print n, pc, time, mips, rss }')
+		if [ -z "$result" ]; then
+			printf "%-10s %-10s failed\n" $kernel $mode
+			status=1
+			continue
+		fi
+		fields $result
+		printf "%-10s %-10s %12s %10s %10s %10s" $kernel $mode $n $time $mips $rss
+		if [ -f $BASE ]; then
+			awk -v k=$kernel -v m=$mode -v mips=$mips '
+				$1 == k && $2 == m && $4 > 0 { printf " %9.2fx", mips / $4; found = 1 }
+				END { if (!found) printf " %10s", "-" }' $BASE
+		fi
+		# every mode must finish the kernel the same way
+		if [ -z "$expect" ]; then
+			expect="$n $pc"
+		elif [ "$expect" != "$n $pc" ]; then
+			printf "  MISMATCH (%s)" "$expect"
+			status=1
+		fi
+		printf "\n"
+		echo "$kernel $mode $n $mips $time $rss" >> $OUT.tmp
+	done
+done
+mv $OUT.tmp $OUT
+exit $status
@@ -0,0 +1,69 @@
+#!/bin/sh
+#
+# Regression checks, run by make check.
+# Every program in ../inputs and ../inputs/bench is run on the JIT against
+# the interpreter (-V), then in batch mode under every execution engine
+# and the pipeline model with assertions on its final state. Runs cut
+# short by an instruction limit must also stop in the same state on the
+# interpreter and the JIT, wherever the limit falls in a translated block.
+#
+# usage: ./check.sh
+
+SIM=./mu-mips
+MODES="switch table threaded jit pipeline"
+LIMITS="1 2 7 100 4097 100000"
+
+status=0
+
+fail() {
+	printf "FAIL  %s\n" "$*"
+	status=1
+}
+
+for program in ../inputs/*.in ../inputs/bench/*.in; do
+	if ! $SIM -V $program > /dev/null; then
+		fail "$program: JIT and interpreter differ ($SIM -V $program)"
+	fi
+done
+
+# program, then the assertions on where it ends
+while read program asserts; do
+	args=""
+	for a in $asserts; do
+		args="$args -a $a"
+	done
+	for mode in $MODES; do
+		if [ $mode = pipeline ]; then
+			engine="-m pipeline"
+		else
+			engine="-e $mode"
+		fi
+		if ! $SIM -b -O none $engine $args ../inputs/$program; then
+			fail "$program ($mode): $SIM -b $engine$args ../inputs/$program"
+		fi
+	done
+done <<END
+test1.in count=32 v0=10 v1=0x10000004 t0=0x792c pc=0x00400080
+test2.in count=17 a3=0x04d2270f t7=0xfffffb01 s1=0x00640000
+test3.in count=5 a1=1 a3=13
+smc.in count=5009 s0=50500
+bench/bubble.in count=14173702 s0=1 s1=1024 s2=0
+bench/fib.in count=6356211 s0=196418
+bench/matmul.in count=12385699 s0=0x78200
+bench/memcpy.in count=19825651 s0=0x68002000
+bench/strscan.in count=16971424 s0=0xffff s1=0x9d9
+END
+
+# the JIT's instruction budget ends blocks and chains early
+for program in ../inputs/smc.in ../inputs/bench/fib.in ../inputs/bench/bubble.in; do
+	for n in $LIMITS; do
+		ref=$($SIM -b -e switch -n $n -a count=$n $program | grep -v '^Host time')
+		out=$($SIM -b -e jit -n $n -a count=$n $program | grep -v '^Host time')
+		if [ "$ref" != "$out" ]; then
+			fail "$program: JIT stops elsewhere than the interpreter after $n instructions"
+		fi
+	done
+done
+
+[ $status -eq 0 ] && echo "All checks passed."
+exit $status
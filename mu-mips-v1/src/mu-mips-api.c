@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "mu-mips-pipeline.h"
+#include "mu-mips-debug.h"
+#include "mumips.h"
+
+/***************************************************************/
+/* Library entry points. Every call makes its context the thread's   */
+/* current machine, the simulator core works on that one. Errors are  */
+/* printed and returned, see mumips.h.                                            */
+/***************************************************************/
+
+/***************************************************************/
+/* Parse a process-wide option, -1 if it is unknown                              */
+/***************************************************************/
+int mumips_option(const char *opt)
+{
+	static const char *engines[] = { "switch", "table", "threaded", "jit" };
+	static const char *formats[] = { "auto", "hex", "bin", "binle", "elf" };
+	static const char *models[] = { "functional", "pipeline", "sampled", "ooo" };
+	int i;
+
+	if (strncmp(opt, "engine=", 7) == 0) {
+		for (i = 0; i < 4; i++) {
+			if (strcmp(opt + 7, engines[i]) == 0) {
+				ENGINE = i;
+				return 0;
+			}
+		}
+		printf("Error: Unknown engine %s (switch, table, threaded or jit)\n", opt + 7);
+		return -1;
+	}
+	if (strncmp(opt, "format=", 7) == 0) {
+		for (i = 0; i < 5; i++) {
+			if (strcmp(opt + 7, formats[i]) == 0) {
+				PROGRAM_FORMAT = i;
+				return 0;
+			}
+		}
+		printf("Error: Unknown program format %s (auto, hex, bin, binle or elf)\n", opt + 7);
+		return -1;
+	}
+	if (strncmp(opt, "model=", 6) == 0) {
+		for (i = 0; i < 4; i++) {
+			if (strcmp(opt + 6, models[i]) == 0) {
+				TIMING = i;
+				return 0;
+			}
+		}
+		printf("Error: Unknown timing model %s (functional, pipeline, sampled or ooo)\n", opt + 6);
+		return -1;
+	}
+	return timing_option(opt) ? 0 : -1;
+}
+
+mumips_t *mumips_create(void)
+{
+	machine_t *current = MACHINE;
+	machine_t *m = machine_create();
+
+	MACHINE = current;
+	return m;
+}
+
+int mumips_load(mumips_t *m, const char *path)
+{
+	MACHINE = m;
+	return machine_load(path) ? 0 : -1;
+}
+
+/***************************************************************/
+/* Back to the state right after the last load                                      */
+/***************************************************************/
+void mumips_reset(mumips_t *m)
+{
+	MACHINE = m;
+	reset();
+}
+
+void mumips_destroy(mumips_t *m)
+{
+	if (m != NULL) {
+		machine_destroy(m);
+	}
+}
+
+uint64_t mumips_step(mumips_t *m)
+{
+	MACHINE = m;
+	return RUN_FLAG ? run_engine(1) : 0;
+}
+
+uint64_t mumips_run(mumips_t *m, uint64_t max)
+{
+	uint64_t done = 0;
+	uint32_t chunk;
+
+	MACHINE = m;
+	while (RUN_FLAG && (max == 0 || done < max)) {
+		chunk = max == 0 || max - done > UINT32_MAX ? UINT32_MAX : (uint32_t)(max - done);
+		done += run_engine(chunk);
+		if (debug_stopped()) {
+			/* at a breakpoint or watchpoint, the next call goes on from there */
+			break;
+		}
+	}
+	return done;
+}
+
+int mumips_halted(mumips_t *m)
+{
+	return !m->run_flag;
+}
+
+uint64_t mumips_instructions(mumips_t *m)
+{
+	return m->instruction_count;
+}
+
+uint32_t mumips_read_reg(mumips_t *m, int reg)
+{
+	if (reg >= 0 && reg < MIPS_REGS) {
+		return m->current.REGS[reg];
+	}
+	switch (reg) {
+		case MUMIPS_HI:
+			return m->current.HI;
+		case MUMIPS_LO:
+			return m->current.LO;
+		case MUMIPS_PC:
+			return m->current.PC;
+	}
+	return 0;
+}
+
+/***************************************************************/
+/* Set a register in both the current and next state, -1 for a bad   */
+/* register number                                                                                     */
+/***************************************************************/
+int mumips_write_reg(mumips_t *m, int reg, uint32_t value)
+{
+	uint32_t *current, *next;
+
+	if (reg >= 0 && reg < MIPS_REGS) {
+		current = &m->current.REGS[reg];
+		next = &m->next.REGS[reg];
+	} else if (reg == MUMIPS_HI) {
+		current = &m->current.HI;
+		next = &m->next.HI;
+	} else if (reg == MUMIPS_LO) {
+		current = &m->current.LO;
+		next = &m->next.LO;
+	} else if (reg == MUMIPS_PC) {
+		current = &m->current.PC;
+		next = &m->next.PC;
+	} else {
+		return -1;
+	}
+	*current = *next = value;
+	MACHINE = m;
+	trace_sink_state(FALSE);
+	return 0;
+}
+
+void mumips_read_mem(mumips_t *m, uint32_t addr, void *buf, uint32_t len)
+{
+	uint8_t *p = buf;
+	uint32_t i;
+
+	MACHINE = m;
+	for (i = 0; i < len; i++) {
+		p[i] = mem_peek(addr + i, 1);
+	}
+}
+
+int mumips_write_mem(mumips_t *m, uint32_t addr, const void *buf, uint32_t len)
+{
+	uint32_t base = addr & ~3u, i;
+	int whole;
+
+	MACHINE = m;
+	whole = mem_write_block(addr, buf, len, FALSE);
+	if (TRACE_FILE != NULL) {
+		/* the trace records whole words */
+		for (i = 0; i < len + (addr & 3); i += 4) {
+			trace_sink_poke(base + i, mem_peek(base + i, 4));
+		}
+	}
+	return whole ? 0 : -1;
+}
@@ -0,0 +1,331 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "mu-mips.h"
+#include "mu-mips-pipeline.h"
+#include "mu-mips-batch.h"
+#include "mu-mips-syscall.h"
+
+/***************************************************************/
+/* Batch mode. Initial values are applied to the loaded program, the  */
+/* run stops when the program halts or the limit is reached, and the  */
+/* assertions are checked against the final state. Registers are named */
+/* by number (4, r4, $4) or convention ($a0, a0), memory words as        */
+/* mem:<address>.                                                                                           */
+/***************************************************************/
+
+int BATCH;
+int BATCH_OUTPUT = BATCH_OUTPUT_TEXT;
+batch_job_t BATCH_JOB;
+
+static const char *REG_NAMES[MIPS_REGS] = {
+	"zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+	"t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+	"s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+	"t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra"
+};
+
+static int parse_value(const char *s, uint64_t *value)
+{
+	char *end;
+
+	/* negative values wrap, parse_item() cuts words down to 32 bits */
+	*value = strtoull(s, &end, 0);
+	return end != s && *end == '\0';
+}
+
+/***************************************************************/
+/* Parse a register: 4, r4, $4, $a0 or a0. FALSE if there is no such  */
+/***************************************************************/
+int batch_reg(const char *name, uint32_t *reg)
+{
+	char *end;
+	int i;
+
+	i = (name[0] == '$' || name[0] == 'r') ? 1 : 0;
+	if (name[i] >= '0' && name[i] <= '9') {
+		*reg = strtoul(name + i, &end, 10);
+		return *end == '\0' && *reg < MIPS_REGS;
+	}
+	i = name[0] == '$';
+	for (*reg = 0; *reg < MIPS_REGS; (*reg)++) {
+		if (strcmp(name + i, REG_NAMES[*reg]) == 0) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/***************************************************************/
+/* Parse "<location>=<value>", FALSE if either half is malformed        */
+/***************************************************************/
+static int parse_item(const char *arg, batch_item_t *item)
+{
+	char name[32], *eq = strchr(arg, '=');
+	char *end;
+	size_t len;
+
+	if (eq == NULL || (len = eq - arg) == 0 || len >= sizeof(name) || !parse_value(eq + 1, &item->value)) {
+		return FALSE;
+	}
+	memcpy(name, arg, len);
+	name[len] = '\0';
+	item->text = arg;
+
+	if (strncmp(name, "mem:", 4) == 0) {
+		item->value = (uint32_t)item->value;
+		item->kind = LOC_MEM;
+		item->where = strtoul(name + 4, &end, 0);
+		return end != name + 4 && *end == '\0' && (item->where & 3) == 0;
+	}
+	if (strcmp(name, "hi") == 0 || strcmp(name, "lo") == 0 || strcmp(name, "pc") == 0 ||
+			strcmp(name, "count") == 0) {
+		item->kind = name[0] == 'h' ? LOC_HI : name[0] == 'l' ? LOC_LO : name[0] == 'p' ? LOC_PC : LOC_COUNT;
+		if (item->kind != LOC_COUNT) {
+			item->value = (uint32_t)item->value;
+		}
+		return TRUE;
+	}
+
+	item->value = (uint32_t)item->value;
+	item->kind = LOC_REG;
+	return batch_reg(name, &item->where);
+}
+
+/***************************************************************/
+/* Command-line options, FALSE on a malformed argument                       */
+/***************************************************************/
+int batch_output(const char *name)
+{
+	if (strcmp(name, "text") == 0) {
+		BATCH_OUTPUT = BATCH_OUTPUT_TEXT;
+	} else if (strcmp(name, "json") == 0) {
+		BATCH_OUTPUT = BATCH_OUTPUT_JSON;
+	} else if (strcmp(name, "none") == 0) {
+		BATCH_OUTPUT = BATCH_OUTPUT_NONE;
+	} else {
+		printf("Error: Unknown output format %s (text, json or none)\n\n", name);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+int batch_limit(batch_job_t *job, const char *arg)
+{
+	char *end;
+
+	job->limit = strtoull(arg, &end, 0);
+	if (end == arg || *end != '\0') {
+		printf("Error: Bad run limit %s\n\n", arg);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+int batch_set(batch_job_t *job, const char *arg)
+{
+	if (job->num_sets == BATCH_MAX_ITEMS) {
+		printf("Error: At most %d initial values\n\n", BATCH_MAX_ITEMS);
+		return FALSE;
+	}
+	if (!parse_item(arg, &job->sets[job->num_sets]) || job->sets[job->num_sets].kind == LOC_COUNT) {
+		printf("Error: Bad initial value %s (e.g. a0=5, hi=0x10, pc=0x400010, mem:0x10010000=7)\n\n", arg);
+		return FALSE;
+	}
+	job->num_sets++;
+	return TRUE;
+}
+
+int batch_assert(batch_job_t *job, const char *arg)
+{
+	if (job->num_asserts == BATCH_MAX_ITEMS) {
+		printf("Error: At most %d assertions\n\n", BATCH_MAX_ITEMS);
+		return FALSE;
+	}
+	if (!parse_item(arg, &job->asserts[job->num_asserts])) {
+		printf("Error: Bad assertion %s (e.g. v0=10, s0=0x2ff42, count=100, mem:0x10010000=7)\n\n", arg);
+		return FALSE;
+	}
+	job->num_asserts++;
+	return TRUE;
+}
+
+static uint64_t batch_read(const batch_item_t *item)
+{
+	switch (item->kind) {
+		case LOC_REG:
+			return CURRENT_STATE.REGS[item->where];
+		case LOC_HI:
+			return CURRENT_STATE.HI;
+		case LOC_LO:
+			return CURRENT_STATE.LO;
+		case LOC_PC:
+			return CURRENT_STATE.PC;
+		case LOC_COUNT:
+			return INSTRUCTION_COUNT;
+		default:
+			return mem_read_32(item->where);
+	}
+}
+
+static void batch_write(const batch_item_t *item)
+{
+	switch (item->kind) {
+		case LOC_REG:
+			if (item->where != 0) {
+				CURRENT_STATE.REGS[item->where] = item->value;
+			}
+			break;
+		case LOC_HI:
+			CURRENT_STATE.HI = item->value;
+			break;
+		case LOC_LO:
+			CURRENT_STATE.LO = item->value;
+			break;
+		case LOC_PC:
+			CURRENT_STATE.PC = item->value;
+			break;
+		default:
+			mem_write_32(item->where, item->value);
+			trace_sink_poke(item->where, item->value);
+			return;
+	}
+	NEXT_STATE = CURRENT_STATE;
+	trace_sink_state(FALSE);
+}
+
+/***************************************************************/
+/* Print s as a JSON string, quoted and escaped                                 */
+/***************************************************************/
+static void batch_json_string(const char *s)
+{
+	unsigned char c;
+
+	putchar('"');
+	for (; *s; s++) {
+		c = *s;
+		if (c == '"' || c == '\\') {
+			printf("\\%c", c);
+		} else if (c == '\n') {
+			printf("\\n");
+		} else if (c == '\t') {
+			printf("\\t");
+		} else if (c < 0x20 || c == 0x7f) {
+			printf("\\u%04x", c);
+		} else {
+			putchar(c);
+		}
+	}
+	putchar('"');
+}
+
+/***************************************************************/
+/* Print a finished job in the chosen format                                          */
+/***************************************************************/
+void batch_print(const batch_job_t *job)
+{
+	static const char *status[] = { "halted", "load error", "assertion failed", "limit reached" };
+	int i;
+
+	if (BATCH_OUTPUT == BATCH_OUTPUT_JSON) {
+		printf("{\n  \"program\": ");
+		batch_json_string(job->program);
+		printf(",\n  \"status\": \"%s\",\n", status[job->status]);
+		if (job->exited) {
+			printf("  \"exit_code\": %d,\n", job->exit_code);
+		}
+		printf("  \"instructions\": %llu,\n", (unsigned long long)job->instructions);
+		if (TIMING == TIMING_PIPELINE || TIMING == TIMING_OOO) {
+			printf("  \"cycles\": %llu,\n", (unsigned long long)job->cycles);
+		} else if (TIMING == TIMING_SAMPLED) {
+			printf("  \"estimated_cycles\": %llu,\n", (unsigned long long)job->cycles);
+		}
+		printf("  \"seconds\": %.6f,\n", job->seconds);
+		printf("  \"pc\": %u,\n  \"hi\": %u,\n  \"lo\": %u,\n  \"regs\": [", job->state.PC,
+				job->state.HI, job->state.LO);
+		for (i = 0; i < MIPS_REGS; i++) {
+			printf("%s%u", i ? ", " : "", job->state.REGS[i]);
+		}
+		printf("],\n  \"assertions\": [");
+		for (i = 0; i < job->num_asserts; i++) {
+			printf("%s\n    {\"check\": ", i ? "," : "");
+			batch_json_string(job->asserts[i].text);
+			printf(", \"actual\": %llu, \"passed\": %s}", (unsigned long long)job->actual[i],
+					job->actual[i] == job->asserts[i].value ? "true" : "false");
+		}
+		printf("%s]\n}\n", job->num_asserts ? "\n  " : "");
+		return;
+	}
+
+	printf("Program\t\t: %s\n", job->program);
+	printf("Status\t\t: %s\n", status[job->status]);
+	if (job->exited) {
+		printf("Exit code\t: %d\n", job->exit_code);
+	}
+	printf("# Instructions Executed\t: %llu\n", (unsigned long long)job->instructions);
+	if (TIMING == TIMING_PIPELINE || TIMING == TIMING_OOO) {
+		printf("# Cycles\t\t: %llu\n", (unsigned long long)job->cycles);
+	} else if (TIMING == TIMING_SAMPLED) {
+		printf("# Cycles (estimated)\t: %llu\n", (unsigned long long)job->cycles);
+	}
+	printf("PC\t: 0x%08x\tHI\t: 0x%08x\tLO\t: 0x%08x\n", job->state.PC, job->state.HI, job->state.LO);
+	for (i = 0; i < MIPS_REGS; i++) {
+		printf("[R%d]\t: 0x%08x%s", i, job->state.REGS[i], i % 4 == 3 ? "\n" : "\t");
+	}
+	for (i = 0; i < job->num_asserts; i++) {
+		if (job->actual[i] == job->asserts[i].value) {
+			printf("PASS %s\n", job->asserts[i].text);
+		} else {
+			printf("FAIL %s (actual 0x%08llx)\n", job->asserts[i].text, (unsigned long long)job->actual[i]);
+		}
+	}
+}
+
+/***************************************************************/
+/* Run the loaded program to completion or the job's limit, check it */
+/* and record the results in the job                                                      */
+/***************************************************************/
+void batch_run(batch_job_t *job)
+{
+	struct timespec start, stop;
+	uint64_t left = job->limit;
+	uint32_t chunk;
+	int i, failed = 0;
+
+	for (i = 0; i < job->num_sets; i++) {
+		batch_write(&job->sets[i]);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (RUN_FLAG) {
+		if (job->limit == 0) {
+			run_engine(UINT32_MAX);
+			continue;
+		}
+		if (left == 0) {
+			break;
+		}
+		chunk = left > UINT32_MAX ? UINT32_MAX : (uint32_t)left;
+		left -= run_engine(chunk);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	job->seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+	job->state = CURRENT_STATE;
+	job->instructions = INSTRUCTION_COUNT;
+	job->cycles = timing_cycles();
+	job->exited = SYS_PROC.exited;
+	job->exit_code = SYS_PROC.exit_code;
+	for (i = 0; i < job->num_asserts; i++) {
+		job->actual[i] = batch_read(&job->asserts[i]);
+		failed += job->actual[i] != job->asserts[i].value;
+	}
+	if (failed) {
+		job->status = BATCH_FAILED;
+	} else {
+		job->status = RUN_FLAG ? BATCH_LIMIT_REACHED : BATCH_PASSED;
+	}
+}
@@ -0,0 +1,56 @@
+#include <stdint.h>
+
+/***************************************************************/
+/* Batch mode.                                                                                                   */
+/* Loads, runs and checks a program from the command line alone: no */
+/* REPL, no banner, the result is the exit status. The job runner      */
+/* runs many batch jobs, one machine per thread.                                 */
+/***************************************************************/
+
+enum { BATCH_OUTPUT_TEXT, BATCH_OUTPUT_JSON, BATCH_OUTPUT_NONE };
+
+/* exit statuses, setup errors exit with 1 like the REPL */
+#define BATCH_PASSED 0
+#define BATCH_LOAD_ERROR 1                 /* the program could not be loaded */
+#define BATCH_FAILED 2                     /* an assertion did not hold */
+#define BATCH_LIMIT_REACHED 3              /* still running when the run limit was reached */
+
+#define BATCH_MAX_ITEMS 64
+
+/* a register, HI/LO, the PC, the instruction count or a memory word */
+enum { LOC_REG, LOC_HI, LOC_LO, LOC_PC, LOC_COUNT, LOC_MEM };
+
+typedef struct {
+	int kind;
+	uint32_t where;                        /* register number or address */
+	uint64_t value;                        /* a word but for the instruction count */
+	const char *text;                      /* as given on the command line */
+} batch_item_t;
+
+typedef struct {
+	/* what to run */
+	const char *program;
+	uint64_t limit;                        /* instructions (cycles with -m pipeline), 0 = none */
+	batch_item_t sets[BATCH_MAX_ITEMS], asserts[BATCH_MAX_ITEMS];
+	int num_sets, num_asserts;
+	/* results */
+	int status;
+	CPU_State state;                       /* final registers */
+	uint64_t instructions;
+	uint64_t cycles;                       /* pipeline model only */
+	double seconds;                        /* host time of the run */
+	int exited, exit_code;                 /* the program stopped with exit2 and this code */
+	uint64_t actual[BATCH_MAX_ITEMS];      /* final value of each assertion */
+} batch_job_t;
+
+extern int BATCH;                          /* run the command line job, no REPL */
+extern int BATCH_OUTPUT;
+extern batch_job_t BATCH_JOB;               /* the job given on the command line */
+
+int batch_reg(const char *name, uint32_t *reg);
+int batch_output(const char *name);
+int batch_limit(batch_job_t *job, const char *arg);
+int batch_set(batch_job_t *job, const char *arg);
+int batch_assert(batch_job_t *job, const char *arg);
+void batch_run(batch_job_t *job);
+void batch_print(const batch_job_t *job);
@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "mu-mips.h"
+#include "mu-mips-bpred.h"
+
+/***************************************************************/
+/* Branch predictors. The pipeline model executes at fetch, so every */
+/* prediction is checked and trained before the next fetch: there is */
+/* no wrong-path state to repair. nottaken predicts pc + 4 for every */
+/* instruction. bimodal and gshare predict conditional branches with  */
+/* 2-bit counters and take targets from the BTB, and JR $ra from the  */
+/* return address stack.                                                                            */
+/***************************************************************/
+
+bpred_t BPRED_CONFIG = { BPRED_NOTTAKEN, 4096, 12, 512, 8, 0 };
+
+static int parse_uint(const char *s, uint32_t *value)
+{
+	char *end;
+
+	*value = strtoul(s, &end, 0);
+	return end != s && *end == '\0';
+}
+
+/***************************************************************/
+/* Parse a predictor option, FALSE if it is not one                              */
+/***************************************************************/
+int bpred_option(const char *opt)
+{
+	if (strcmp(opt, "bpred=nottaken") == 0) {
+		BPRED_CONFIG.type = BPRED_NOTTAKEN;
+	} else if (strcmp(opt, "bpred=bimodal") == 0) {
+		BPRED_CONFIG.type = BPRED_BIMODAL;
+	} else if (strcmp(opt, "bpred=gshare") == 0) {
+		BPRED_CONFIG.type = BPRED_GSHARE;
+	} else if (strncmp(opt, "bpred.size=", 11) == 0) {
+		return parse_uint(opt + 11, &BPRED_CONFIG.table_size);
+	} else if (strncmp(opt, "bpred.history=", 14) == 0) {
+		return parse_uint(opt + 14, &BPRED_CONFIG.history_bits) && BPRED_CONFIG.history_bits <= 31;
+	} else if (strncmp(opt, "bpred.penalty=", 14) == 0) {
+		return parse_uint(opt + 14, &BPRED_CONFIG.penalty);
+	} else if (strncmp(opt, "btb.size=", 9) == 0) {
+		return parse_uint(opt + 9, &BPRED_CONFIG.btb_size);
+	} else if (strncmp(opt, "ras.size=", 9) == 0) {
+		return parse_uint(opt + 9, &BPRED_CONFIG.ras_size);
+	} else {
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/***************************************************************/
+/* Check the sizes and allocate the machine's tables                         */
+/***************************************************************/
+int bpred_init()
+{
+	if (MACHINE->bpred == NULL) {
+		MACHINE->bpred = calloc(1, sizeof(bpred_t));
+		if (MACHINE->bpred == NULL) {
+			printf("Error: Can't allocate branch predictor tables\n");
+			return FALSE;
+		}
+	}
+	memcpy(MACHINE->bpred, &BPRED_CONFIG, offsetof(bpred_t, counters));
+	if (BPRED.table_size == 0 || (BPRED.table_size & (BPRED.table_size - 1)) ||
+			(BPRED.btb_size & (BPRED.btb_size - 1))) {
+		printf("Error: Predictor table (%u) and BTB (%u) sizes must be powers of two\n",
+				BPRED.table_size, BPRED.btb_size);
+		return FALSE;
+	}
+	free(BPRED.counters);
+	free(BPRED.btb);
+	free(BPRED.ras);
+	BPRED.counters = malloc(BPRED.table_size);
+	BPRED.btb = calloc(BPRED.btb_size ? BPRED.btb_size : 1, sizeof(btb_entry_t));
+	BPRED.ras = calloc(BPRED.ras_size ? BPRED.ras_size : 1, sizeof(uint32_t));
+	if (BPRED.counters == NULL || BPRED.btb == NULL || BPRED.ras == NULL) {
+		printf("Error: Can't allocate branch predictor tables\n");
+		return FALSE;
+	}
+	bpred_reset();
+	return TRUE;
+}
+
+/***************************************************************/
+/* Free the machine's predictor                                                          */
+/***************************************************************/
+void bpred_release()
+{
+	if (MACHINE->bpred == NULL) {
+		return;
+	}
+	free(BPRED.counters);
+	free(BPRED.btb);
+	free(BPRED.ras);
+	free(BPRED.pcs);
+	free(MACHINE->bpred);
+	MACHINE->bpred = NULL;
+}
+
+/***************************************************************/
+/* Forget everything learnt and clear the counters                              */
+/***************************************************************/
+void bpred_reset()
+{
+	uint32_t i;
+
+	if (MACHINE->bpred == NULL || BPRED.counters == NULL) {
+		return;
+	}
+	memset(BPRED.counters, 1, BPRED.table_size);   /* weakly not taken */
+	for (i = 0; i < BPRED.btb_size; i++) {
+		BPRED.btb[i].tag = MEM_TLB_INVALID;
+	}
+	BPRED.history = 0;
+	BPRED.ras_top = 0;
+	BPRED.branches = BPRED.branch_mispredicts = 0;
+	BPRED.jumps = BPRED.jump_mispredicts = 0;
+	BPRED.btb_hits = BPRED.btb_misses = BPRED.ras_hits = BPRED.ras_misses = 0;
+	if (BPRED.pcs_used > 0) {
+		memset(BPRED.pcs, 0, BPRED_STATS_SIZE * sizeof(bpred_pc_stats_t));
+		BPRED.pcs_used = 0;
+	}
+}
+
+static int is_branch(uint8_t op)
+{
+	return op == OP_BEQ || op == OP_BNE || op == OP_BLEZ || op == OP_BGTZ ||
+			op == OP_BLTZ || op == OP_BGEZ;
+}
+
+static int is_return(uint8_t op, uint8_t rs)
+{
+	return op == OP_JR && rs == 31 && BPRED.ras_size > 0;
+}
+
+static uint8_t *bpred_counter(uint32_t pc)
+{
+	uint32_t index = pc >> 2;
+
+	if (BPRED.type == BPRED_GSHARE) {
+		index ^= BPRED.history;
+	}
+	return &BPRED.counters[index & (BPRED.table_size - 1)];
+}
+
+static btb_entry_t *bpred_btb(uint32_t pc)
+{
+	return BPRED.btb_size ? &BPRED.btb[(pc >> 2) & (BPRED.btb_size - 1)] : NULL;
+}
+
+/***************************************************************/
+/* Predicted successor of the control instruction at pc                        */
+/***************************************************************/
+uint32_t bpred_predict(uint32_t pc, uint8_t op, uint8_t rs)
+{
+	btb_entry_t *btb;
+	uint32_t predicted = pc + 4;
+
+	if (BPRED.type == BPRED_NOTTAKEN) {
+		return predicted;
+	}
+	if (is_return(op, rs)) {
+		if (BPRED.ras_top > 0) {
+			BPRED.ras_top--;
+			return BPRED.ras[BPRED.ras_top % BPRED.ras_size];
+		}
+	} else if (!is_branch(op) || *bpred_counter(pc) >= 2) {
+		btb = bpred_btb(pc);
+		if (btb != NULL && btb->tag == pc) {
+			BPRED.btb_hits++;
+			predicted = btb->target;
+		} else {
+			BPRED.btb_misses++;
+		}
+	}
+	if ((op == OP_JAL || op == OP_JALR) && BPRED.ras_size > 0) {
+		/* a full stack overwrites its oldest entry */
+		BPRED.ras[BPRED.ras_top % BPRED.ras_size] = pc + 4;
+		BPRED.ras_top++;
+	}
+	return predicted;
+}
+
+/***************************************************************/
+/* Per-PC counters, open addressing on the branch PC. The table is  */
+/* only allocated once a model trains the predictor                              */
+/***************************************************************/
+static bpred_pc_stats_t *bpred_pc_stats(uint32_t pc)
+{
+	uint32_t i = (pc >> 2) & (BPRED_STATS_SIZE - 1);
+
+	if (BPRED.pcs == NULL) {
+		BPRED.pcs = calloc(BPRED_STATS_SIZE, sizeof(bpred_pc_stats_t));
+		if (BPRED.pcs == NULL) {
+			return NULL;   /* the totals still count */
+		}
+	}
+	while (BPRED.pcs[i].executed != 0 && BPRED.pcs[i].pc != pc) {
+		i = (i + 1) & (BPRED_STATS_SIZE - 1);
+	}
+	if (BPRED.pcs[i].executed == 0) {
+		if (BPRED.pcs_used == BPRED_STATS_SIZE - 1) {
+			return NULL;   /* table full, the totals still count */
+		}
+		BPRED.pcs_used++;
+		BPRED.pcs[i].pc = pc;
+	}
+	return &BPRED.pcs[i];
+}
+
+/***************************************************************/
+/* Train on the real successor and count the outcome                         */
+/***************************************************************/
+void bpred_update(uint32_t pc, uint8_t op, uint8_t rs, uint32_t next, uint32_t predicted)
+{
+	bpred_pc_stats_t *s = bpred_pc_stats(pc);
+	btb_entry_t *btb;
+	uint8_t *counter;
+	int taken = next != pc + 4, miss = next != predicted;
+
+	if (s != NULL) {
+		s->executed++;
+		s->taken += taken;
+		s->mispredicts += miss;
+	}
+	if (is_branch(op)) {
+		BPRED.branches++;
+		BPRED.branch_mispredicts += miss;
+	} else {
+		BPRED.jumps++;
+		BPRED.jump_mispredicts += miss;
+	}
+	if (BPRED.type == BPRED_NOTTAKEN) {
+		return;
+	}
+
+	if (is_branch(op)) {
+		counter = bpred_counter(pc);
+		if (taken && *counter < 3) {
+			(*counter)++;
+		} else if (!taken && *counter > 0) {
+			(*counter)--;
+		}
+		if (BPRED.type == BPRED_GSHARE) {
+			BPRED.history = ((BPRED.history << 1) | taken) & ((1u << BPRED.history_bits) - 1);
+		}
+	}
+	if (is_return(op, rs)) {
+		if (miss) {
+			BPRED.ras_misses++;
+		} else {
+			BPRED.ras_hits++;
+		}
+	} else if (taken && (btb = bpred_btb(pc)) != NULL) {
+		btb->tag = pc;
+		btb->target = next;
+	}
+}
+
+/***************************************************************/
+/* Order per-PC counters by mispredictions, most first                     */
+/***************************************************************/
+static int bpred_compare(const void *a, const void *b)
+{
+	const bpred_pc_stats_t *x = *(bpred_pc_stats_t *const *)a, *y = *(bpred_pc_stats_t *const *)b;
+
+	if (x->mispredicts != y->mispredicts) {
+		return x->mispredicts < y->mispredicts ? 1 : -1;
+	}
+	return x->pc < y->pc ? -1 : x->pc > y->pc;
+}
+
+/***************************************************************/
+/* Print accuracy and the worst predicted branches                            */
+/***************************************************************/
+void bpred_report()
+{
+	static const char *names[] = { "not taken", "bimodal", "gshare" };
+	bpred_pc_stats_t **sorted;
+	uint32_t i, n = 0;
+	uint64_t total = BPRED.branches + BPRED.jumps;
+	uint64_t misses = BPRED.branch_mispredicts + BPRED.jump_mispredicts;
+
+	printf("Branch predictor\t: %s", names[BPRED.type]);
+	if (BPRED.type != BPRED_NOTTAKEN) {
+		printf(", %u counters", BPRED.table_size);
+		if (BPRED.type == BPRED_GSHARE) {
+			printf(", %u history bits", BPRED.history_bits);
+		}
+		printf(", %u-entry BTB, %u-entry RAS", BPRED.btb_size, BPRED.ras_size);
+	}
+	printf("\n");
+	printf("  control instructions %llu, mispredicted %llu (%.2f%% accurate)\n",
+			(unsigned long long)total, (unsigned long long)misses,
+			total ? 100.0 * (total - misses) / total : 100.0);
+	printf("  branches %llu, mispredicted %llu; jumps %llu, mispredicted %llu\n",
+			(unsigned long long)BPRED.branches, (unsigned long long)BPRED.branch_mispredicts,
+			(unsigned long long)BPRED.jumps, (unsigned long long)BPRED.jump_mispredicts);
+	if (BPRED.type != BPRED_NOTTAKEN) {
+		printf("  BTB hits %llu, misses %llu; RAS hits %llu, misses %llu\n",
+				(unsigned long long)BPRED.btb_hits, (unsigned long long)BPRED.btb_misses,
+				(unsigned long long)BPRED.ras_hits, (unsigned long long)BPRED.ras_misses);
+	}
+
+	if (BPRED.pcs_used == 0) {
+		printf("\n");
+		return;
+	}
+	sorted = malloc(BPRED.pcs_used * sizeof(*sorted));
+	if (sorted == NULL) {
+		return;
+	}
+	for (i = 0; i < BPRED_STATS_SIZE; i++) {
+		if (BPRED.pcs[i].executed != 0) {
+			sorted[n++] = &BPRED.pcs[i];
+		}
+	}
+	qsort(sorted, n, sizeof(*sorted), bpred_compare);
+	if (n > 0 && sorted[0]->mispredicts > 0) {
+		printf("  most mispredicted:\texecuted\ttaken\tmispredicted\n");
+	}
+	for (i = 0; i < n && i < BPRED_REPORT_TOP && sorted[i]->mispredicts > 0; i++) {
+		printf("  [0x%08x]\t\t%llu\t\t%llu\t%llu\t", sorted[i]->pc,
+				(unsigned long long)sorted[i]->executed, (unsigned long long)sorted[i]->taken,
+				(unsigned long long)sorted[i]->mispredicts);
+		print_instruction(sorted[i]->pc);
+	}
+	free(sorted);
+	printf("\n");
+}
@@ -0,0 +1,58 @@
+#include <stdint.h>
+
+/***************************************************************/
+/* Branch prediction for the pipeline model.                                         */
+/* The fetch stage asks for the next PC of every instruction it            */
+/* fetches and reports the real successor once the instruction has      */
+/* executed. A direction predictor, a branch target buffer and a         */
+/* return address stack make up the prediction.                                  */
+/***************************************************************/
+
+enum { BPRED_NOTTAKEN, BPRED_BIMODAL, BPRED_GSHARE };
+
+#define BPRED_STATS_SIZE (1 << 14)          /* per-PC counters, power of two */
+#define BPRED_REPORT_TOP 10
+
+typedef struct {
+	uint32_t tag;                          /* branch PC */
+	uint32_t target;
+} btb_entry_t;
+
+typedef struct {
+	uint32_t pc;
+	uint64_t executed, taken, mispredicts;
+} bpred_pc_stats_t;
+
+typedef struct bpred_struct {
+	/* configuration */
+	int type;
+	uint32_t table_size;                   /* 2-bit counters, power of two */
+	uint32_t history_bits;                 /* gshare global history length */
+	uint32_t btb_size;                     /* direct-mapped, power of two, 0 = none */
+	uint32_t ras_size;                     /* 0 = none */
+	uint32_t penalty;                      /* fetch cycles lost per misprediction, 0 = until resolved */
+	/* state */
+	uint8_t *counters;
+	uint32_t history;
+	btb_entry_t *btb;
+	uint32_t *ras;
+	uint32_t ras_top;                      /* entries pushed, wraps over the oldest */
+	/* statistics */
+	uint64_t branches, branch_mispredicts;  /* conditional */
+	uint64_t jumps, jump_mispredicts;       /* J/JAL/JR/JALR */
+	uint64_t btb_hits, btb_misses, ras_hits, ras_misses;
+	bpred_pc_stats_t *pcs;                 /* BPRED_STATS_SIZE, allocated on the first update */
+	uint32_t pcs_used;
+} bpred_t;
+
+extern bpred_t BPRED_CONFIG;               /* options, copied into each machine */
+
+#define BPRED (*MACHINE->bpred)
+
+int bpred_option(const char *opt);
+int bpred_init();
+void bpred_reset();
+void bpred_release();
+uint32_t bpred_predict(uint32_t pc, uint8_t op, uint8_t rs);
+void bpred_update(uint32_t pc, uint8_t op, uint8_t rs, uint32_t next, uint32_t predicted);
+void bpred_report();
@@ -0,0 +1,362 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "mu-mips-cache.h"
+#include "mu-mips-dram.h"
+#include "mu-mips-smp.h"
+
+/***************************************************************/
+/* L1 caches. A hit costs nothing beyond the pipeline stage, a miss     */
+/* costs MEM_LATENCY and a dirty victim another MEM_LATENCY. Write-     */
+/* through stores and write-no-allocate store misses go to a write     */
+/* buffer and never stall, they are only counted. With the DRAM model */
+/* on, fills are DRAM reads and everything written back or through is  */
+/* a queued DRAM write; a disabled cache sends every access there.     */
+/***************************************************************/
+
+cache_t L1I_CONFIG = { "L1I", 0, 32, 2, CACHE_LRU, TRUE, TRUE };
+cache_t L1D_CONFIG = { "L1D", 0, 32, 2, CACHE_LRU, TRUE, TRUE };
+uint32_t MEM_LATENCY = 20;
+
+/***************************************************************/
+/* Parse a size with an optional k or m suffix                                      */
+/***************************************************************/
+static int parse_size(const char *s, uint32_t *value)
+{
+	char *end;
+	unsigned long v = strtoul(s, &end, 0);
+
+	if (end == s) {
+		return FALSE;
+	}
+	if (*end == 'k' || *end == 'K') {
+		v *= 1024;
+		end++;
+	} else if (*end == 'm' || *end == 'M') {
+		v *= 1024 * 1024;
+		end++;
+	}
+	*value = v;
+	return *end == '\0';
+}
+
+/***************************************************************/
+/* Parse a cache option: l1i.<key>=<value>, l1d.<key>=<value> or      */
+/* mem.latency=<cycles>. FALSE if the option is not a cache option    */
+/***************************************************************/
+int cache_option(const char *opt)
+{
+	cache_t *c;
+	const char *key, *value;
+
+	if (strncmp(opt, "mem.latency=", 12) == 0) {
+		return parse_size(opt + 12, &MEM_LATENCY);
+	}
+	if (strncmp(opt, "l1i.", 4) == 0) {
+		c = &L1I_CONFIG;
+	} else if (strncmp(opt, "l1d.", 4) == 0) {
+		c = &L1D_CONFIG;
+	} else {
+		return FALSE;
+	}
+	key = opt + 4;
+	value = strchr(key, '=');
+	if (value == NULL) {
+		return FALSE;
+	}
+	value++;
+
+	if (strncmp(key, "size=", 5) == 0) {
+		return parse_size(value, &c->size);
+	} else if (strncmp(key, "line=", 5) == 0) {
+		return parse_size(value, &c->line_size);
+	} else if (strncmp(key, "assoc=", 6) == 0) {
+		return parse_size(value, &c->assoc);
+	} else if (strcmp(key, "repl=lru") == 0) {
+		c->replacement = CACHE_LRU;
+	} else if (strcmp(key, "repl=fifo") == 0) {
+		c->replacement = CACHE_FIFO;
+	} else if (strcmp(key, "repl=random") == 0) {
+		c->replacement = CACHE_RANDOM;
+	} else if (strcmp(key, "write=wb") == 0) {
+		c->write_back = TRUE;
+	} else if (strcmp(key, "write=wt") == 0) {
+		c->write_back = FALSE;
+	} else if (strcmp(key, "alloc=on") == 0) {
+		c->write_allocate = TRUE;
+	} else if (strcmp(key, "alloc=off") == 0) {
+		c->write_allocate = FALSE;
+	} else {
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/***************************************************************/
+/* Take the configured geometry, check it and allocate the tag array. */
+/* FALSE if it is invalid or can't be allocated                                   */
+/***************************************************************/
+static int cache_setup(cache_t **cp, const cache_t *config)
+{
+	cache_t *c = *cp;
+
+	if (c == NULL) {
+		c = *cp = malloc(sizeof(cache_t));
+		if (c == NULL) {
+			printf("Error: Can't allocate %s\n", config->name);
+			return FALSE;
+		}
+	} else {
+		free(c->lines);
+	}
+	*c = *config;
+	c->lines = NULL;
+	if (c->size == 0) {
+		return TRUE;
+	}
+	if (c->line_size < 4 || (c->line_size & (c->line_size - 1)) || c->assoc == 0 ||
+			c->size % (c->line_size * c->assoc) != 0) {
+		printf("Error: %s size %u is not a multiple of %u-byte lines times %u ways\n",
+				c->name, c->size, c->line_size, c->assoc);
+		return FALSE;
+	}
+	c->sets = c->size / (c->line_size * c->assoc);
+	if (c->sets & (c->sets - 1)) {
+		printf("Error: %s has %u sets, it must be a power of two\n", c->name, c->sets);
+		return FALSE;
+	}
+	for (c->line_shift = 0; (1u << c->line_shift) < c->line_size; c->line_shift++);
+	c->lines = calloc(c->sets * c->assoc, sizeof(cache_line_t));
+	if (c->lines == NULL) {
+		printf("Error: Can't allocate %s tags\n", c->name);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+int cache_init()
+{
+	if (!cache_setup(&MACHINE->l1i, &L1I_CONFIG) || !cache_setup(&MACHINE->l1d, &L1D_CONFIG)) {
+		return FALSE;
+	}
+	cache_reset();
+	return TRUE;
+}
+
+void cache_release()
+{
+	if (MACHINE->l1i != NULL) {
+		free(L1I.lines);
+		free(MACHINE->l1i);
+		MACHINE->l1i = NULL;
+	}
+	if (MACHINE->l1d != NULL) {
+		free(L1D.lines);
+		free(MACHINE->l1d);
+		MACHINE->l1d = NULL;
+	}
+}
+
+/***************************************************************/
+/* Invalidate every line and clear the counters                                    */
+/***************************************************************/
+static void cache_clear(cache_t *c)
+{
+	if (c->lines != NULL) {
+		memset(c->lines, 0, c->sets * c->assoc * sizeof(cache_line_t));
+	}
+	c->clock = 0;
+	c->random = 0x2545F491;
+	c->reads = c->writes = c->read_misses = c->write_misses = 0;
+	c->evictions = c->writebacks = c->mem_writes = 0;
+	c->coherence_misses = 0;
+}
+
+void cache_reset()
+{
+	if (MACHINE->l1i == NULL) {
+		return;
+	}
+	cache_clear(&L1I);
+	cache_clear(&L1D);
+}
+
+/***************************************************************/
+/* Pick the way to refill in a full set                                                      */
+/***************************************************************/
+static cache_line_t *cache_victim(cache_t *c, cache_line_t *set)
+{
+	cache_line_t *victim = set;
+	uint32_t i;
+
+	for (i = 0; i < c->assoc; i++) {
+		if (!set[i].valid) {
+			return &set[i];
+		}
+	}
+	if (c->replacement == CACHE_RANDOM) {
+		/* xorshift, deterministic from run to run */
+		c->random ^= c->random << 13;
+		c->random ^= c->random >> 17;
+		c->random ^= c->random << 5;
+		return &set[c->random % c->assoc];
+	}
+	/* LRU and FIFO both evict the oldest stamp, they differ in when it is set */
+	for (i = 1; i < c->assoc; i++) {
+		if (set[i].stamp < victim->stamp) {
+			victim = &set[i];
+		}
+	}
+	return victim;
+}
+
+/* stall cycles of a line fill */
+static uint32_t cache_fill(const cache_t *c, uint32_t block)
+{
+	return DRAM.enabled ? dram_read(block << c->line_shift, c->line_size) : MEM_LATENCY;
+}
+
+/* stall cycles of writing back a dirty line */
+static uint32_t cache_writeback(const cache_t *c, uint32_t block)
+{
+	return DRAM.enabled ? dram_write(block << c->line_shift, c->line_size) : MEM_LATENCY;
+}
+
+/* stall cycles of a word going through the write buffer */
+static uint32_t cache_write_through(cache_t *c, uint32_t addr)
+{
+	c->mem_writes++;
+	return DRAM.enabled ? dram_write(addr & ~3u, 4) : 0;
+}
+
+/***************************************************************/
+/* Invalidate this cache's copy of block, if it has one                      */
+/***************************************************************/
+static void cache_drop(cache_t *c, uint32_t block)
+{
+	cache_line_t *set = &c->lines[(block & (c->sets - 1)) * c->assoc];
+	uint32_t i;
+
+	for (i = 0; i < c->assoc; i++) {
+		if (set[i].valid && set[i].tag == block / c->sets) {
+			set[i].valid = FALSE;
+			c->coherence_misses++;
+		}
+	}
+}
+
+/***************************************************************/
+/* Look up addr, filling on a miss. Returns the stall cycles. On a    */
+/* multicore machine the data cache first settles the line with the */
+/* other cores, see mu-mips-smp.h                                                           */
+/***************************************************************/
+uint32_t cache_access(cache_t *c, uint32_t addr, int write)
+{
+	cache_line_t *set, *line;
+	uint32_t block, tag, victim, i, latency = 0, coherence = 0;
+	int coherent = MACHINE->smp != NULL && c == MACHINE->l1d, held = TRUE, supplied = FALSE;
+
+	if (c->lines == NULL) {
+		if (!DRAM.enabled) {
+			return 0;
+		}
+		return write ? dram_write(addr & ~3u, 4) : dram_read(addr & ~3u, 4);
+	}
+	if (write) {
+		c->writes++;
+	} else {
+		c->reads++;
+	}
+	c->clock++;
+
+	block = addr >> c->line_shift;
+	tag = block / c->sets;
+	set = &c->lines[(block & (c->sets - 1)) * c->assoc];
+	if (coherent) {
+		coherence = smp_coherence(block, write, &held, &supplied);
+		if (!held) {
+			cache_drop(c, block);
+		}
+	}
+	for (i = 0; i < c->assoc; i++) {
+		line = &set[i];
+		if (line->valid && line->tag == tag) {
+			if (c->replacement == CACHE_LRU) {
+				line->stamp = c->clock;
+			}
+			if (write && c->write_back) {
+				line->dirty = TRUE;
+			} else if (write) {
+				return coherence + cache_write_through(c, addr);
+			}
+			return coherence;
+		}
+	}
+
+	if (write) {
+		c->write_misses++;
+		if (!c->write_allocate) {
+			if (coherent) {
+				/* the word goes around the cache, which keeps no copy */
+				smp_evict(block);
+			}
+			return coherence + cache_write_through(c, addr);
+		}
+	} else {
+		c->read_misses++;
+	}
+
+	line = cache_victim(c, set);
+	if (line->valid) {
+		c->evictions++;
+		victim = line->tag * c->sets + (block & (c->sets - 1));
+		/* another core may have taken the line, then it holds the data */
+		if (coherent && !smp_evict(victim)) {
+			line->dirty = FALSE;
+		}
+		if (line->dirty) {
+			c->writebacks++;
+			latency += cache_writeback(c, victim);
+		}
+	}
+	latency += supplied ? coherence : coherence + cache_fill(c, block);
+	line->valid = TRUE;
+	line->tag = tag;
+	line->stamp = c->clock;
+	line->dirty = write && c->write_back;
+	if (write && !c->write_back) {
+		latency += cache_write_through(c, addr);
+	}
+	return latency;
+}
+
+/***************************************************************/
+/* Print one cache's configuration and counters                                    */
+/***************************************************************/
+void cache_report(const cache_t *c)
+{
+	static const char *repl[] = { "LRU", "FIFO", "random" };
+	uint64_t accesses = c->reads + c->writes, misses = c->read_misses + c->write_misses;
+
+	if (c->lines == NULL) {
+		return;
+	}
+	printf("%s: %u bytes, %u-byte lines, %u-way, %s, %s, %s\n", c->name, c->size, c->line_size,
+			c->assoc, repl[c->replacement], c->write_back ? "write-back" : "write-through",
+			c->write_allocate ? "write-allocate" : "no-write-allocate");
+	printf("  accesses %llu (%llu reads, %llu writes), hits %llu, misses %llu (%.2f%%)\n",
+			(unsigned long long)accesses, (unsigned long long)c->reads, (unsigned long long)c->writes,
+			(unsigned long long)(accesses - misses), (unsigned long long)misses,
+			accesses ? 100.0 * misses / accesses : 0.0);
+	printf("  read misses %llu, write misses %llu, evictions %llu, writebacks %llu, memory writes %llu\n",
+			(unsigned long long)c->read_misses, (unsigned long long)c->write_misses,
+			(unsigned long long)c->evictions, (unsigned long long)c->writebacks,
+			(unsigned long long)c->mem_writes);
+	if (c->coherence_misses > 0) {
+		printf("  coherence misses %llu (copies invalidated by other cores)\n",
+				(unsigned long long)c->coherence_misses);
+	}
+}
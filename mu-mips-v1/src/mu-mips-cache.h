@@ -0,0 +1,47 @@
+#include <stdint.h>
+
+/***************************************************************/
+/* Set-associative cache timing model.                                                  */
+/* Only tags are kept, the data stays in guest memory. The pipeline */
+/* model sends every fetch through L1I and every load and store        */
+/* through L1D and stalls for the latency returned.                             */
+/***************************************************************/
+
+enum { CACHE_LRU, CACHE_FIFO, CACHE_RANDOM };
+
+typedef struct {
+	uint32_t tag;
+	int valid, dirty;
+	uint64_t stamp;                        /* last use (LRU) or fill (FIFO) */
+} cache_line_t;
+
+typedef struct cache_struct {
+	const char *name;
+	/* configuration, size 0 disables the cache (every access hits) */
+	uint32_t size, line_size, assoc;
+	int replacement;
+	int write_back;                        /* FALSE: write-through with a write buffer */
+	int write_allocate;
+	/* derived */
+	uint32_t sets, line_shift;
+	cache_line_t *lines;                   /* sets * assoc, set-major */
+	uint64_t clock;
+	uint32_t random;
+	/* statistics */
+	uint64_t reads, writes, read_misses, write_misses;
+	uint64_t evictions, writebacks, mem_writes;
+	uint64_t coherence_misses;             /* the line was there but another core had invalidated it */
+} cache_t;
+
+extern cache_t L1I_CONFIG, L1D_CONFIG;      /* options, copied into each machine */
+
+#define L1I (*MACHINE->l1i)
+#define L1D (*MACHINE->l1d)
+extern uint32_t MEM_LATENCY;               /* cycles to fetch or write back a line */
+
+int cache_option(const char *opt);
+int cache_init();
+void cache_reset();
+void cache_release();
+uint32_t cache_access(cache_t *c, uint32_t addr, int write);
+void cache_report(const cache_t *c);
@@ -0,0 +1,375 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "mu-mips-pipeline.h"
+#include "mu-mips-debug.h"
+
+static const char *COND_NAMES[] = { "", "==", "!=", "<", "<=", ">", ">=" };
+
+/***************************************************************/
+/* Does the point's condition hold on the current registers               */
+/***************************************************************/
+static int debug_cond(const debug_point_t *p)
+{
+	int32_t reg = CURRENT_STATE.REGS[p->cond.reg], value = p->cond.value;
+
+	switch (p->cond.op) {
+		case DEBUG_EQ:
+			return reg == value;
+		case DEBUG_NE:
+			return reg != value;
+		case DEBUG_LT:
+			return reg < value;
+		case DEBUG_LE:
+			return reg <= value;
+		case DEBUG_GT:
+			return reg > value;
+		case DEBUG_GE:
+			return reg >= value;
+		default:
+			return TRUE;
+	}
+}
+
+/***************************************************************/
+/* Remember the first point hit in a run and wind the run down         */
+/***************************************************************/
+static void debug_hit(const debug_point_t *p, int kind, uint32_t address, uint32_t size)
+{
+	if (DEBUG.pending) {
+		return;
+	}
+	DEBUG.pending = TRUE;
+	DEBUG.stop_id = p->id;
+	DEBUG.stop_kind = kind;
+	DEBUG.stop_pc = CURRENT_STATE.PC;
+	DEBUG.stop_addr = address;
+	DEBUG.stop_size = size;
+	RUN_FLAG = FALSE;
+}
+
+/***************************************************************/
+/* Take every mark off the pages, decoded breakpoints decode again    */
+/***************************************************************/
+static void debug_clear_pages()
+{
+	mem_page_t *page;
+	uint32_t i;
+
+	for (page = MEM_PAGES; page != NULL; page = page->next) {
+		if (page->breaks != NULL && page->decoded != NULL) {
+			for (i = 0; i < MEM_PAGE_SIZE / 4; i++) {
+				if (page->decoded[i].op == OP_BREAKPOINT) {
+					page->decoded[i].op = OP_INVALID;
+				}
+			}
+		}
+		free(page->breaks);
+		page->breaks = NULL;
+		page->watch = 0;
+	}
+}
+
+/***************************************************************/
+/* Mark the pages of every point, materializing them. FALSE if a      */
+/* breakpoint's bitmap can't be allocated, that one is left unmarked  */
+/***************************************************************/
+static int debug_mark_pages()
+{
+	debug_point_t *p;
+	mem_page_t *page;
+	uint32_t address, word;
+	int i, marked = TRUE;
+
+	debug_clear_pages();
+	for (i = 0; i < DEBUG.num_points; i++) {
+		p = &DEBUG.points[i];
+		if (p->kind == DEBUG_BREAK) {
+			page = mem_page(p->begin, TRUE);
+			if (page == NULL) {
+				continue;
+			}
+			if (page->breaks == NULL) {
+				page->breaks = calloc(MEM_PAGE_SIZE / 4 / 32, sizeof(uint32_t));
+				if (page->breaks == NULL) {
+					printf("Error: Can't allocate breakpoints for address 0x%08x\n", p->begin);
+					marked = FALSE;
+					continue;
+				}
+			}
+			word = (p->begin & MEM_PAGE_MASK) >> 2;
+			page->breaks[word >> 5] |= 1u << (word & 31);
+			/* fetch puts the breakpoint in when it decodes the word again */
+			if (page->decoded != NULL) {
+				page->decoded[word].op = OP_INVALID;
+			}
+			continue;
+		}
+		for (address = p->begin & ~MEM_PAGE_MASK; ; address += MEM_PAGE_SIZE) {
+			page = mem_page(address, TRUE);
+			if (page != NULL) {
+				page->watch |= p->kind;
+			}
+			if (address == (p->end & ~MEM_PAGE_MASK)) {
+				break;
+			}
+		}
+	}
+	/* watched pages may sit in the TLBs */
+	mem_tlb_flush();
+	return marked;
+}
+
+/***************************************************************/
+/* Add a breakpoint at begin, or a watchpoint on begin..end. Returns  */
+/* its number, 0 if it can't be set                                                        */
+/***************************************************************/
+int debug_add(int kind, uint32_t begin, uint32_t end, const debug_cond_t *cond)
+{
+	debug_point_t *p;
+
+	if (MACHINE->smp != NULL) {
+		printf("Error: Breakpoints and watchpoints work on a single core\n");
+		return 0;
+	}
+	if (kind == DEBUG_BREAK && ((begin & 0x3) || mem_page(begin, TRUE) == NULL)) {
+		printf("Error: No instruction at 0x%08x\n", begin);
+		return 0;
+	}
+	if (kind != DEBUG_BREAK && (end < begin || end - begin >= DEBUG_WATCH_MAX)) {
+		printf("Error: Watch 0x%08x..0x%08x, at most %u bytes\n", begin, end, DEBUG_WATCH_MAX);
+		return 0;
+	}
+	if (cond->op != DEBUG_COND_NONE && cond->reg >= MIPS_REGS) {
+		printf("Error: No register %u\n", cond->reg);
+		return 0;
+	}
+	if (MACHINE->debug == NULL) {
+		MACHINE->debug = calloc(1, sizeof(debug_t));
+		if (MACHINE->debug == NULL) {
+			printf("Error: Can't allocate the breakpoint table\n");
+			return 0;
+		}
+		DEBUG.next_id = 1;
+	}
+	if (DEBUG.num_points == DEBUG_MAX_POINTS) {
+		printf("Error: At most %d breakpoints and watchpoints\n", DEBUG_MAX_POINTS);
+		return 0;
+	}
+	p = &DEBUG.points[DEBUG.num_points++];
+	p->id = DEBUG.next_id++;
+	p->kind = kind;
+	p->begin = begin;
+	p->end = kind == DEBUG_BREAK ? begin : end;
+	p->cond = *cond;
+	p->hits = 0;
+	if (!debug_mark_pages()) {
+		DEBUG.num_points--;
+		debug_mark_pages();
+		return 0;
+	}
+	return p->id;
+}
+
+/***************************************************************/
+/* Delete a point, or every point with id 0. FALSE if there is none    */
+/***************************************************************/
+int debug_delete(int id)
+{
+	int i;
+
+	if (MACHINE->debug == NULL) {
+		return FALSE;
+	}
+	if (id == 0) {
+		DEBUG.num_points = 0;
+	} else {
+		for (i = 0; i < DEBUG.num_points && DEBUG.points[i].id != id; i++) {
+		}
+		if (i == DEBUG.num_points) {
+			return FALSE;
+		}
+		memmove(&DEBUG.points[i], &DEBUG.points[i + 1], (DEBUG.num_points - i - 1) * sizeof(debug_point_t));
+		DEBUG.num_points--;
+	}
+	debug_mark_pages();
+	return TRUE;
+}
+
+/***************************************************************/
+/* Print the points with their conditions and hit counts                   */
+/***************************************************************/
+void debug_list()
+{
+	static const char *kinds[] = { "break", "watch read", "watch write", "watch access" };
+	debug_point_t *p;
+	int i;
+
+	if (MACHINE->debug == NULL || DEBUG.num_points == 0) {
+		printf("No breakpoints or watchpoints.\n\n");
+		return;
+	}
+	printf("[Id]\t[Kind]\t\t[Address]\t\t[Hits]\t[Condition]\n");
+	for (i = 0; i < DEBUG.num_points; i++) {
+		p = &DEBUG.points[i];
+		printf("%d\t%-12s\t", p->id, kinds[p->kind]);
+		if (p->kind == DEBUG_BREAK || p->begin == p->end) {
+			printf("0x%08x\t\t", p->begin);
+		} else {
+			printf("0x%08x..0x%08x\t", p->begin, p->end);
+		}
+		printf("%llu\t", (unsigned long long)p->hits);
+		if (p->cond.op != DEBUG_COND_NONE) {
+			printf("R%u %s %d", p->cond.reg, COND_NAMES[p->cond.op], (int32_t)p->cond.value);
+		}
+		printf("\n");
+	}
+	printf("\n");
+}
+
+/***************************************************************/
+/* Mark the points again after memory was replaced (load, snapshot)  */
+/* and forget the last stop                                                                         */
+/***************************************************************/
+void debug_apply()
+{
+	if (MACHINE->debug == NULL) {
+		return;
+	}
+	DEBUG.pending = DEBUG.held = DEBUG.skip = DEBUG.stopped = FALSE;
+	debug_mark_pages();
+}
+
+void debug_release()
+{
+	free(MACHINE->debug);
+	MACHINE->debug = NULL;
+}
+
+/***************************************************************/
+/* Decide whether the breakpoint at pc stops the run before its        */
+/* instruction. Decided once per execution: when it does not stop,   */
+/* the OP_BREAKPOINT handler that follows executes the instruction    */
+/***************************************************************/
+int debug_stop(uint32_t pc)
+{
+	debug_point_t *p;
+	int i;
+
+	if (DEBUG.skip || !DEBUG.armed) {
+		return FALSE;
+	}
+	for (i = 0; i < DEBUG.num_points; i++) {
+		p = &DEBUG.points[i];
+		if (p->kind == DEBUG_BREAK && p->begin == pc && debug_cond(p)) {
+			p->hits++;
+			debug_hit(p, DEBUG_BREAK, pc, 0);
+			DEBUG.held = TRUE;
+			return TRUE;
+		}
+	}
+	DEBUG.skip = TRUE;
+	return FALSE;
+}
+
+/***************************************************************/
+/* OP_BREAKPOINT: stop, or run the instruction the word decodes to   */
+/***************************************************************/
+void debug_break(decoded_inst_t *d)
+{
+	decoded_inst_t e;
+
+	if (debug_stop(CURRENT_STATE.PC)) {
+		/* stay on the instruction, it executes when the run resumes */
+		NEXT_STATE.PC = CURRENT_STATE.PC;
+		INSTRUCTION_COUNT--;
+		return;
+	}
+	DEBUG.skip = FALSE;
+	decode_instruction(CURRENT_STATE.PC, d->word, &e);
+	execute_as(d, e.op);
+}
+
+/***************************************************************/
+/* An access to a watched page, from the memory slow path                 */
+/***************************************************************/
+void debug_watch(uint32_t address, uint32_t size, int write)
+{
+	debug_point_t *p;
+	int i, kind = write ? DEBUG_WRITE : DEBUG_READ;
+
+	if (MACHINE->debug == NULL || !DEBUG.armed) {
+		/* the simulator's own accesses, between runs */
+		return;
+	}
+	for (i = 0; i < DEBUG.num_points; i++) {
+		p = &DEBUG.points[i];
+		if ((p->kind & kind) && address <= p->end && address + size - 1 >= p->begin && debug_cond(p)) {
+			p->hits++;
+			debug_hit(p, kind, address, size);
+		}
+	}
+}
+
+/***************************************************************/
+/* run_core with the points armed. A point that was hit stopped the  */
+/* run the way a halt does, the program goes on from there next time */
+/***************************************************************/
+uint32_t debug_run(uint32_t max)
+{
+	uint32_t n;
+
+	if (DEBUG.stopped) {
+		/* resuming on the breakpoint that stopped the last run executes it */
+		DEBUG.skip = DEBUG.stop_kind == DEBUG_BREAK && CURRENT_STATE.PC == DEBUG.stop_pc;
+		DEBUG.stopped = FALSE;
+	}
+	DEBUG.held = FALSE;
+	DEBUG.armed = TRUE;
+	n = run_core(max);
+	DEBUG.armed = FALSE;
+	if (DEBUG.pending && !RUN_FLAG) {
+		DEBUG.pending = FALSE;
+		DEBUG.stopped = TRUE;
+		RUN_FLAG = TRUE;
+		timing_resume();
+	}
+	return n;
+}
+
+/***************************************************************/
+/* Did the last run end at a point                                                          */
+/***************************************************************/
+int debug_stopped()
+{
+	return MACHINE->debug != NULL && DEBUG.stopped;
+}
+
+/***************************************************************/
+/* Say which point stopped the last run                                                 */
+/***************************************************************/
+void debug_report()
+{
+	int i;
+
+	if (!debug_stopped()) {
+		return;
+	}
+	for (i = 0; i < DEBUG.num_points && DEBUG.points[i].id != DEBUG.stop_id; i++) {
+	}
+	if (DEBUG.stop_kind == DEBUG_BREAK) {
+		printf("Breakpoint %d at 0x%08x", DEBUG.stop_id, DEBUG.stop_pc);
+	} else {
+		printf("Watchpoint %d: %s of %u byte%s at 0x%08x by the instruction at 0x%08x", DEBUG.stop_id,
+				DEBUG.stop_kind == DEBUG_WRITE ? "write" : "read", DEBUG.stop_size,
+				DEBUG.stop_size == 1 ? "" : "s", DEBUG.stop_addr, DEBUG.stop_pc);
+	}
+	if (i < DEBUG.num_points) {
+		printf(", hit %llu time%s", (unsigned long long)DEBUG.points[i].hits, DEBUG.points[i].hits == 1 ? "" : "s");
+	}
+	printf("\n# Instructions Executed\t: %llu\n", (unsigned long long)INSTRUCTION_COUNT);
+	printf("PC\t: 0x%08x\n\n", CURRENT_STATE.PC);
+}
@@ -0,0 +1,73 @@
+#include <stdint.h>
+
+/***************************************************************/
+/* Breakpoints and watchpoints.                                                                       */
+/* A breakpoint is a bit in its page's bitmap. Fetch decodes a word     */
+/* with its bit set as OP_BREAKPOINT, whose handler either stops the   */
+/* run before the instruction or executes it as the instruction it    */
+/* decoded to, so code without breakpoints runs exactly as before.     */
+/* A watched page carries the kinds of access watched on it and is     */
+/* never entered in the TLB those accesses use: they all take the        */
+/* slow path, which checks the watchpoints. Watchpoints stop the run  */
+/* after the access, once the instruction has completed.                      */
+/* Either kind may have a condition on a register, compared signed,     */
+/* and counts the times it was hit. Under the timing models a stop     */
+/* drains the pipeline the way a halt does. Single core only, the JIT  */
+/* engine runs on the interpreter while any point is set.                      */
+/***************************************************************/
+
+#define DEBUG_MAX_POINTS 64
+#define DEBUG_WATCH_MAX  (1 << 20)         /* bytes one watchpoint may cover */
+
+enum {
+	DEBUG_BREAK = 0,
+	DEBUG_READ = MEM_WATCH_READ,
+	DEBUG_WRITE = MEM_WATCH_WRITE,
+	DEBUG_ACCESS = MEM_WATCH_READ | MEM_WATCH_WRITE
+};
+
+enum { DEBUG_COND_NONE, DEBUG_EQ, DEBUG_NE, DEBUG_LT, DEBUG_LE, DEBUG_GT, DEBUG_GE };
+
+typedef struct {
+	int op;                                /* DEBUG_COND_NONE: always */
+	uint32_t reg;
+	uint32_t value;
+} debug_cond_t;
+
+typedef struct {
+	int id;
+	int kind;
+	uint32_t begin, end;                   /* watched bytes, inclusive; begin is the PC of a breakpoint */
+	debug_cond_t cond;
+	uint64_t hits;                         /* times it was reached with the condition holding */
+} debug_point_t;
+
+typedef struct debug_struct {
+	debug_point_t points[DEBUG_MAX_POINTS];
+	int num_points;
+	int next_id;
+	/* the stop in progress */
+	int armed;                             /* a run is in progress, watchpoints may fire */
+	int pending;                           /* a point was hit, the run is winding down */
+	int held;                              /* the instruction under the breakpoint did not execute */
+	int skip;                              /* the next breakpoint reached executes without a check */
+	int stopped;                           /* the last run ended at a point */
+	int stop_id, stop_kind;
+	uint32_t stop_pc;                      /* instruction that hit it */
+	uint32_t stop_addr, stop_size;         /* access that hit a watchpoint */
+} debug_t;
+
+#define DEBUG (*MACHINE->debug)
+
+/* an OP_BREAKPOINT entry whose instruction was held back by a stop */
+#define DEBUG_HELD(d) ((d)->op == OP_BREAKPOINT && MACHINE->debug->held)
+
+int debug_add(int kind, uint32_t begin, uint32_t end, const debug_cond_t *cond);
+int debug_delete(int id);
+void debug_list();
+void debug_apply();
+void debug_release();
+int debug_stop(uint32_t pc);
+uint32_t debug_run(uint32_t max);
+int debug_stopped();
+void debug_report();
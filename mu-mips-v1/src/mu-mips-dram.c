@@ -0,0 +1,312 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "mu-mips.h"
+#include "mu-mips-dram.h"
+
+/***************************************************************/
+/* DRAM controller. Time is the requester's cycle count in DRAM.now,   */
+/* which only moves forward. Queued writes are issued whenever the     */
+/* controller is next consulted, as far as they could have started by */
+/* then, so they mostly use the time the core spends elsewhere.           */
+/* Addresses are split row:bank:channel:column, a sequential stream  */
+/* stays in one row until it moves to the next channel.                       */
+/***************************************************************/
+
+dram_t DRAM_CONFIG = { FALSE, 1, 8, 2048, TRUE, 15, 15, 15, 8, 16 };
+
+static int parse_uint(const char *s, uint32_t *value)
+{
+	char *end;
+
+	*value = strtoul(s, &end, 0);
+	if (*end == 'k' || *end == 'K') {
+		*value *= 1024;
+		end++;
+	}
+	return end != s && *end == '\0';
+}
+
+/***************************************************************/
+/* Parse a DRAM option, FALSE if it is not one                                        */
+/***************************************************************/
+int dram_option(const char *opt)
+{
+	if (strcmp(opt, "dram=on") == 0) {
+		DRAM_CONFIG.enabled = TRUE;
+	} else if (strcmp(opt, "dram=off") == 0) {
+		DRAM_CONFIG.enabled = FALSE;
+	} else if (strcmp(opt, "dram.page=open") == 0) {
+		DRAM_CONFIG.open_page = TRUE;
+	} else if (strcmp(opt, "dram.page=closed") == 0) {
+		DRAM_CONFIG.open_page = FALSE;
+	} else if (strncmp(opt, "dram.channels=", 14) == 0) {
+		return parse_uint(opt + 14, &DRAM_CONFIG.channels);
+	} else if (strncmp(opt, "dram.banks=", 11) == 0) {
+		return parse_uint(opt + 11, &DRAM_CONFIG.banks);
+	} else if (strncmp(opt, "dram.row=", 9) == 0) {
+		return parse_uint(opt + 9, &DRAM_CONFIG.row_size);
+	} else if (strncmp(opt, "dram.tcas=", 10) == 0) {
+		return parse_uint(opt + 10, &DRAM_CONFIG.tcas);
+	} else if (strncmp(opt, "dram.trcd=", 10) == 0) {
+		return parse_uint(opt + 10, &DRAM_CONFIG.trcd);
+	} else if (strncmp(opt, "dram.trp=", 9) == 0) {
+		return parse_uint(opt + 9, &DRAM_CONFIG.trp);
+	} else if (strncmp(opt, "dram.bus=", 9) == 0) {
+		return parse_uint(opt + 9, &DRAM_CONFIG.bus_width) && DRAM_CONFIG.bus_width > 0;
+	} else if (strncmp(opt, "dram.queue=", 11) == 0) {
+		return parse_uint(opt + 11, &DRAM_CONFIG.queue_size) && DRAM_CONFIG.queue_size > 0;
+	} else {
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static uint32_t log2_of(uint32_t n)
+{
+	uint32_t bits = 0;
+
+	while ((1u << bits) < n) {
+		bits++;
+	}
+	return bits;
+}
+
+/***************************************************************/
+/* Check the geometry and allocate the machine's banks and queue     */
+/***************************************************************/
+int dram_init()
+{
+	if (MACHINE->dram == NULL) {
+		MACHINE->dram = calloc(1, sizeof(dram_t));
+		if (MACHINE->dram == NULL) {
+			printf("Error: Can't allocate the DRAM model\n");
+			return FALSE;
+		}
+	}
+	memcpy(MACHINE->dram, &DRAM_CONFIG, offsetof(dram_t, row_shift));
+	if (DRAM.channels == 0 || (DRAM.channels & (DRAM.channels - 1)) || DRAM.banks == 0 ||
+			(DRAM.banks & (DRAM.banks - 1)) || DRAM.row_size < 64 || (DRAM.row_size & (DRAM.row_size - 1))) {
+		printf("Error: DRAM channels (%u), banks (%u) and row size (%u, at least 64) must be powers of two\n",
+				DRAM.channels, DRAM.banks, DRAM.row_size);
+		return FALSE;
+	}
+	DRAM.row_shift = log2_of(DRAM.row_size);
+	DRAM.channel_bits = log2_of(DRAM.channels);
+	DRAM.bank_bits = log2_of(DRAM.banks);
+	free(DRAM.bank);
+	free(DRAM.bus_ready);
+	free(DRAM.queue);
+	DRAM.bank = malloc(DRAM.channels * DRAM.banks * sizeof(dram_bank_t));
+	DRAM.bus_ready = malloc(DRAM.channels * sizeof(uint64_t));
+	DRAM.queue = malloc((DRAM.queue_size + 1) * sizeof(dram_request_t));
+	if (DRAM.bank == NULL || DRAM.bus_ready == NULL || DRAM.queue == NULL) {
+		printf("Error: Can't allocate the DRAM model\n");
+		return FALSE;
+	}
+	dram_reset();
+	return TRUE;
+}
+
+/***************************************************************/
+/* Close every row, drop the queued writes and clear the counters     */
+/***************************************************************/
+void dram_reset()
+{
+	if (MACHINE->dram == NULL || DRAM.bank == NULL) {
+		return;
+	}
+	memset(DRAM.bank, 0, DRAM.channels * DRAM.banks * sizeof(dram_bank_t));
+	memset(DRAM.bus_ready, 0, DRAM.channels * sizeof(uint64_t));
+	DRAM.now = 0;
+	DRAM.queued = 0;
+	DRAM.reads = DRAM.writes = DRAM.bytes = 0;
+	DRAM.row_hits = DRAM.row_empty = DRAM.row_conflicts = 0;
+	DRAM.queue_cycles = DRAM.full_cycles = 0;
+}
+
+void dram_release()
+{
+	if (MACHINE->dram == NULL) {
+		return;
+	}
+	free(DRAM.bank);
+	free(DRAM.bus_ready);
+	free(DRAM.queue);
+	free(MACHINE->dram);
+	MACHINE->dram = NULL;
+}
+
+/* the bank addr maps to, with its channel and row */
+static dram_bank_t *dram_bank(uint32_t addr, uint32_t *channel, uint32_t *row)
+{
+	uint32_t above = addr >> DRAM.row_shift;
+	uint32_t bank = (above >> DRAM.channel_bits) & (DRAM.banks - 1);
+
+	*channel = above & (DRAM.channels - 1);
+	*row = above >> (DRAM.channel_bits + DRAM.bank_bits);
+	return &DRAM.bank[*channel * DRAM.banks + bank];
+}
+
+static int dram_row_hit(const dram_request_t *r)
+{
+	uint32_t channel, row;
+	dram_bank_t *b = dram_bank(r->addr, &channel, &row);
+
+	return b->open && b->row == row;
+}
+
+/* earliest cycle the bank could start on the request */
+static uint64_t dram_start(const dram_request_t *r)
+{
+	uint32_t channel, row;
+	dram_bank_t *b = dram_bank(r->addr, &channel, &row);
+
+	return b->ready > r->arrival ? b->ready : r->arrival;
+}
+
+/***************************************************************/
+/* First-ready FCFS: the oldest queued request to an open row, else  */
+/* the oldest                                                                                               */
+/***************************************************************/
+static uint32_t dram_pick()
+{
+	uint32_t i;
+
+	for (i = 0; i < DRAM.queued; i++) {
+		if (dram_row_hit(&DRAM.queue[i])) {
+			return i;
+		}
+	}
+	return 0;
+}
+
+/***************************************************************/
+/* Issue queued request i to its bank and take it off the queue.      */
+/* Returns the cycle its data transfer ends                                         */
+/***************************************************************/
+static uint64_t dram_service(uint32_t i)
+{
+	dram_request_t r = DRAM.queue[i];
+	uint32_t channel, row, latency = DRAM.tcas;
+	uint32_t transfer = (r.bytes + DRAM.bus_width - 1) / DRAM.bus_width;
+	dram_bank_t *b = dram_bank(r.addr, &channel, &row);
+	uint64_t start = dram_start(&r), done;
+
+	if (b->open && b->row == row) {
+		DRAM.row_hits++;
+	} else if (!b->open) {
+		latency += DRAM.trcd;
+		DRAM.row_empty++;
+	} else {
+		latency += DRAM.trp + DRAM.trcd;
+		DRAM.row_conflicts++;
+	}
+	done = start + latency > DRAM.bus_ready[channel] ? start + latency : DRAM.bus_ready[channel];
+	done += transfer;
+	DRAM.bus_ready[channel] = done;
+	if (DRAM.open_page) {
+		b->open = TRUE;
+		b->row = row;
+		b->ready = done;
+	} else {
+		/* auto-precharge */
+		b->open = FALSE;
+		b->ready = done + DRAM.trp;
+	}
+
+	if (r.write) {
+		DRAM.writes++;
+	} else {
+		DRAM.reads++;
+	}
+	DRAM.bytes += r.bytes;
+	DRAM.queue_cycles += done - r.arrival - latency - transfer;
+	DRAM.queued--;
+	memmove(&DRAM.queue[i], &DRAM.queue[i + 1], (DRAM.queued - i) * sizeof(dram_request_t));
+	return done;
+}
+
+/* issue the queued writes that could have started before now */
+static void dram_drain()
+{
+	uint32_t i;
+
+	while (DRAM.queued > 0) {
+		i = dram_pick();
+		if (dram_start(&DRAM.queue[i]) >= DRAM.now) {
+			break;
+		}
+		dram_service(i);
+	}
+}
+
+/***************************************************************/
+/* Read bytes at addr, returns the cycles until the data is back          */
+/***************************************************************/
+uint32_t dram_read(uint32_t addr, uint32_t bytes)
+{
+	uint64_t done;
+	uint32_t i;
+	int read;
+
+	dram_drain();
+	/* the read joins the queue and waits its turn */
+	DRAM.queue[DRAM.queued++] = (dram_request_t){ addr, bytes, FALSE, DRAM.now };
+	do {
+		i = dram_pick();
+		read = !DRAM.queue[i].write;
+		done = dram_service(i);
+	} while (!read);
+	return done - DRAM.now;
+}
+
+/***************************************************************/
+/* Queue a write, returns the cycles the writer waits for a free slot */
+/***************************************************************/
+uint32_t dram_write(uint32_t addr, uint32_t bytes)
+{
+	uint64_t start;
+	uint32_t i, stall = 0;
+
+	dram_drain();
+	if (DRAM.queued == DRAM.queue_size) {
+		i = dram_pick();
+		start = dram_start(&DRAM.queue[i]);
+		dram_service(i);
+		if (start > DRAM.now) {
+			stall = start - DRAM.now;
+			DRAM.full_cycles += stall;
+		}
+	}
+	DRAM.queue[DRAM.queued++] = (dram_request_t){ addr, bytes, TRUE, DRAM.now + stall };
+	return stall;
+}
+
+/***************************************************************/
+/* Print the configuration, row buffer behaviour and bandwidth          */
+/***************************************************************/
+void dram_report()
+{
+	uint64_t requests = DRAM.reads + DRAM.writes;
+	uint64_t peak = (uint64_t)DRAM.channels * DRAM.bus_width;
+
+	if (!DRAM.enabled) {
+		return;
+	}
+	printf("DRAM: %u channel%s, %u banks, %u-byte rows, %s page, tCAS %u, tRCD %u, tRP %u, %u bytes/cycle\n",
+			DRAM.channels, DRAM.channels == 1 ? "" : "s", DRAM.banks, DRAM.row_size,
+			DRAM.open_page ? "open" : "closed", DRAM.tcas, DRAM.trcd, DRAM.trp, DRAM.bus_width);
+	printf("  requests %llu (%llu reads, %llu writes), row hits %llu (%.2f%%), misses %llu, conflicts %llu\n",
+			(unsigned long long)requests, (unsigned long long)DRAM.reads, (unsigned long long)DRAM.writes,
+			(unsigned long long)DRAM.row_hits, requests ? 100.0 * DRAM.row_hits / requests : 0.0,
+			(unsigned long long)DRAM.row_empty, (unsigned long long)DRAM.row_conflicts);
+	printf("  queueing delay %.2f cycles per request, %llu cycles stalled on a full write queue\n",
+			requests ? (double)DRAM.queue_cycles / requests : 0.0, (unsigned long long)DRAM.full_cycles);
+	printf("  bandwidth %.3f bytes/cycle (%.2f%% of peak), %u writes still queued\n",
+			DRAM.now ? (double)DRAM.bytes / DRAM.now : 0.0,
+			DRAM.now ? 100.0 * DRAM.bytes / DRAM.now / peak : 0.0, DRAM.queued);
+}
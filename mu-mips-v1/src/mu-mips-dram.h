@@ -0,0 +1,61 @@
+#include <stdint.h>
+
+/***************************************************************/
+/* DRAM main-memory timing model.                                                   */
+/* Sits behind the L1 caches (or behind every access when they are  */
+/* off) in place of the flat mem.latency. Addresses map to channel,   */
+/* bank and row; each bank keeps its open row, so an access is a row */
+/* hit, a row miss on a closed bank or a conflict that precharges the */
+/* open row first. Reads stall the requester until their data is back, */
+/* writes wait in a request queue and stall only when it is full. The */
+/* queue is scheduled first-ready first-come-first-served: requests   */
+/* to an open row go before older ones.                                            */
+/***************************************************************/
+
+typedef struct {
+	uint32_t addr, bytes;
+	int write;
+	uint64_t arrival;                      /* cycle the request was queued */
+} dram_request_t;
+
+typedef struct {
+	int open;
+	uint32_t row;
+	uint64_t ready;                        /* cycle the bank takes the next command */
+} dram_bank_t;
+
+typedef struct dram_struct {
+	/* configuration */
+	int enabled;                           /* FALSE: flat mem.latency */
+	uint32_t channels, banks;              /* powers of two, banks per channel */
+	uint32_t row_size;                     /* bytes, power of two */
+	int open_page;                         /* FALSE: close the row after every access */
+	uint32_t tcas, trcd, trp;              /* cycles: column access, activate, precharge */
+	uint32_t bus_width;                    /* bytes per cycle per channel */
+	uint32_t queue_size;                   /* write requests waiting */
+	/* derived */
+	uint32_t row_shift, channel_bits, bank_bits;
+	/* state */
+	uint64_t now;                          /* cycle of the accesses being made */
+	dram_bank_t *bank;                     /* channels * banks, channel-major */
+	uint64_t *bus_ready;                   /* per channel */
+	dram_request_t *queue;                 /* oldest first, one spare slot for a read */
+	uint32_t queued;
+	/* statistics */
+	uint64_t reads, writes, bytes;
+	uint64_t row_hits, row_empty, row_conflicts;
+	uint64_t queue_cycles;                 /* waiting beyond the unloaded access time */
+	uint64_t full_cycles;                  /* writers stalled on a full queue */
+} dram_t;
+
+extern dram_t DRAM_CONFIG;                 /* options, copied into each machine */
+
+#define DRAM (*MACHINE->dram)
+
+int dram_option(const char *opt);
+int dram_init();
+void dram_reset();
+void dram_release();
+uint32_t dram_read(uint32_t addr, uint32_t bytes);
+uint32_t dram_write(uint32_t addr, uint32_t bytes);
+void dram_report();
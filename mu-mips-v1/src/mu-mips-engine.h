@@ -0,0 +1,126 @@
+/***************************************************************/
+/* Execution engines. mu-mips.c includes this file three times: with */
+/* ENGINE_TRACE set, producing the *_trace engines that print and      */
+/* record every instruction, with ENGINE_PROFILE set, producing the     */
+/* *_profile engines that only count, and with neither, producing the */
+/* *_quiet engines where no tracing code exists in the loop at all.      */
+/***************************************************************/
+#define ENGINE_PASTE2(a, b) a##b
+#define ENGINE_PASTE(a, b) ENGINE_PASTE2(a, b)
+#define ENGINE_FN(name) ENGINE_PASTE(name, ENGINE_SUFFIX)
+
+#if ENGINE_TRACE
+#define ENGINE_BEFORE(d) trace_before(d)
+#define ENGINE_AFTER(d)  trace_after(d)
+#elif ENGINE_PROFILE
+#define ENGINE_BEFORE(d) ((void)0)
+#define ENGINE_AFTER(d)  do { if (!DEBUG_HELD(d)) profile_after(d); } while (0)
+#else
+#define ENGINE_BEFORE(d) ((void)0)
+#define ENGINE_AFTER(d)  ((void)0)
+#endif
+
+/************************************************************/
+/* Switch engine, the reference: decode once, switch on the handler */
+/************************************************************/
+static inline decoded_inst_t *ENGINE_FN(step_switch)(void)
+{
+	decoded_inst_t *d = fetch_decoded(CURRENT_STATE.PC);
+
+	ENGINE_BEFORE(d);
+	NEXT_STATE.PC = CURRENT_STATE.PC + 4;
+
+	switch(d->op){
+#define X(name, ...) case OP_##name: { __VA_ARGS__ } break;
+		MIPS_OPS(X)
+#undef X
+	}
+	ENGINE_AFTER(d);
+	return d;
+}
+
+static uint32_t ENGINE_FN(run_switch)(uint32_t max)
+{
+	uint32_t n;
+
+	for (n = 0; n < max && RUN_FLAG; n++) {
+		commit_state(ENGINE_FN(step_switch)());
+		INSTRUCTION_COUNT++;
+	}
+	return n;
+}
+
+/************************************************************/
+/* Handler-table engine: one function per handler index                     */
+/************************************************************/
+static uint32_t ENGINE_FN(run_table)(uint32_t max)
+{
+	decoded_inst_t *d;
+	uint32_t n;
+
+	for (n = 0; n < max && RUN_FLAG; n++) {
+		d = fetch_decoded(CURRENT_STATE.PC);
+		ENGINE_BEFORE(d);
+		NEXT_STATE.PC = CURRENT_STATE.PC + 4;
+		EXEC_TABLE[d->op](d);
+		ENGINE_AFTER(d);
+		commit_state(d);
+		INSTRUCTION_COUNT++;
+	}
+	return n;
+}
+
+/************************************************************/
+/* Threaded engine: every handler ends in its own indirect jump to the */
+/* next handler, so each branch site predicts its own successors.        */
+/* Needs GCC labels-as-values, otherwise the handler table is used.   */
+/************************************************************/
+static uint32_t ENGINE_FN(run_threaded)(uint32_t max)
+{
+#if defined(__GNUC__)
+	static void *const labels[NUM_OPS] = {
+		[OP_INVALID] = &&L_UNIMPLEMENTED,
+#define X(name, ...) [OP_##name] = &&L_##name,
+		MIPS_OPS(X)
+#undef X
+	};
+	decoded_inst_t *d;
+	uint32_t n = 0;
+
+	if (max == 0 || !RUN_FLAG) {
+		return 0;
+	}
+
+#define DISPATCH() \
+	do { \
+		d = fetch_decoded(CURRENT_STATE.PC); \
+		ENGINE_BEFORE(d); \
+		NEXT_STATE.PC = CURRENT_STATE.PC + 4; \
+		goto *labels[d->op]; \
+	} while (0)
+
+	DISPATCH();
+#define X(name, ...) \
+	L_##name: \
+		{ __VA_ARGS__ } \
+		ENGINE_AFTER(d); \
+		commit_state(d); \
+		INSTRUCTION_COUNT++; \
+		if (++n >= max || !RUN_FLAG) { \
+			return n; \
+		} \
+		DISPATCH();
+	MIPS_OPS(X)
+#undef X
+#undef DISPATCH
+	return n;
+#else
+	return ENGINE_FN(run_table)(max);
+#endif
+}
+
+#undef ENGINE_BEFORE
+#undef ENGINE_AFTER
+#undef ENGINE_FN
+#undef ENGINE_PASTE
+#undef ENGINE_PASTE2
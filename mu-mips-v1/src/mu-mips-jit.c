@@ -0,0 +1,705 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/mman.h>
+
+#include "mu-mips.h"
+#include "mu-mips-ops.h"
+#include "mu-mips-jit.h"
+
+#if defined(__x86_64__)
+
+typedef struct {
+	uint32_t pc;                         /* guest address of the first instruction */
+	uint32_t ninsns;
+	uint8_t *code;                       /* host entry point, NULL for a free slot */
+} jit_block_t;
+
+/* filled by the epilogue when translated code returns to the dispatcher */
+typedef struct {
+	uint32_t pc;                         /* guest PC to continue at */
+	uint32_t pad;
+	uint8_t *patch;                      /* rel32 to point at the successor, NULL for indirect exits */
+	int64_t budget;                      /* instructions left to run */
+} jit_exit_t;
+
+typedef void (*jit_enter_fn)(CPU_State *state, uint8_t *code, int64_t budget, jit_exit_t *exit);
+
+/* a block exit that still has to be emitted after the block body */
+typedef struct {
+	uint8_t *field;                      /* rel32 of the jump or jcc leading to the stub */
+	uint32_t pc;
+	int chain;
+	uint32_t refund;                     /* instructions charged to the budget but not executed */
+} jit_stub_t;
+
+/* translator state of a machine, allocated on its first jit_run */
+struct jit_struct {
+	uint8_t *cache;
+	uint8_t *code_begin;                 /* first byte after the entry/exit trampolines */
+	uint8_t *ptr;
+	uint8_t *epilogue;
+	jit_enter_fn enter;
+	jit_block_t blocks[JIT_BLOCK_TABLE_SIZE];
+	uint32_t nblocks;
+	uint32_t generation;                 /* bumped on every flush */
+	int state;                           /* 0 untried, 1 ready, -1 unavailable */
+};
+
+#define jit_cache      (MACHINE->jit->cache)
+#define jit_code_begin (MACHINE->jit->code_begin)
+#define jit_ptr        (MACHINE->jit->ptr)
+#define jit_epilogue   (MACHINE->jit->epilogue)
+#define jit_enter      (MACHINE->jit->enter)
+#define jit_blocks     (MACHINE->jit->blocks)
+#define jit_nblocks    (MACHINE->jit->nblocks)
+#define jit_generation (MACHINE->jit->generation)
+#define jit_state      (MACHINE->jit->state)
+
+/* host registers, guest state lives in memory at [rbx] */
+enum { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7 };
+
+#define REG_OFF(r) ((int32_t)(offsetof(CPU_State, REGS) + 4 * (r)))
+#define HI_OFF     ((int32_t)offsetof(CPU_State, HI))
+#define LO_OFF     ((int32_t)offsetof(CPU_State, LO))
+#define PC_OFF     ((int32_t)offsetof(CPU_State, PC))
+
+/* worst case for one block, including its exit stubs */
+#define JIT_BLOCK_RESERVE (JIT_MAX_BLOCK_INSNS * 96 + 256)
+
+/************************************************************/
+/* Instruction semantics for ops the translator calls out to. Only   */
+/* used for non-control ops, which read all their operands before   */
+/* writing, so current and next state can be the same structure.   */
+/************************************************************/
+static void jit_helper(CPU_State *s, decoded_inst_t *d)
+{
+#undef CURRENT_STATE
+#undef NEXT_STATE
+#define CURRENT_STATE (*s)
+#define NEXT_STATE (*s)
+	switch(d->op){
+#define X(name, ...) case OP_##name: { __VA_ARGS__ } break;
+		MIPS_OPS(X)
+#undef X
+	}
+#undef CURRENT_STATE
+#undef NEXT_STATE
+#define CURRENT_STATE (MACHINE->current)
+#define NEXT_STATE (MACHINE->next)
+}
+
+/************************************************************/
+/* x86-64 encoders                                                                                       */
+/************************************************************/
+static inline void emit8(uint8_t b)
+{
+	*jit_ptr++ = b;
+}
+
+static inline void emit32(uint32_t v)
+{
+	memcpy(jit_ptr, &v, 4);
+	jit_ptr += 4;
+}
+
+static inline void emit64(uint64_t v)
+{
+	memcpy(jit_ptr, &v, 8);
+	jit_ptr += 8;
+}
+
+/* <opcode> reg, [rbx + disp32] (or the /digit form when reg is an extension) */
+static void emit_rm(uint8_t opcode, int reg, int32_t disp)
+{
+	emit8(opcode);
+	emit8(0x80 | (reg << 3) | RBX);
+	emit32(disp);
+}
+
+static void emit_load(int reg, int32_t disp)
+{
+	emit_rm(0x8B, reg, disp);
+}
+
+static void emit_store(int reg, int32_t disp)
+{
+	emit_rm(0x89, reg, disp);
+}
+
+static void emit_store_imm(int32_t disp, uint32_t imm)
+{
+	emit_rm(0xC7, 0, disp);
+	emit32(imm);
+}
+
+static void emit_mov_imm64(int reg, uint64_t imm)
+{
+	emit8(0x48);
+	emit8(0xB8 + reg);
+	emit64(imm);
+}
+
+static void emit_call(void *fn)
+{
+	emit_mov_imm64(RAX, (uint64_t)(uintptr_t)fn);
+	emit8(0xFF); emit8(0xD0);            /* call rax */
+}
+
+/* r12 holds the instruction budget: add/sub/cmp r12, imm32 */
+static void emit_budget(uint8_t ext, uint32_t imm)
+{
+	emit8(0x49); emit8(0x81); emit8(0xC0 | (ext << 3) | 4);
+	emit32(imm);
+}
+
+/* jmp (cc == 0) or jcc rel32, returns the rel32 field for patching */
+static uint8_t *emit_jump(uint8_t cc)
+{
+	uint8_t *field;
+	if (cc == 0) {
+		emit8(0xE9);
+	} else {
+		emit8(0x0F); emit8(cc);
+	}
+	field = jit_ptr;
+	emit32(0);
+	return field;
+}
+
+static void set_target(uint8_t *field, uint8_t *dest)
+{
+	int32_t rel = (int32_t)(dest - (field + 4));
+	memcpy(field, &rel, 4);
+}
+
+/* setcc al; movzx eax, al */
+static void emit_setcc(uint8_t cc)
+{
+	emit8(0x0F); emit8(cc); emit8(0xC0);
+	emit8(0x0F); emit8(0xB6); emit8(0xC0);
+}
+
+/* mov edi, [rs]; add edi, imm32: effective address of a load or store */
+static void emit_address(decoded_inst_t *d)
+{
+	emit_load(RDI, REG_OFF(d->rs));
+	emit8(0x81); emit8(0xC7); emit32(d->imm);
+}
+
+/************************************************************/
+/* Build the entry trampoline and the shared exit epilogue            */
+/************************************************************/
+static void jit_emit_trampolines()
+{
+	jit_ptr = jit_cache;
+
+	jit_enter = (jit_enter_fn)(void *)jit_ptr;
+	emit8(0x53);                               /* push rbx */
+	emit8(0x55);                               /* push rbp */
+	emit8(0x41); emit8(0x54);                  /* push r12 */
+	emit8(0x41); emit8(0x55);                  /* push r13 */
+	emit8(0x41); emit8(0x56);                  /* push r14 */
+	emit8(0x41); emit8(0x57);                  /* push r15 */
+	emit8(0x48); emit8(0x83); emit8(0xEC); emit8(0x08);   /* sub rsp, 8: keep calls 16-byte aligned */
+	emit8(0x48); emit8(0x89); emit8(0xFB);     /* mov rbx, rdi (state) */
+	emit8(0x49); emit8(0x89); emit8(0xD4);     /* mov r12, rdx (budget) */
+	emit8(0x49); emit8(0x89); emit8(0xCD);     /* mov r13, rcx (exit record) */
+	emit8(0xFF); emit8(0xE6);                  /* jmp rsi */
+
+	jit_epilogue = jit_ptr;
+	emit8(0x41); emit8(0x89); emit8(0x45); emit8(0x00);   /* mov [r13], eax */
+	emit8(0x49); emit8(0x89); emit8(0x55); emit8(0x08);   /* mov [r13+8], rdx */
+	emit8(0x4D); emit8(0x89); emit8(0x65); emit8(0x10);   /* mov [r13+16], r12 */
+	emit8(0x48); emit8(0x83); emit8(0xC4); emit8(0x08);   /* add rsp, 8 */
+	emit8(0x41); emit8(0x5F);                  /* pop r15 */
+	emit8(0x41); emit8(0x5E);                  /* pop r14 */
+	emit8(0x41); emit8(0x5D);                  /* pop r13 */
+	emit8(0x41); emit8(0x5C);                  /* pop r12 */
+	emit8(0x5D);                               /* pop rbp */
+	emit8(0x5B);                               /* pop rbx */
+	emit8(0xC3);                               /* ret */
+
+	jit_code_begin = jit_ptr;
+}
+
+/************************************************************/
+/* Map the code cache on first use                                                       */
+/************************************************************/
+static int jit_init()
+{
+	if (MACHINE->jit == NULL) {
+		MACHINE->jit = calloc(1, sizeof(struct jit_struct));
+		if (MACHINE->jit == NULL) {
+			printf("Warning: Can't allocate the translator state, using the interpreter\n");
+			return FALSE;
+		}
+	}
+	if (jit_state == 0) {
+		jit_cache = mmap(NULL, JIT_CODE_CACHE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (jit_cache == MAP_FAILED) {
+			printf("Warning: Can't map the JIT code cache, using the interpreter\n");
+			jit_state = -1;
+		} else {
+			jit_emit_trampolines();
+			jit_state = 1;
+		}
+	}
+	return jit_state == 1;
+}
+
+int jit_available()
+{
+	return jit_init();
+}
+
+/************************************************************/
+/* Unmap the machine's code cache, the next jit_run maps a new one  */
+/************************************************************/
+void jit_release()
+{
+	if (MACHINE->jit == NULL) {
+		return;
+	}
+	if (jit_state == 1) {
+		munmap(jit_cache, JIT_CODE_CACHE_SIZE);
+	}
+	free(MACHINE->jit);
+	MACHINE->jit = NULL;
+}
+
+/************************************************************/
+/* Throw away every translation                                                             */
+/************************************************************/
+void jit_flush()
+{
+	mem_page_t *page;
+
+	if (MACHINE->jit != NULL && jit_state == 1) {
+		memset(jit_blocks, 0, sizeof(jit_blocks));
+		jit_nblocks = 0;
+		jit_ptr = jit_code_begin;
+		jit_generation++;
+	}
+	for (page = MEM_PAGES; page != NULL; page = page->next) {
+		page->jit = FALSE;
+	}
+	JIT_STALE = FALSE;
+}
+
+static jit_block_t *jit_lookup(uint32_t pc)
+{
+	uint32_t i = (pc >> 2) & (JIT_BLOCK_TABLE_SIZE - 1);
+
+	while (jit_blocks[i].code != NULL) {
+		if (jit_blocks[i].pc == pc) {
+			return &jit_blocks[i];
+		}
+		i = (i + 1) & (JIT_BLOCK_TABLE_SIZE - 1);
+	}
+	return NULL;
+}
+
+/************************************************************/
+/* Control-flow ops end a block                                                              */
+/************************************************************/
+static int jit_ends_block(uint8_t op)
+{
+	switch (op) {
+		case OP_JR: case OP_JALR: case OP_J: case OP_JAL: case OP_SYSCALL:
+		case OP_BLTZ: case OP_BGEZ: case OP_BEQ: case OP_BNE: case OP_BLEZ: case OP_BGTZ:
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+/************************************************************/
+/* Translate the block starting at pc, NULL if it has to be interpreted */
+/************************************************************/
+static jit_block_t *jit_translate(uint32_t pc)
+{
+	jit_stub_t stubs[2 * JIT_MAX_BLOCK_INSNS + 4];
+	int nstubs = 0;
+	mem_page_t *page;
+	decoded_inst_t *d;
+	jit_block_t *block;
+	uint8_t *code, *copy;
+	uint32_t addr, n, i, remaining, slot;
+	uint8_t cc;
+
+	if ((pc & 0x3) || (page = mem_page(pc, FALSE)) == NULL) {
+		return NULL;
+	}
+
+	/* find the block: up to a control op, the length limit or the end of the page */
+	n = 0;
+	for (addr = pc; ; addr += 4) {
+		n++;
+		if (jit_ends_block(fetch_decoded(addr)->op) || n == JIT_MAX_BLOCK_INSNS ||
+				((addr + 4) & MEM_PAGE_MASK) == 0) {
+			break;
+		}
+	}
+
+	if (jit_ptr + JIT_BLOCK_RESERVE > jit_cache + JIT_CODE_CACHE_SIZE ||
+			jit_nblocks >= JIT_BLOCK_TABLE_SIZE * 3 / 4) {
+		jit_flush();
+	}
+	page->jit = TRUE;
+	code = jit_ptr;
+
+	/* not enough budget left for the whole block: give it back to the dispatcher */
+	emit_budget(7, n);                          /* cmp r12, n */
+	stubs[nstubs].field = emit_jump(0x8C);      /* jl */
+	stubs[nstubs].pc = pc;
+	stubs[nstubs].chain = FALSE;
+	stubs[nstubs++].refund = 0;
+	emit_budget(5, n);                          /* sub r12, n */
+
+	for (i = 0, addr = pc; i < n; i++, addr += 4) {
+		d = fetch_decoded(addr);
+		remaining = n - i - 1;
+		cc = 0;
+
+		switch (d->op) {
+			case OP_SLL: case OP_SRL: case OP_SRA:
+				emit_load(RAX, REG_OFF(d->rt));
+				emit8(0xC1);
+				emit8(d->op == OP_SLL ? 0xE0 : d->op == OP_SRL ? 0xE8 : 0xF8);
+				emit8(d->sa);
+				emit_store(RAX, REG_OFF(d->rd));
+				break;
+			case OP_ADD: case OP_ADDU: case OP_SUB: case OP_SUBU:
+			case OP_AND: case OP_OR: case OP_XOR: case OP_NOR:
+				emit_load(RAX, REG_OFF(d->rs));
+				switch (d->op) {
+					case OP_ADD: case OP_ADDU: emit_rm(0x03, RAX, REG_OFF(d->rt)); break;
+					case OP_SUB: case OP_SUBU: emit_rm(0x2B, RAX, REG_OFF(d->rt)); break;
+					case OP_AND: emit_rm(0x23, RAX, REG_OFF(d->rt)); break;
+					case OP_XOR: emit_rm(0x33, RAX, REG_OFF(d->rt)); break;
+					default:
+						emit_rm(0x0B, RAX, REG_OFF(d->rt));
+						if (d->op == OP_NOR) {
+							emit8(0xF7); emit8(0xD0);      /* not eax */
+						}
+						break;
+				}
+				emit_store(RAX, REG_OFF(d->rd));
+				break;
+			case OP_SLT:
+				emit_load(RAX, REG_OFF(d->rs));
+				emit_rm(0x3B, RAX, REG_OFF(d->rt));   /* cmp eax, [rt] */
+				emit_setcc(0x9C);                      /* setl */
+				emit_store(RAX, REG_OFF(d->rd));
+				break;
+			case OP_ADDI: case OP_ADDIU: case OP_ANDI: case OP_ORI: case OP_XORI:
+				emit_load(RAX, REG_OFF(d->rs));
+				emit8(d->op == OP_ANDI ? 0x25 : d->op == OP_ORI ? 0x0D : d->op == OP_XORI ? 0x35 : 0x05);
+				emit32(d->imm);
+				emit_store(RAX, REG_OFF(d->rt));
+				break;
+			case OP_SLTI:
+				emit_load(RAX, REG_OFF(d->rs));
+				emit8(0x3D); emit32(d->imm);          /* cmp eax, imm32 */
+				emit_setcc(0x9C);
+				emit_store(RAX, REG_OFF(d->rt));
+				break;
+			case OP_LUI:
+				emit_store_imm(REG_OFF(d->rt), d->imm);
+				break;
+			case OP_MFHI: case OP_MFLO:
+				emit_load(RAX, d->op == OP_MFHI ? HI_OFF : LO_OFF);
+				emit_store(RAX, REG_OFF(d->rd));
+				break;
+			case OP_MTHI: case OP_MTLO:
+				emit_load(RAX, REG_OFF(d->rs));
+				emit_store(RAX, d->op == OP_MTHI ? HI_OFF : LO_OFF);
+				break;
+			case OP_MULT: case OP_MULTU:
+				emit_load(RAX, REG_OFF(d->rs));
+				emit_rm(0xF7, d->op == OP_MULT ? 5 : 4, REG_OFF(d->rt));   /* imul/mul dword [rt] */
+				emit_store(RAX, LO_OFF);
+				emit_store(RDX, HI_OFF);
+				break;
+			case OP_LB: case OP_LH: case OP_LW: case OP_LBU: case OP_LHU:
+				emit_address(d);
+				emit_call(d->op == OP_LW ? (void *)mem_read_32 :
+						(d->op == OP_LH || d->op == OP_LHU) ? (void *)mem_read_16 : (void *)mem_read_8);
+				if (d->op != OP_LW) {
+					emit8(0x0F);
+					emit8(d->op == OP_LB ? 0xBE : d->op == OP_LBU ? 0xB6 : d->op == OP_LH ? 0xBF : 0xB7);
+					emit8(0xC0);                       /* movsx/movzx eax, al/ax */
+				}
+				emit_store(RAX, REG_OFF(d->rt));
+				break;
+			case OP_SB: case OP_SH: case OP_SW:
+				emit_address(d);
+				emit_load(RSI, REG_OFF(d->rt));
+				emit_call(d->op == OP_SW ? (void *)mem_write_32 :
+						d->op == OP_SH ? (void *)mem_write_16 : (void *)mem_write_8);
+				break;
+			case OP_BEQ: case OP_BNE:
+				emit_load(RAX, REG_OFF(d->rs));
+				emit_rm(0x3B, RAX, REG_OFF(d->rt));
+				cc = d->op == OP_BEQ ? 0x84 : 0x85;
+				break;
+			case OP_BLTZ: case OP_BGEZ: case OP_BLEZ: case OP_BGTZ:
+				emit_rm(0x83, 7, REG_OFF(d->rs)); emit8(0x00);   /* cmp dword [rs], 0 */
+				cc = d->op == OP_BLTZ ? 0x8C : d->op == OP_BGEZ ? 0x8D : d->op == OP_BLEZ ? 0x8E : 0x8F;
+				break;
+			case OP_JAL:
+				emit_store_imm(REG_OFF(31), addr + 4);
+				/* fall through */
+			case OP_J:
+				stubs[nstubs].field = emit_jump(0);
+				stubs[nstubs].pc = d->target;
+				stubs[nstubs].chain = TRUE;
+				stubs[nstubs++].refund = 0;
+				break;
+			case OP_JR: case OP_JALR:
+				emit_load(RAX, REG_OFF(d->rs));
+				if (d->op == OP_JALR) {
+					emit_store_imm(REG_OFF(d->rd), addr + 4);
+				}
+				emit8(0x31); emit8(0xD2);              /* xor edx, edx */
+				set_target(emit_jump(0), jit_epilogue);
+				break;
+			default:
+				/* DIV, DIVU, SYSCALL and anything unimplemented run the shared semantics */
+				emit_store_imm(PC_OFF, addr);
+				emit8(0xEB); emit8(sizeof(decoded_inst_t));     /* jmp over an inline copy of d */
+				copy = jit_ptr;
+				memcpy(copy, d, sizeof(decoded_inst_t));
+				jit_ptr += sizeof(decoded_inst_t);
+				emit8(0x48); emit8(0x89); emit8(0xDF);          /* mov rdi, rbx */
+				emit_mov_imm64(RSI, (uint64_t)(uintptr_t)copy);
+				emit_call((void *)jit_helper);
+				break;
+		}
+
+		if (d->op >= OP_SB && d->op <= OP_SC) {
+			/* the store may have hit translated code: leave right after it */
+			emit_mov_imm64(RAX, (uint64_t)(uintptr_t)&JIT_STALE);
+			emit8(0x83); emit8(0x38); emit8(0x00); /* cmp dword [rax], 0 */
+			stubs[nstubs].field = emit_jump(0x85);
+			stubs[nstubs].pc = addr + 4;
+			stubs[nstubs].chain = FALSE;
+			stubs[nstubs++].refund = remaining;
+		}
+
+		if (cc != 0) {
+			/* conditional branch: taken and fall-through exits, both chainable */
+			stubs[nstubs].field = emit_jump(cc);
+			stubs[nstubs].pc = d->target;
+			stubs[nstubs].chain = TRUE;
+			stubs[nstubs++].refund = 0;
+			stubs[nstubs].field = emit_jump(0);
+			stubs[nstubs].pc = addr + 4;
+			stubs[nstubs].chain = TRUE;
+			stubs[nstubs++].refund = 0;
+		} else if (i == n - 1 && d->op == OP_SYSCALL) {
+			/* back to the dispatcher, which checks RUN_FLAG */
+			stubs[nstubs].field = emit_jump(0);
+			stubs[nstubs].pc = addr + 4;
+			stubs[nstubs].chain = FALSE;
+			stubs[nstubs++].refund = 0;
+		} else if (i == n - 1 && !jit_ends_block(d->op)) {
+			/* block cut at the length limit or the page end */
+			stubs[nstubs].field = emit_jump(0);
+			stubs[nstubs].pc = addr + 4;
+			stubs[nstubs].chain = TRUE;
+			stubs[nstubs++].refund = 0;
+		}
+	}
+
+	for (i = 0; i < (uint32_t)nstubs; i++) {
+		set_target(stubs[i].field, jit_ptr);
+		if (stubs[i].refund) {
+			emit_budget(0, stubs[i].refund);        /* add r12, refund */
+		}
+		emit8(0xB8); emit32(stubs[i].pc);           /* mov eax, pc */
+		if (stubs[i].chain) {
+			emit_mov_imm64(RDX, (uint64_t)(uintptr_t)stubs[i].field);
+		} else {
+			emit8(0x31); emit8(0xD2);               /* xor edx, edx */
+		}
+		set_target(emit_jump(0), jit_epilogue);
+	}
+
+	slot = (pc >> 2) & (JIT_BLOCK_TABLE_SIZE - 1);
+	while (jit_blocks[slot].code != NULL) {
+		slot = (slot + 1) & (JIT_BLOCK_TABLE_SIZE - 1);
+	}
+	block = &jit_blocks[slot];
+	block->pc = pc;
+	block->ninsns = n;
+	block->code = code;
+	jit_nblocks++;
+	return block;
+}
+
+/************************************************************/
+/* Run up to max instructions through translated code                       */
+/************************************************************/
+uint32_t jit_run(uint32_t max)
+{
+	jit_exit_t exit;
+	jit_block_t *block, *next;
+	uint32_t done = 0, n, generation;
+
+	if (!jit_init()) {
+		return run_interpreter(max);
+	}
+
+	/* translated code works on CURRENT_STATE alone, NEXT_STATE is synced when the interpreter takes over */
+	while (done < max && RUN_FLAG) {
+		if (JIT_STALE) {
+			jit_flush();
+		}
+		block = jit_lookup(CURRENT_STATE.PC);
+		if (block == NULL) {
+			block = jit_translate(CURRENT_STATE.PC);
+		}
+		if (block == NULL || block->ninsns > max - done) {
+			NEXT_STATE = CURRENT_STATE;
+			done += run_interpreter(1);
+			continue;
+		}
+
+		jit_enter(&CURRENT_STATE, block->code, max - done, &exit);
+		n = (uint32_t)((max - done) - exit.budget);
+		done += n;
+		INSTRUCTION_COUNT += n;
+		CURRENT_STATE.PC = exit.pc;
+
+		if (exit.patch != NULL && !JIT_STALE && RUN_FLAG) {
+			/* chain the exit straight to its successor, unless translating it flushed the cache */
+			generation = jit_generation;
+			next = jit_lookup(exit.pc);
+			if (next == NULL) {
+				next = jit_translate(exit.pc);
+			}
+			if (next != NULL && generation == jit_generation) {
+				set_target(exit.patch, next->code);
+			}
+		}
+	}
+	NEXT_STATE = CURRENT_STATE;
+	return done;
+}
+
+#else /* no translator for this host */
+
+int jit_available()
+{
+	return FALSE;
+}
+
+uint32_t jit_run(uint32_t max)
+{
+	return run_interpreter(max);
+}
+
+void jit_flush()
+{
+	JIT_STALE = FALSE;
+}
+
+void jit_release()
+{
+}
+
+#endif
+
+/************************************************************/
+/* Order-independent hash of all non-zero guest memory                  */
+/************************************************************/
+static uint64_t memory_hash()
+{
+	mem_page_t *page;
+	uint64_t sum = 0, h;
+	int i, nonzero;
+
+	for (page = MEM_PAGES; page != NULL; page = page->next) {
+		h = 1469598103934665603ULL ^ page->vpn;
+		nonzero = FALSE;
+		for (i = 0; i < MEM_PAGE_SIZE; i++) {
+			nonzero |= page->data[i] != 0;
+			h = (h ^ page->data[i]) * 1099511628211ULL;
+		}
+		if (nonzero) {
+			sum += h;
+		}
+	}
+	return sum;
+}
+
+/************************************************************/
+/* Run the program on the reference interpreter and on the JIT and  */
+/* compare the final registers and memory. TRUE when they agree.   */
+/************************************************************/
+int jit_verify()
+{
+	CPU_State ref;
+	uint64_t ref_count;
+	uint64_t ref_hash, hash;
+	int engine = ENGINE, trace = TRACE, ok = TRUE, i;
+	FILE *trace_file = TRACE_FILE;
+
+	TRACE = FALSE;
+	TRACE_FILE = NULL;
+
+	reset();
+	ENGINE = ENGINE_SWITCH;
+	while (RUN_FLAG) {
+		run_engine(UINT32_MAX);
+	}
+	ref = CURRENT_STATE;
+	ref_count = INSTRUCTION_COUNT;
+	ref_hash = memory_hash();
+
+	reset();
+	ENGINE = ENGINE_JIT;
+	while (RUN_FLAG) {
+		run_engine(UINT32_MAX);
+	}
+	hash = memory_hash();
+
+	if (!jit_available()) {
+		printf("JIT verify: no translator on this host, compared the interpreter with itself\n");
+	}
+	for (i = 0; i < MIPS_REGS; i++) {
+		if (ref.REGS[i] != CURRENT_STATE.REGS[i]) {
+			printf("JIT verify: R%d is 0x%08x, interpreter has 0x%08x\n", i, CURRENT_STATE.REGS[i], ref.REGS[i]);
+			ok = FALSE;
+		}
+	}
+	if (ref.HI != CURRENT_STATE.HI || ref.LO != CURRENT_STATE.LO) {
+		printf("JIT verify: HI/LO are 0x%08x/0x%08x, interpreter has 0x%08x/0x%08x\n",
+				CURRENT_STATE.HI, CURRENT_STATE.LO, ref.HI, ref.LO);
+		ok = FALSE;
+	}
+	if (ref.PC != CURRENT_STATE.PC) {
+		printf("JIT verify: PC is 0x%08x, interpreter has 0x%08x\n", CURRENT_STATE.PC, ref.PC);
+		ok = FALSE;
+	}
+	if (ref_count != INSTRUCTION_COUNT) {
+		printf("JIT verify: %llu instructions executed, interpreter executed %llu\n",
+				(unsigned long long)INSTRUCTION_COUNT, (unsigned long long)ref_count);
+		ok = FALSE;
+	}
+	if (ref_hash != hash) {
+		printf("JIT verify: memory contents differ from the interpreter\n");
+		ok = FALSE;
+	}
+	printf("JIT verify: %s (%llu instructions)\n", ok ? "PASSED" : "FAILED", (unsigned long long)ref_count);
+
+	ENGINE = engine;
+	TRACE = trace;
+	TRACE_FILE = trace_file;
+	return ok;
+}
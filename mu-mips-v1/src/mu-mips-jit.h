@@ -0,0 +1,21 @@
+#include <stdint.h>
+
+/***************************************************************/
+/* Basic-block translator to x86-64 host code.                                             */
+/* Blocks are discovered from CURRENT_STATE.PC, translated into an  */
+/* executable code cache and chained to their static successors.     */
+/* On other hosts, or for code the translator cannot handle, the        */
+/* interpreter runs instead.                                                                         */
+/***************************************************************/
+#define JIT_CODE_CACHE_SIZE (16 * 1024 * 1024)
+#define JIT_BLOCK_TABLE_SIZE (1 << 16)   /* guest PC -> block hash table, power of two */
+#define JIT_MAX_BLOCK_INSNS 64
+
+/* set when a store hits a translated page or memory is reset, the cache is flushed before the next block */
+#define JIT_STALE (MACHINE->jit_stale)
+
+int jit_available();
+void jit_release();
+uint32_t jit_run(uint32_t max);
+void jit_flush();
+int jit_verify();
@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mu-mips.h"
+#include "mu-mips-syscall.h"
+
+/***************************************************************/
+/* Program loader. The file is memory-mapped and copied into guest  */
+/* memory a page at a time. Supported formats:                                  */
+/*   hex   - one hexadecimal word per line (the original format)      */
+/*   bin   - raw big-endian words, loaded at MEM_TEXT_BEGIN               */
+/*   binle - raw little-endian words, loaded at MEM_TEXT_BEGIN             */
+/*   elf   - MIPS32 ELF executable, PT_LOAD segments and entry point */
+/* Guest memory is little-endian, so big-endian input is byte-swapped */
+/* per word: instructions and words read back correctly.                  */
+/***************************************************************/
+
+#define EI_CLASS    4
+#define EI_DATA     5
+#define ELFCLASS32  1
+#define ELFDATA2LSB 1
+#define ELFDATA2MSB 2
+#define ET_EXEC     2
+#define EM_MIPS     8
+#define PT_LOAD     1
+#define PF_X        1
+
+typedef struct {
+	uint8_t e_ident[16];
+	uint16_t e_type, e_machine;
+	uint32_t e_version, e_entry, e_phoff, e_shoff, e_flags;
+	uint16_t e_ehsize, e_phentsize, e_phnum, e_shentsize, e_shnum, e_shstrndx;
+} elf32_ehdr_t;
+
+typedef struct {
+	uint32_t p_type, p_offset, p_vaddr, p_paddr, p_filesz, p_memsz, p_flags, p_align;
+} elf32_phdr_t;
+
+static uint16_t elf16(uint16_t v, int big)
+{
+	return big ? (uint16_t)((v >> 8) | (v << 8)) : v;
+}
+
+static uint32_t elf32(uint32_t v, int big)
+{
+	return big ? __builtin_bswap32(v) : v;
+}
+
+/***************************************************************/
+/* Guess the format: ELF magic, hex text, otherwise a raw binary   */
+/***************************************************************/
+static int detect_format(const uint8_t *buf, size_t len)
+{
+	size_t i;
+
+	if (len >= 4 && memcmp(buf, "\x7f" "ELF", 4) == 0) {
+		return FORMAT_ELF;
+	}
+	for (i = 0; i < len; i++) {
+		if (!strchr("0123456789abcdefABCDEFxX \t\r\n", buf[i]) || buf[i] == '\0') {
+			return FORMAT_BIN;
+		}
+	}
+	return FORMAT_HEX;
+}
+
+/***************************************************************/
+/* Text format: whitespace-separated hexadecimal words                 */
+/***************************************************************/
+static int load_hex(const uint8_t *buf, size_t len)
+{
+	char *text, *p, *end;
+	uint32_t word, i = 0;
+
+	/* strtoul needs a terminated string */
+	text = malloc(len + 1);
+	if (text == NULL) {
+		printf("Error: Can't allocate %lu bytes for program file %s\n", (unsigned long)len, prog_file);
+		return FALSE;
+	}
+	memcpy(text, buf, len);
+	text[len] = '\0';
+
+	for (p = text; ; p = end) {
+		word = strtoul(p, &end, 16);
+		if (end == p) {
+			break;
+		}
+		mem_write_32(MEM_TEXT_BEGIN + i, word);
+		i += 4;
+	}
+	free(text);
+
+	PROGRAM_TEXT_BEGIN = MEM_TEXT_BEGIN;
+	PROGRAM_SIZE = i/4;
+	PROGRAM_ENTRY = MEM_TEXT_BEGIN;
+	if (VERBOSE) {
+		printf("Program loaded into memory.\n%d words written into memory.\n\n", PROGRAM_SIZE);
+	}
+	return TRUE;
+}
+
+/***************************************************************/
+/* Raw binary image of the text segment                                           */
+/***************************************************************/
+static int load_binary(const uint8_t *buf, size_t len, int big)
+{
+	mem_write_block(MEM_TEXT_BEGIN, buf, len, big);
+
+	PROGRAM_TEXT_BEGIN = MEM_TEXT_BEGIN;
+	PROGRAM_SIZE = len/4;
+	PROGRAM_ENTRY = MEM_TEXT_BEGIN;
+	if (VERBOSE) {
+		printf("Program loaded into memory.\n%d words written into memory.\n\n", PROGRAM_SIZE);
+	}
+	return TRUE;
+}
+
+/***************************************************************/
+/* MIPS32 ELF executable: copy every PT_LOAD segment. The part of   */
+/* a segment past its file size (bss) is left untouched, memory that  */
+/* was never written reads as zero.                                                        */
+/***************************************************************/
+static int load_elf(const uint8_t *buf, size_t len)
+{
+	elf32_ehdr_t eh;
+	elf32_phdr_t ph;
+	uint32_t i, phoff, phentsize, offset, vaddr, filesz, memsz, flags, bytes = 0, segments = 0;
+	int big;
+
+	if (len < sizeof(eh)) {
+		printf("Error: %s is too short to be an ELF file\n", prog_file);
+		return FALSE;
+	}
+	memcpy(&eh, buf, sizeof(eh));
+	big = eh.e_ident[EI_DATA] == ELFDATA2MSB;
+	if (eh.e_ident[EI_CLASS] != ELFCLASS32 || elf16(eh.e_machine, big) != EM_MIPS ||
+			(eh.e_ident[EI_DATA] != ELFDATA2LSB && !big)) {
+		printf("Error: %s is not a 32-bit MIPS ELF executable\n", prog_file);
+		return FALSE;
+	}
+	if (elf16(eh.e_type, big) != ET_EXEC) {
+		printf("Error: %s is an ELF file of type %u, only executables (%u) can be loaded\n", prog_file,
+				elf16(eh.e_type, big), ET_EXEC);
+		return FALSE;
+	}
+
+	PROGRAM_TEXT_BEGIN = 0;
+	PROGRAM_SIZE = 0;
+	phoff = elf32(eh.e_phoff, big);
+	phentsize = elf16(eh.e_phentsize, big);
+	if (phentsize < sizeof(ph)) {
+		printf("Error: %s has program headers of %u bytes, expected at least %u\n", prog_file,
+				phentsize, (uint32_t)sizeof(ph));
+		return FALSE;
+	}
+	for (i = 0; i < elf16(eh.e_phnum, big); i++) {
+		if ((size_t)phoff + (size_t)i * phentsize + sizeof(ph) > len) {
+			printf("Error: %s has a truncated program header table\n", prog_file);
+			return FALSE;
+		}
+		memcpy(&ph, buf + phoff + (size_t)i * phentsize, sizeof(ph));
+		if (elf32(ph.p_type, big) != PT_LOAD) {
+			continue;
+		}
+		offset = elf32(ph.p_offset, big);
+		vaddr = elf32(ph.p_vaddr, big);
+		filesz = elf32(ph.p_filesz, big);
+		memsz = elf32(ph.p_memsz, big);
+		flags = elf32(ph.p_flags, big);
+		if ((size_t)offset + filesz > len || filesz > memsz) {
+			printf("Error: %s has a segment outside the file\n", prog_file);
+			return FALSE;
+		}
+		if (memsz > 0 && vaddr + memsz - 1 < vaddr) {
+			printf("Error: %s has a segment at 0x%08x of %u bytes past the end of the address space\n",
+					prog_file, vaddr, memsz);
+			return FALSE;
+		}
+		if (memsz > 0 && (mem_page(vaddr, TRUE) == NULL || mem_page(vaddr + memsz - 1, TRUE) == NULL)) {
+			printf("Warning: segment 0x%08x-0x%08x lies outside simulated memory\n", vaddr, vaddr + memsz - 1);
+		}
+		mem_write_block(vaddr, buf + offset, filesz, big);
+		if ((flags & PF_X) && PROGRAM_SIZE == 0) {
+			PROGRAM_TEXT_BEGIN = vaddr;
+			PROGRAM_SIZE = filesz/4;
+		}
+		if (vaddr >= MEM_DATA_BEGIN && vaddr <= MEM_DATA_END && memsz > 0) {
+			/* sbrk hands out memory above the data and bss */
+			syscall_heap(vaddr + memsz);
+		}
+		bytes += filesz;
+		segments++;
+	}
+	if (segments == 0) {
+		printf("Error: %s has no loadable segment\n", prog_file);
+		return FALSE;
+	}
+
+	PROGRAM_ENTRY = elf32(eh.e_entry, big);
+	if (VERBOSE) {
+		printf("Program loaded into memory.\n%u segments, %u bytes written into memory, entry 0x%08x.\n\n",
+				segments, bytes, PROGRAM_ENTRY);
+	}
+	return TRUE;
+}
+
+/**************************************************************/
+/* load program into memory, FALSE if it can't be read                    */
+/**************************************************************/
+int load_program() {
+	struct stat st;
+	uint8_t *buf;
+	int fd, format, ok;
+
+	/* Open and map the program file. */
+	fd = open(prog_file, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		printf("Error: Can't open program file %s\n", prog_file);
+		if (fd >= 0) {
+			close(fd);
+		}
+		return FALSE;
+	}
+	buf = NULL;
+	if (st.st_size > 0) {
+		buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (buf == MAP_FAILED) {
+			printf("Error: Can't map program file %s\n", prog_file);
+			close(fd);
+			return FALSE;
+		}
+	}
+	close(fd);
+
+	format = PROGRAM_FORMAT == FORMAT_AUTO ? detect_format(buf, st.st_size) : PROGRAM_FORMAT;
+	switch (format) {
+		case FORMAT_ELF:
+			ok = load_elf(buf, st.st_size);
+			break;
+		case FORMAT_BIN:
+			ok = load_binary(buf, st.st_size, TRUE);
+			break;
+		case FORMAT_BINLE:
+			ok = load_binary(buf, st.st_size, FALSE);
+			break;
+		default:
+			ok = load_hex(buf, st.st_size);
+			break;
+	}
+
+	if (buf != NULL) {
+		munmap(buf, st.st_size);
+	}
+	return ok;
+}
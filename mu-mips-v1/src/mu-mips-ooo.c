@@ -0,0 +1,411 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "mu-mips.h"
+#include "mu-mips-pipeline.h"
+#include "mu-mips-cache.h"
+#include "mu-mips-dram.h"
+#include "mu-mips-bpred.h"
+#include "mu-mips-ooo.h"
+
+/***************************************************************/
+/* Out-of-order core. Every cycle retires, issues, dispatches and        */
+/* fetches in that order, so an instruction spends at least a cycle in */
+/* each. A result is ready latency cycles after issue and dependents   */
+/* can issue that cycle. Stores write L1D when they retire, through a */
+/* write buffer that never stalls.                                                          */
+/***************************************************************/
+
+ooo_t OOO_CONFIG = { 4, 4, 64, 32, 16, 2, 1, 1, 3, 20 };
+
+static int parse_uint(const char *s, uint32_t *value)
+{
+	char *end;
+
+	*value = strtoul(s, &end, 0);
+	return end != s && *end == '\0' && *value > 0;
+}
+
+/***************************************************************/
+/* Parse an out-of-order core option, FALSE if it is not one              */
+/***************************************************************/
+int ooo_option(const char *opt)
+{
+	static const char *keys[] = { "ooo.fetch=", "ooo.width=", "ooo.rob=", "ooo.rs=", "ooo.lsq=",
+			"ooo.alu=", "ooo.mem=", "ooo.muldiv=", "ooo.mul=", "ooo.div=" };
+	uint32_t *fields[] = { &OOO_CONFIG.fetch_width, &OOO_CONFIG.width, &OOO_CONFIG.rob_size,
+			&OOO_CONFIG.rs_size, &OOO_CONFIG.lsq_size, &OOO_CONFIG.alus, &OOO_CONFIG.mem_ports,
+			&OOO_CONFIG.muldivs, &OOO_CONFIG.mul_latency, &OOO_CONFIG.div_latency };
+	int i;
+
+	for (i = 0; i < 10; i++) {
+		if (strncmp(opt, keys[i], strlen(keys[i])) == 0) {
+			return parse_uint(opt + strlen(keys[i]), fields[i]);
+		}
+	}
+	return FALSE;
+}
+
+/***************************************************************/
+/* Allocate the machine's reorder buffer, units and fetch queue          */
+/***************************************************************/
+int ooo_init()
+{
+	if (MACHINE->ooo == NULL) {
+		MACHINE->ooo = calloc(1, sizeof(ooo_t));
+		if (MACHINE->ooo == NULL) {
+			printf("Error: Can't allocate the out-of-order model\n");
+			return FALSE;
+		}
+	}
+	memcpy(MACHINE->ooo, &OOO_CONFIG, offsetof(ooo_t, now));
+	if (OOO.rs_size > OOO.rob_size || OOO.lsq_size > OOO.rob_size) {
+		printf("Error: Reservation stations (%u) and LSQ (%u) can't outnumber the ROB entries (%u)\n",
+				OOO.rs_size, OOO.lsq_size, OOO.rob_size);
+		return FALSE;
+	}
+	free(OOO.rob);
+	free(OOO.muldiv_busy);
+	free(OOO.fetchq);
+	OOO.fetchq_size = 2 * OOO.fetch_width;
+	OOO.rob = malloc(OOO.rob_size * sizeof(ooo_entry_t));
+	OOO.muldiv_busy = malloc(OOO.muldivs * sizeof(uint64_t));
+	OOO.fetchq = malloc(OOO.fetchq_size * sizeof(pipe_slot_t));
+	if (OOO.rob == NULL || OOO.muldiv_busy == NULL || OOO.fetchq == NULL) {
+		printf("Error: Can't allocate the out-of-order model\n");
+		return FALSE;
+	}
+	ooo_reset();
+	return TRUE;
+}
+
+/***************************************************************/
+/* Empty the core and clear the counters                                               */
+/***************************************************************/
+void ooo_reset()
+{
+	if (MACHINE->ooo == NULL || OOO.rob == NULL) {
+		return;
+	}
+	memset(OOO.rename, 0, sizeof(OOO.rename));
+	memset(OOO.muldiv_busy, 0, OOO.muldivs * sizeof(uint64_t));
+	OOO.now = 0;
+	OOO.head = OOO.tail = 1;
+	OOO.rs_used = OOO.lsq_used = 0;
+	OOO.fetchq_head = OOO.fetchq_count = 0;
+	OOO.fetch_ready = 0;
+	OOO.fetch_accessed = FALSE;
+	OOO.redirect = 0;
+	OOO.redirect_pending = FALSE;
+	OOO.fetch_done = FALSE;
+	memset(&OOO.cycles, 0, sizeof(ooo_t) - offsetof(ooo_t, cycles));
+}
+
+/***************************************************************/
+/* Let fetch go on after a stop that was not a halt                           */
+/***************************************************************/
+void ooo_resume()
+{
+	if (MACHINE->ooo != NULL) {
+		OOO.fetch_done = FALSE;
+	}
+}
+
+void ooo_release()
+{
+	if (MACHINE->ooo == NULL) {
+		return;
+	}
+	free(OOO.rob);
+	free(OOO.muldiv_busy);
+	free(OOO.fetchq);
+	free(MACHINE->ooo);
+	MACHINE->ooo = NULL;
+}
+
+#define ENTRY(seq) (&OOO.rob[(seq) % OOO.rob_size])
+
+static int ooo_mem(const pipe_slot_t *s)
+{
+	return s->load || s->store;
+}
+
+/* has the producer's result been computed by now */
+static int ooo_available(uint64_t seq)
+{
+	const ooo_entry_t *e;
+
+	if (seq < OOO.head) {
+		return TRUE;
+	}
+	e = ENTRY(seq);
+	return e->issued && e->ready <= OOO.now;
+}
+
+/***************************************************************/
+/* Retire up to width finished instructions from the head of the ROB */
+/***************************************************************/
+static void ooo_commit()
+{
+	ooo_entry_t *e;
+	uint32_t n;
+
+	for (n = 0; n < OOO.width && OOO.head < OOO.tail; n++) {
+		e = ENTRY(OOO.head);
+		if (!e->issued || e->ready > OOO.now) {
+			break;
+		}
+		if (e->s.store) {
+			cache_access(&L1D, e->s.mem_addr, TRUE);
+		}
+		if (ooo_mem(&e->s)) {
+			OOO.lsq_used--;
+		}
+		OOO.head++;
+		/* a breakpoint stop carries no instruction */
+		OOO.retired += e->s.op != OP_BREAKPOINT;
+		if (e->s.halt) {
+			RUN_FLAG = FALSE;
+			break;
+		}
+	}
+}
+
+/***************************************************************/
+/* Cycles until a load's data is back, 0 if it has to wait for an       */
+/* older store to the same word                                                             */
+/***************************************************************/
+static uint32_t ooo_load(uint64_t seq)
+{
+	uint32_t word = ENTRY(seq)->s.mem_addr & ~3u;
+	const ooo_entry_t *e;
+	uint64_t older;
+
+	for (older = seq - 1; older >= OOO.head; older--) {
+		e = ENTRY(older);
+		if (e->s.store && (e->s.mem_addr & ~3u) == word) {
+			if (!e->issued || e->ready > OOO.now) {
+				OOO.load_waits++;
+				return 0;
+			}
+			OOO.forwarded++;
+			return 1;
+		}
+	}
+	return 1 + cache_access(&L1D, ENTRY(seq)->s.mem_addr, FALSE);
+}
+
+/***************************************************************/
+/* Issue up to width ready instructions, oldest first, to free units  */
+/***************************************************************/
+static void ooo_issue()
+{
+	uint32_t n = 0, alus = 0, ports = 0, latency, i;
+	ooo_entry_t *e;
+	uint64_t seq;
+
+	for (seq = OOO.head; seq < OOO.tail && n < OOO.width; seq++) {
+		e = ENTRY(seq);
+		if (e->issued || !ooo_available(e->src[0]) || !ooo_available(e->src[1])) {
+			continue;
+		}
+		switch (e->fu) {
+			case OOO_MEM:
+				if (ports == OOO.mem_ports) {
+					continue;
+				}
+				latency = e->s.load ? ooo_load(seq) : 1;
+				if (latency == 0) {
+					continue;
+				}
+				ports++;
+				OOO.loads += e->s.load;
+				break;
+			case OOO_MULDIV:
+				for (i = 0; i < OOO.muldivs && OOO.muldiv_busy[i] > OOO.now; i++);
+				if (i == OOO.muldivs) {
+					continue;
+				}
+				if (e->s.op == OP_DIV || e->s.op == OP_DIVU) {
+					latency = OOO.div_latency;
+					OOO.muldiv_busy[i] = OOO.now + latency;
+				} else {
+					latency = OOO.mul_latency;
+					OOO.muldiv_busy[i] = OOO.now + 1;
+				}
+				break;
+			default:
+				if (alus == OOO.alus) {
+					continue;
+				}
+				alus++;
+				latency = 1;
+				break;
+		}
+		e->issued = TRUE;
+		e->ready = OOO.now + latency;
+		OOO.rs_used--;
+		n++;
+	}
+}
+
+/***************************************************************/
+/* Rename up to width fetched instructions into the ROB, stopping at  */
+/* the first that finds its ROB, RS or LSQ full                                   */
+/***************************************************************/
+static void ooo_dispatch()
+{
+	pipe_slot_t *s;
+	ooo_entry_t *e;
+	uint64_t reads, writes;
+	uint32_t n, r, nsrc;
+
+	for (n = 0; n < OOO.width && OOO.fetchq_count > 0; n++) {
+		s = &OOO.fetchq[OOO.fetchq_head];
+		if (OOO.tail - OOO.head == OOO.rob_size) {
+			OOO.rob_full++;
+			return;
+		}
+		if (OOO.rs_used == OOO.rs_size) {
+			OOO.rs_full++;
+			return;
+		}
+		if (ooo_mem(s) && OOO.lsq_used == OOO.lsq_size) {
+			OOO.lsq_full++;
+			return;
+		}
+		e = ENTRY(OOO.tail);
+		e->s = *s;
+		e->issued = FALSE;
+		e->fu = ooo_mem(s) ? OOO_MEM : s->op >= OP_MULT && s->op <= OP_DIVU ? OOO_MULDIV : OOO_ALU;
+		/* at most two of the GPRs, HI and LO are read */
+		e->src[0] = e->src[1] = 0;
+		for (reads = s->reads, nsrc = 0; reads; reads &= reads - 1) {
+			r = __builtin_ctzll(reads);
+			if (OOO.rename[r] >= OOO.head && nsrc < 2) {
+				e->src[nsrc++] = OOO.rename[r];
+			}
+		}
+		for (writes = s->writes; writes; writes &= writes - 1) {
+			OOO.rename[__builtin_ctzll(writes)] = OOO.tail;
+		}
+		if (s->redirect) {
+			OOO.redirect = OOO.tail;
+			OOO.redirect_pending = FALSE;
+		}
+		OOO.rs_used++;
+		OOO.lsq_used += ooo_mem(s);
+		OOO.tail++;
+		OOO.fetchq_head = (OOO.fetchq_head + 1) % OOO.fetchq_size;
+		OOO.fetchq_count--;
+	}
+}
+
+/***************************************************************/
+/* Fetch up to fetch_width instructions down the predicted path,        */
+/* ending the group at a taken control instruction                           */
+/***************************************************************/
+static void ooo_fetch()
+{
+	pipe_slot_t *s;
+	uint32_t n, latency;
+
+	if (OOO.fetch_done) {
+		return;
+	}
+	/* a mispredicted instruction blocks fetch until it has executed */
+	if (OOO.redirect_pending || (OOO.redirect != 0 &&
+			(OOO.redirect >= OOO.head && !ooo_available(OOO.redirect)))) {
+		OOO.redirect_stalls++;
+		return;
+	}
+	if (OOO.redirect != 0) {
+		OOO.fetch_ready = OOO.now + BPRED.penalty;
+		OOO.redirect = 0;
+	}
+	for (n = 0; n < OOO.fetch_width && OOO.fetchq_count < OOO.fetchq_size; n++) {
+		if (!OOO.fetch_accessed) {
+			latency = cache_access(&L1I, CURRENT_STATE.PC, FALSE);
+			OOO.fetch_accessed = TRUE;
+			if (latency > 0 && OOO.now + latency > OOO.fetch_ready) {
+				OOO.fetch_ready = OOO.now + latency;
+			}
+		}
+		if (OOO.now < OOO.fetch_ready) {
+			if (n == 0) {
+				OOO.icache_stalls++;
+			}
+			return;
+		}
+		OOO.fetch_accessed = FALSE;
+		s = &OOO.fetchq[(OOO.fetchq_head + OOO.fetchq_count) % OOO.fetchq_size];
+		pipe_execute(s);
+		OOO.fetchq_count++;
+		if (s->halt) {
+			OOO.fetch_done = TRUE;
+			return;
+		}
+		if (s->redirect) {
+			OOO.redirect_pending = TRUE;
+			return;
+		}
+		if (CURRENT_STATE.PC != s->pc + 4) {
+			return;
+		}
+	}
+}
+
+/***************************************************************/
+/* Run up to max cycles, returns how many were simulated before the */
+/* halting instruction retired                                                                  */
+/***************************************************************/
+uint32_t ooo_run(uint32_t max)
+{
+	uint32_t n;
+
+	for (n = 0; n < max && RUN_FLAG; n++) {
+		OOO.now++;
+		OOO.cycles++;
+		DRAM.now++;
+		ooo_commit();
+		ooo_issue();
+		ooo_dispatch();
+		ooo_fetch();
+		OOO.rob_occupancy += OOO.tail - OOO.head;
+	}
+	trace_sink_flush();
+	return n;
+}
+
+/***************************************************************/
+/* Print the core's counters                                                                      */
+/***************************************************************/
+void ooo_report()
+{
+	printf("# Cycles\t\t: %llu\n", (unsigned long long)OOO.cycles);
+	printf("# Instructions Retired\t: %llu\n", (unsigned long long)OOO.retired);
+	printf("IPC\t\t\t: %.3f (CPI %.3f)\n", OOO.cycles ? (double)OOO.retired / OOO.cycles : 0.0,
+			OOO.retired ? (double)OOO.cycles / OOO.retired : 0.0);
+	printf("Core\t\t\t: fetch %u, width %u, ROB %u, RS %u, LSQ %u, %u ALU, %u memory, %u MULT/DIV (%u/%u cycles)\n",
+			OOO.fetch_width, OOO.width, OOO.rob_size, OOO.rs_size, OOO.lsq_size, OOO.alus,
+			OOO.mem_ports, OOO.muldivs, OOO.mul_latency, OOO.div_latency);
+	printf("Dispatch stalls\t\t: %llu ROB full, %llu RS full, %llu LSQ full\n",
+			(unsigned long long)OOO.rob_full, (unsigned long long)OOO.rs_full,
+			(unsigned long long)OOO.lsq_full);
+	printf("Fetch stalls\t\t: %llu instruction cache, %llu mispredictions\n",
+			(unsigned long long)OOO.icache_stalls, (unsigned long long)OOO.redirect_stalls);
+	printf("Loads\t\t\t: %llu, %llu forwarded from stores, %llu cycles waiting on older stores\n",
+			(unsigned long long)OOO.loads, (unsigned long long)OOO.forwarded,
+			(unsigned long long)OOO.load_waits);
+	printf("ROB occupancy\t\t: %.2f on average\n\n", OOO.cycles ? (double)OOO.rob_occupancy / OOO.cycles : 0.0);
+	bpred_report();
+	cache_report(&L1I);
+	cache_report(&L1D);
+	dram_report();
+	if (L1I.lines != NULL || L1D.lines != NULL || DRAM.enabled) {
+		printf("\n");
+	}
+}
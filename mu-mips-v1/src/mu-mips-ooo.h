@@ -0,0 +1,65 @@
+#include <stdint.h>
+
+/***************************************************************/
+/* Out-of-order superscalar timing model.                                            */
+/* Functional-first like the pipeline model: instructions execute on  */
+/* the functional model as they are fetched, and only their timing     */
+/* goes through the core. Fetch follows the branch predictor and        */
+/* stops behind a mispredicted branch until it executes. Dispatch    */
+/* renames into a reorder buffer and reservation stations, the oldest */
+/* ready instructions issue to free functional units, and the ROB        */
+/* retires in order. Loads take their data from the youngest older     */
+/* store to the same word when there is one; addresses are known at  */
+/* dispatch, so there is no memory dependence misspeculation.           */
+/***************************************************************/
+
+enum { OOO_ALU, OOO_MEM, OOO_MULDIV };
+
+typedef struct {
+	pipe_slot_t s;
+	int fu;                                /* OOO_ALU, OOO_MEM or OOO_MULDIV */
+	uint64_t src[2];                       /* producers' sequence numbers, 0 = none */
+	int issued;
+	uint64_t ready;                        /* cycle the result can be used */
+} ooo_entry_t;
+
+typedef struct ooo_struct {
+	/* configuration */
+	uint32_t fetch_width;                  /* instructions fetched per cycle */
+	uint32_t width;                        /* dispatched, issued and retired per cycle */
+	uint32_t rob_size, rs_size, lsq_size;
+	uint32_t alus, mem_ports, muldivs;     /* functional units */
+	uint32_t mul_latency, div_latency;     /* HI/LO results; MULT pipelined, DIV not */
+	/* state */
+	uint64_t now;
+	ooo_entry_t *rob;                      /* entry of sequence number n at n % rob_size */
+	uint64_t head, tail;                   /* oldest in flight and next sequence numbers */
+	uint64_t rename[34];                   /* last writer of each GPR, HI and LO */
+	uint32_t rs_used, lsq_used;
+	uint64_t *muldiv_busy;                 /* cycle each MULT/DIV unit is free again */
+	pipe_slot_t *fetchq;                   /* fetched, waiting for dispatch */
+	uint32_t fetchq_size, fetchq_head, fetchq_count;
+	uint64_t fetch_ready;                  /* cycle an instruction cache miss is served */
+	int fetch_accessed;                    /* the next instruction has been looked up in L1I */
+	uint64_t redirect;                     /* mispredicted instruction fetch waits on */
+	int redirect_pending;                  /* fetched, not dispatched yet */
+	int fetch_done;                        /* the halting instruction has been fetched */
+	/* statistics */
+	uint64_t cycles, retired;
+	uint64_t rob_full, rs_full, lsq_full;  /* cycles dispatch waited for each */
+	uint64_t icache_stalls, redirect_stalls;
+	uint64_t loads, forwarded, load_waits; /* load_waits: cycles loads waited on older stores */
+	uint64_t rob_occupancy;                /* summed every cycle */
+} ooo_t;
+
+extern ooo_t OOO_CONFIG;                   /* options, copied into each machine */
+
+#define OOO (*MACHINE->ooo)
+
+int ooo_option(const char *opt);
+int ooo_init();
+void ooo_reset();
+void ooo_resume();
+void ooo_release();
+uint32_t ooo_run(uint32_t max);
+void ooo_report();
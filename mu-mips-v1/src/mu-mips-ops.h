@@ -0,0 +1,81 @@
+/***************************************************************/
+/* Instruction semantics, one entry per handler index.                                      */
+/* Every execution engine expands this list, so a fix here applies   */
+/* to all of them. Bodies see the decoded entry as d, read            */
+/* CURRENT_STATE and write NEXT_STATE (NEXT_STATE.PC already holds */
+/* the fall-through address).                                                                                   */
+/***************************************************************/
+#define MIPS_OPS(X) \
+	X(SLL,    NEXT_STATE.REGS[d->rd] = CURRENT_STATE.REGS[d->rt] << d->sa;) \
+	X(SRL,    NEXT_STATE.REGS[d->rd] = CURRENT_STATE.REGS[d->rt] >> d->sa;) \
+	X(SRA,    NEXT_STATE.REGS[d->rd] = (int32_t)CURRENT_STATE.REGS[d->rt] >> d->sa;) \
+	X(JR,     NEXT_STATE.PC = CURRENT_STATE.REGS[d->rs];) \
+	X(JALR,   NEXT_STATE.REGS[d->rd] = CURRENT_STATE.PC + 4; \
+	          NEXT_STATE.PC = CURRENT_STATE.REGS[d->rs];) \
+	X(SYSCALL, syscall_emulate(&CURRENT_STATE, &NEXT_STATE);) \
+	X(MFHI,   NEXT_STATE.REGS[d->rd] = CURRENT_STATE.HI;) \
+	X(MTHI,   NEXT_STATE.HI = CURRENT_STATE.REGS[d->rs];) \
+	X(MFLO,   NEXT_STATE.REGS[d->rd] = CURRENT_STATE.LO;) \
+	X(MTLO,   NEXT_STATE.LO = CURRENT_STATE.REGS[d->rs];) \
+	X(MULT, \
+		uint64_t product = (uint64_t)((int64_t)(int32_t)CURRENT_STATE.REGS[d->rs] * (int64_t)(int32_t)CURRENT_STATE.REGS[d->rt]); \
+		NEXT_STATE.LO = (product & 0X00000000FFFFFFFF); \
+		NEXT_STATE.HI = (product & 0XFFFFFFFF00000000)>>32;) \
+	X(MULTU, \
+		uint64_t product = (uint64_t)CURRENT_STATE.REGS[d->rs] * (uint64_t)CURRENT_STATE.REGS[d->rt]; \
+		NEXT_STATE.LO = (product & 0X00000000FFFFFFFF); \
+		NEXT_STATE.HI = (product & 0XFFFFFFFF00000000)>>32;) \
+	X(DIV, \
+		if(CURRENT_STATE.REGS[d->rt] == 0xFFFFFFFF && CURRENT_STATE.REGS[d->rs] == 0x80000000){ \
+			/* the one quotient that overflows, would trap on the host */ \
+			NEXT_STATE.LO = 0x80000000; \
+			NEXT_STATE.HI = 0; \
+		} \
+		else if(CURRENT_STATE.REGS[d->rt] != 0){ \
+			NEXT_STATE.LO = (int32_t)CURRENT_STATE.REGS[d->rs] / (int32_t)CURRENT_STATE.REGS[d->rt]; \
+			NEXT_STATE.HI = (int32_t)CURRENT_STATE.REGS[d->rs] % (int32_t)CURRENT_STATE.REGS[d->rt]; \
+		}) \
+	X(DIVU, \
+		if(CURRENT_STATE.REGS[d->rt] != 0){ \
+			NEXT_STATE.LO = CURRENT_STATE.REGS[d->rs] / CURRENT_STATE.REGS[d->rt]; \
+			NEXT_STATE.HI = CURRENT_STATE.REGS[d->rs] % CURRENT_STATE.REGS[d->rt]; \
+		}) \
+	X(ADD,    NEXT_STATE.REGS[d->rd] = CURRENT_STATE.REGS[d->rs] + CURRENT_STATE.REGS[d->rt];) \
+	X(ADDU,   NEXT_STATE.REGS[d->rd] = CURRENT_STATE.REGS[d->rs] + CURRENT_STATE.REGS[d->rt];) \
+	X(SUB,    NEXT_STATE.REGS[d->rd] = CURRENT_STATE.REGS[d->rs] - CURRENT_STATE.REGS[d->rt];) \
+	X(SUBU,   NEXT_STATE.REGS[d->rd] = CURRENT_STATE.REGS[d->rs] - CURRENT_STATE.REGS[d->rt];) \
+	X(AND,    NEXT_STATE.REGS[d->rd] = CURRENT_STATE.REGS[d->rs] & CURRENT_STATE.REGS[d->rt];) \
+	X(OR,     NEXT_STATE.REGS[d->rd] = CURRENT_STATE.REGS[d->rs] | CURRENT_STATE.REGS[d->rt];) \
+	X(XOR,    NEXT_STATE.REGS[d->rd] = CURRENT_STATE.REGS[d->rs] ^ CURRENT_STATE.REGS[d->rt];) \
+	X(NOR,    NEXT_STATE.REGS[d->rd] = ~(CURRENT_STATE.REGS[d->rs] | CURRENT_STATE.REGS[d->rt]);) \
+	X(SLT,    NEXT_STATE.REGS[d->rd] = (int32_t)CURRENT_STATE.REGS[d->rs] < (int32_t)CURRENT_STATE.REGS[d->rt];) \
+	X(BLTZ,   if((int32_t)CURRENT_STATE.REGS[d->rs] < 0){ NEXT_STATE.PC = d->target; }) \
+	X(BGEZ,   if((int32_t)CURRENT_STATE.REGS[d->rs] >= 0){ NEXT_STATE.PC = d->target; }) \
+	X(J,      NEXT_STATE.PC = d->target;) \
+	X(JAL,    NEXT_STATE.REGS[31] = CURRENT_STATE.PC + 4; \
+	          NEXT_STATE.PC = d->target;) \
+	X(BEQ,    if(CURRENT_STATE.REGS[d->rs] == CURRENT_STATE.REGS[d->rt]){ NEXT_STATE.PC = d->target; }) \
+	X(BNE,    if(CURRENT_STATE.REGS[d->rs] != CURRENT_STATE.REGS[d->rt]){ NEXT_STATE.PC = d->target; }) \
+	X(BLEZ,   if((int32_t)CURRENT_STATE.REGS[d->rs] <= 0){ NEXT_STATE.PC = d->target; }) \
+	X(BGTZ,   if((int32_t)CURRENT_STATE.REGS[d->rs] > 0){ NEXT_STATE.PC = d->target; }) \
+	X(ADDI,   NEXT_STATE.REGS[d->rt] = CURRENT_STATE.REGS[d->rs] + d->imm;) \
+	X(ADDIU,  NEXT_STATE.REGS[d->rt] = CURRENT_STATE.REGS[d->rs] + d->imm;) \
+	X(SLTI,   NEXT_STATE.REGS[d->rt] = (int32_t)CURRENT_STATE.REGS[d->rs] < d->imm;) \
+	X(ANDI,   NEXT_STATE.REGS[d->rt] = CURRENT_STATE.REGS[d->rs] & d->imm;) \
+	X(ORI,    NEXT_STATE.REGS[d->rt] = CURRENT_STATE.REGS[d->rs] | d->imm;) \
+	X(XORI,   NEXT_STATE.REGS[d->rt] = CURRENT_STATE.REGS[d->rs] ^ d->imm;) \
+	X(LUI,    NEXT_STATE.REGS[d->rt] = d->imm;) \
+	X(LB,     NEXT_STATE.REGS[d->rt] = (int32_t)(int8_t)mem_read_8(CURRENT_STATE.REGS[d->rs] + d->imm);) \
+	X(LH,     NEXT_STATE.REGS[d->rt] = (int32_t)(int16_t)mem_read_16(CURRENT_STATE.REGS[d->rs] + d->imm);) \
+	X(LW,     NEXT_STATE.REGS[d->rt] = mem_read_32(CURRENT_STATE.REGS[d->rs] + d->imm);) \
+	X(LBU,    NEXT_STATE.REGS[d->rt] = mem_read_8(CURRENT_STATE.REGS[d->rs] + d->imm);) \
+	X(LHU,    NEXT_STATE.REGS[d->rt] = mem_read_16(CURRENT_STATE.REGS[d->rs] + d->imm);) \
+	X(LL,     NEXT_STATE.REGS[d->rt] = mem_load_linked(CURRENT_STATE.REGS[d->rs] + d->imm);) \
+	X(SB,     mem_write_8(CURRENT_STATE.REGS[d->rs] + d->imm, CURRENT_STATE.REGS[d->rt] & 0x000000FF);) \
+	X(SH,     mem_write_16(CURRENT_STATE.REGS[d->rs] + d->imm, CURRENT_STATE.REGS[d->rt] & 0x0000FFFF);) \
+	X(SW,     mem_write_32(CURRENT_STATE.REGS[d->rs] + d->imm, CURRENT_STATE.REGS[d->rt]);) \
+	X(SC,     NEXT_STATE.REGS[d->rt] = mem_store_conditional(CURRENT_STATE.REGS[d->rs] + d->imm, \
+	                                                         CURRENT_STATE.REGS[d->rt]);) \
+	X(BREAKPOINT, debug_break(d);) \
+	X(UNIMPLEMENTED, \
+		printf("Instruction at 0x%x is not implemented!\n", CURRENT_STATE.PC);)
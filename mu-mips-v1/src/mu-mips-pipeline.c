@@ -0,0 +1,494 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "mu-mips-pipeline.h"
+#include "mu-mips-cache.h"
+#include "mu-mips-bpred.h"
+#include "mu-mips-dram.h"
+#include "mu-mips-sample.h"
+#include "mu-mips-ooo.h"
+#include "mu-mips-smp.h"
+#include "mu-mips-debug.h"
+
+/***************************************************************/
+/* Pipeline timing model.                                                                                  */
+/* Register values are forwarded from the EX/MEM and MEM/WB                */
+/* registers into EX, or into ID for branches resolved there. The      */
+/* register file is written in the first half of a cycle and read in */
+/* the second, so WB never causes a stall. Fetch follows the branch  */
+/* predictor and, on a misprediction, waits until the branch resolves */
+/* or for the configured penalty. A data cache miss freezes the      */
+/* whole pipeline, an instruction cache miss only starves ID.            */
+/***************************************************************/
+
+int TIMING;
+int PIPE_FORWARDING = TRUE;
+int PIPE_RESOLVE = PIPE_RESOLVE_ID;
+
+/***************************************************************/
+/* Parse a timing option of the form key=value                                   */
+/***************************************************************/
+int timing_option(const char *opt)
+{
+	if (strcmp(opt, "forwarding=on") == 0) {
+		PIPE_FORWARDING = TRUE;
+	} else if (strcmp(opt, "forwarding=off") == 0) {
+		PIPE_FORWARDING = FALSE;
+	} else if (strcmp(opt, "branch=id") == 0) {
+		PIPE_RESOLVE = PIPE_RESOLVE_ID;
+	} else if (strcmp(opt, "branch=ex") == 0) {
+		PIPE_RESOLVE = PIPE_RESOLVE_EX;
+	} else if (!cache_option(opt) && !dram_option(opt) && !bpred_option(opt) && !sample_option(opt) &&
+			!ooo_option(opt) && !smp_option(opt)) {
+		printf("Error: Unknown timing option %s\n", opt);
+		printf("  forwarding=on|off\tforward results to EX (and ID for branches), default on\n");
+		printf("  branch=id|ex     \tstage resolving branches and jump registers, default id\n");
+		printf("  l1i.size=<bytes> \tenable the instruction cache (l1d.* for the data cache), 0 = ideal\n");
+		printf("  l1i.line=<bytes>, l1i.assoc=<ways>, l1i.repl=lru|fifo|random, default 32, 2, lru\n");
+		printf("  l1d.write=wb|wt, l1d.alloc=on|off\twrite policy, default wb and on\n");
+		printf("  mem.latency=<n>  \tcycles per line fill or writeback without the DRAM model, default 20\n");
+		printf("  dram=on|off      \tDRAM model behind the caches, default off\n");
+		printf("  dram.channels=<n>, dram.banks=<n>, dram.row=<bytes>, default 1, 8, 2k\n");
+		printf("  dram.page=open|closed\trow buffer policy, default open\n");
+		printf("  dram.tcas=<n>, dram.trcd=<n>, dram.trp=<n>\ttimings in cycles, default 15, 15, 15\n");
+		printf("  dram.bus=<bytes> \tbytes per cycle per channel, default 8\n");
+		printf("  dram.queue=<n>   \twrites the controller can hold, default 16\n");
+		printf("  bpred=nottaken|bimodal|gshare\tbranch predictor, default nottaken\n");
+		printf("  bpred.size=<n>, bpred.history=<bits>, btb.size=<n>, ras.size=<n>, default 4096, 12, 512, 8\n");
+		printf("  bpred.penalty=<n>\tfetch cycles lost per misprediction, default 0 = until resolved\n");
+		printf("  sample.period=<n>, sample.warm=<n>, sample.detail=<n>, sample.window=<n>\twith -m sampled,\n");
+		printf("                   \tinstructions per period, warmed, detailed and measured, default 1m, 50k, 2k, 1k\n");
+		printf("  sample.skip=<n>  \tfast-forward before the first period, default 0\n");
+		printf("  sample.confidence=90|95|99\tconfidence of the CPI interval, default 95\n");
+		printf("  ooo.fetch=<n>, ooo.width=<n>\twith -m ooo, instructions fetched and dispatched, issued\n");
+		printf("                   \tand retired per cycle, default 4, 4\n");
+		printf("  ooo.rob=<n>, ooo.rs=<n>, ooo.lsq=<n>\tentries, default 64, 32, 16\n");
+		printf("  ooo.alu=<n>, ooo.mem=<n>, ooo.muldiv=<n>\tfunctional units, default 2, 1, 1\n");
+		printf("  ooo.mul=<n>, ooo.div=<n>\tMULT and DIV latency to HI/LO, default 3, 20\n");
+		printf("  cores=<n>        \tguest cores sharing memory, one host thread each, default 1\n");
+		printf("  smp.quantum=<n>  \tinstructions (cycles with -m pipeline or ooo) the cores run between\n");
+		printf("                   \tsynchronizations, default 10000\n");
+		printf("  smp.latency=<n>  \tcycles of a cache-to-cache transfer or an upgrade, default 10\n");
+		printf("  smp.dir=<n>      \tcoherence directory entries, default 64k\n\n");
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/***************************************************************/
+/* Give the current machine its pipeline, caches and predictor. FALSE */
+/* if an option is invalid or they can't be allocated                           */
+/***************************************************************/
+int timing_init()
+{
+	if (MACHINE->pipe == NULL) {
+		MACHINE->pipe = malloc(sizeof(struct pipe_struct));
+		if (MACHINE->pipe == NULL) {
+			printf("Error: Can't allocate the pipeline model\n");
+			return FALSE;
+		}
+	}
+	if (!cache_init() || !dram_init() || !bpred_init() || !sample_init() || !ooo_init()) {
+		return FALSE;
+	}
+	pipe_reset();
+	return TRUE;
+}
+
+void timing_release()
+{
+	cache_release();
+	dram_release();
+	bpred_release();
+	sample_release();
+	ooo_release();
+	free(MACHINE->pipe);
+	MACHINE->pipe = NULL;
+}
+
+/***************************************************************/
+/* Empty the pipeline and clear the counters                                        */
+/***************************************************************/
+void pipe_reset()
+{
+	memset(&PIPE, 0, sizeof(PIPE));
+	memset(&PIPE_STATS, 0, sizeof(PIPE_STATS));
+	cache_reset();
+	dram_reset();
+	bpred_reset();
+	sample_reset();
+	ooo_reset();
+}
+
+/***************************************************************/
+/* Fetch again after the run stopped at a breakpoint or watchpoint,  */
+/* the pipeline drained as for a halt                                                    */
+/***************************************************************/
+void timing_resume()
+{
+	PIPE.fetch_done = FALSE;
+	ooo_resume();
+}
+
+#define REG(r) ((r) ? 1ULL << (r) : 0)
+
+/***************************************************************/
+/* Registers an instruction reads                                                          */
+/***************************************************************/
+static uint64_t pipe_reads(const decoded_inst_t *d)
+{
+	switch (d->op) {
+		case OP_SLL: case OP_SRL: case OP_SRA:
+			return REG(d->rt);
+		case OP_JR: case OP_JALR: case OP_MTHI: case OP_MTLO:
+		case OP_BLTZ: case OP_BGEZ: case OP_BLEZ: case OP_BGTZ:
+		case OP_ADDI: case OP_ADDIU: case OP_SLTI: case OP_ANDI: case OP_ORI: case OP_XORI:
+		case OP_LB: case OP_LH: case OP_LW: case OP_LBU: case OP_LHU: case OP_LL:
+			return REG(d->rs);
+		case OP_SYSCALL:
+			return REG(2) | REG(4) | REG(5) | REG(6);
+		case OP_MFHI:
+			return PIPE_HI;
+		case OP_MFLO:
+			return PIPE_LO;
+		case OP_J: case OP_JAL: case OP_LUI: case OP_UNIMPLEMENTED:
+			return 0;
+		default:
+			/* two-register ALU ops, MULT/DIV, BEQ/BNE and stores */
+			return REG(d->rs) | REG(d->rt);
+	}
+}
+
+/***************************************************************/
+/* Registers an instruction writes                                                         */
+/***************************************************************/
+static uint64_t pipe_writes(const decoded_inst_t *d)
+{
+	switch (d->op) {
+		case OP_MULT: case OP_MULTU: case OP_DIV: case OP_DIVU:
+			return PIPE_HI | PIPE_LO;
+		case OP_MTHI:
+			return PIPE_HI;
+		case OP_MTLO:
+			return PIPE_LO;
+		case OP_SYSCALL:
+			return REG(2) | REG(4) | REG(5);
+		default:
+			return REG(d->wb);
+	}
+}
+
+/***************************************************************/
+/* Does the instruction need its operands in ID                                  */
+/***************************************************************/
+static int pipe_reads_in_id(const pipe_slot_t *s)
+{
+	switch (s->op) {
+		case OP_BEQ: case OP_BNE: case OP_BLEZ: case OP_BGTZ: case OP_BLTZ: case OP_BGEZ:
+		case OP_JR: case OP_JALR:
+			return PIPE_RESOLVE == PIPE_RESOLVE_ID;
+		default:
+			return FALSE;
+	}
+}
+
+int pipe_control(uint8_t op)
+{
+	return op == OP_J || op == OP_JAL || op == OP_JR || op == OP_JALR ||
+			op == OP_BEQ || op == OP_BNE || op == OP_BLEZ || op == OP_BGTZ ||
+			op == OP_BLTZ || op == OP_BGEZ;
+}
+
+/***************************************************************/
+/* Stage where fetch learns the instruction's real successor           */
+/***************************************************************/
+static int pipe_resolved_in_ex(const pipe_slot_t *s)
+{
+	/* jump targets are known once decoded */
+	return s->op != OP_J && s->op != OP_JAL && PIPE_RESOLVE == PIPE_RESOLVE_EX;
+}
+
+/***************************************************************/
+/* Check the instruction in ID against the producers in EX and MEM,  */
+/* TRUE if it has to stay in ID this cycle                                             */
+/***************************************************************/
+static int pipe_data_hazard(const pipe_slot_t *id, int *load_use)
+{
+	const pipe_slot_t *ex = &PIPE.id_ex, *mem = &PIPE.ex_mem;
+	int in_id = pipe_reads_in_id(id);
+
+	*load_use = FALSE;
+	if (ex->valid && (ex->writes & id->reads)) {
+		/* an ALU result can be forwarded into EX next cycle, a load result cannot */
+		if (!PIPE_FORWARDING || in_id || ex->load) {
+			*load_use = ex->load;
+			return TRUE;
+		}
+	}
+	if (mem->valid && (mem->writes & id->reads)) {
+		/* EX/MEM forwards into ID unless the value is still being loaded */
+		if (!PIPE_FORWARDING || (in_id && mem->load)) {
+			*load_use = mem->load;
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/***************************************************************/
+/* Execute the next instruction on the functional model and capture  */
+/* what a timing model needs to know about it                                   */
+/***************************************************************/
+void pipe_execute(pipe_slot_t *s)
+{
+	decoded_inst_t *d, e;
+	uint32_t pc = CURRENT_STATE.PC, predicted = pc + 4;
+	uint8_t rs;
+
+	d = fetch_decoded(pc);
+	if (d->op == OP_BREAKPOINT) {
+		if (debug_stop(pc)) {
+			/* nothing executes, the slot takes the stop to retirement like a halt */
+			memset(s, 0, sizeof(*s));
+			s->valid = TRUE;
+			s->pc = pc;
+			s->word = d->word;
+			s->op = OP_BREAKPOINT;
+			s->halt = TRUE;
+			RUN_FLAG = TRUE;
+			return;
+		}
+		/* time the instruction under the breakpoint as itself */
+		decode_instruction(pc, d->word, &e);
+		d = &e;
+	}
+	s->valid = TRUE;
+	s->pc = pc;
+	s->word = d->word;
+	s->op = d->op;
+	s->reads = pipe_reads(d);
+	s->writes = pipe_writes(d);
+	s->load = d->op >= OP_LB && d->op <= OP_LL;
+	s->store = d->op >= OP_SB && d->op <= OP_SC;
+	s->mem_addr = CURRENT_STATE.REGS[d->rs] + d->imm;
+	rs = d->rs;
+	if (pipe_control(s->op)) {
+		predicted = bpred_predict(pc, s->op, rs);
+	}
+
+	execute_instruction();
+
+	if (pipe_control(s->op)) {
+		bpred_update(pc, s->op, rs, CURRENT_STATE.PC, predicted);
+	}
+	/* fetch went on at the predicted PC */
+	s->redirect = CURRENT_STATE.PC != predicted;
+	/* the program stops when the instruction retires, not when it is fetched */
+	s->halt = !RUN_FLAG;
+	RUN_FLAG = TRUE;
+}
+
+/* IF */
+static void pipe_fetch(pipe_slot_t *s)
+{
+	pipe_execute(s);
+	if (s->halt) {
+		PIPE.fetch_done = TRUE;
+	}
+}
+
+/***************************************************************/
+/* Advance the pipeline by one clock                                                    */
+/***************************************************************/
+static void pipe_cycle()
+{
+	pipe_slot_t *id = &PIPE.if_id;
+	int stall = FALSE, load_use, fetch_blocked;
+
+	PIPE_STATS.cycles++;
+	DRAM.now++;
+
+	/* WB */
+	if (PIPE.mem_wb.valid) {
+		/* a breakpoint stop carries no instruction */
+		PIPE_STATS.retired += PIPE.mem_wb.op != OP_BREAKPOINT;
+		if (PIPE.mem_wb.halt) {
+			RUN_FLAG = FALSE;
+		}
+	}
+	PIPE.mem_wb.valid = FALSE;
+
+	/* MEM holds everything behind it until the data cache answers */
+	if (PIPE.mem_wait > 0) {
+		PIPE.mem_wait--;
+		PIPE_STATS.dcache_stalls++;
+		return;
+	}
+
+	/* ID */
+	if (id->valid && pipe_data_hazard(id, &load_use)) {
+		stall = TRUE;
+		PIPE_STATS.data_stalls++;
+		PIPE_STATS.load_use_stalls += load_use;
+	}
+
+	/* IF waits while a mispredicted instruction is still unresolved, or out the fixed penalty */
+	if (BPRED.penalty > 0) {
+		fetch_blocked = PIPE.redirect_wait > 0;
+	} else {
+		fetch_blocked = (id->valid && id->redirect) ||
+				(PIPE.id_ex.valid && PIPE.id_ex.redirect && pipe_resolved_in_ex(&PIPE.id_ex));
+	}
+
+	/* latch the pipeline registers, back to front */
+	PIPE.mem_wb = PIPE.ex_mem;
+	PIPE.ex_mem = PIPE.id_ex;
+	if (PIPE.ex_mem.valid && (PIPE.ex_mem.load || PIPE.ex_mem.store)) {
+		PIPE.mem_wait = cache_access(&L1D, PIPE.ex_mem.mem_addr, PIPE.ex_mem.store);
+	}
+	if (stall) {
+		PIPE.id_ex.valid = FALSE;
+		return;
+	}
+	PIPE.id_ex = *id;
+	id->valid = FALSE;
+	if (fetch_blocked) {
+		PIPE_STATS.control_bubbles++;
+		if (PIPE.redirect_wait > 0) {
+			PIPE.redirect_wait--;
+		}
+		return;
+	}
+	if (!PIPE.fetching.valid && !PIPE.fetch_done) {
+		pipe_fetch(&PIPE.fetching);
+		PIPE.fetch_wait = cache_access(&L1I, PIPE.fetching.pc, FALSE);
+	}
+	if (PIPE.fetch_wait > 0) {
+		PIPE.fetch_wait--;
+		PIPE_STATS.icache_stalls++;
+	} else if (PIPE.fetching.valid) {
+		*id = PIPE.fetching;
+		PIPE.fetching.valid = FALSE;
+		if (id->redirect) {
+			PIPE.redirect_wait = BPRED.penalty;
+		}
+	}
+}
+
+/***************************************************************/
+/* Run up to max cycles, returns how many were simulated before the */
+/* halting instruction retired                                                                  */
+/***************************************************************/
+uint32_t pipe_run(uint32_t max)
+{
+	uint32_t n;
+
+	for (n = 0; n < max && RUN_FLAG; n++) {
+		pipe_cycle();
+	}
+	trace_sink_flush();
+	return n;
+}
+
+/***************************************************************/
+/* Detailed window of the sampled model. From an empty pipeline,     */
+/* with whatever the caches and predictor hold, run until warm + n    */
+/* more instructions retire and return the cycles the last n took.     */
+/* The instructions still in flight have already executed on the       */
+/* functional model, so they are simply dropped afterwards                 */
+/***************************************************************/
+uint64_t pipe_window(uint32_t warm, uint32_t n, uint32_t *measured)
+{
+	uint64_t target = PIPE_STATS.retired + warm, cycles, retired;
+
+	memset(&PIPE, 0, sizeof(PIPE));
+	while (RUN_FLAG && PIPE_STATS.retired < target) {
+		pipe_cycle();
+	}
+	cycles = PIPE_STATS.cycles;
+	retired = PIPE_STATS.retired;
+	target += n;
+	while (RUN_FLAG && PIPE_STATS.retired < target) {
+		pipe_cycle();
+	}
+	*measured = PIPE_STATS.retired - retired;
+	cycles = PIPE_STATS.cycles - cycles;
+	/* the halting instruction was fetched but is dropped with the rest */
+	if (PIPE.fetch_done) {
+		RUN_FLAG = FALSE;
+	}
+	memset(&PIPE, 0, sizeof(PIPE));
+	trace_sink_flush();
+	return cycles;
+}
+
+/***************************************************************/
+/* Print the selected timing model's report, after the cores' on a  */
+/* multicore machine. FALSE if there is none                                        */
+/***************************************************************/
+int timing_report()
+{
+	int cores = MACHINE->smp != NULL;
+
+	if (cores) {
+		smp_report();
+	}
+	switch (TIMING) {
+		case TIMING_PIPELINE:
+			pipe_report();
+			return TRUE;
+		case TIMING_SAMPLED:
+			sample_report();
+			return TRUE;
+		case TIMING_OOO:
+			ooo_report();
+			return TRUE;
+		default:
+			return cores;
+	}
+}
+
+/***************************************************************/
+/* Cycles the selected timing model has counted, or estimated when  */
+/* sampling                                                                                                */
+/***************************************************************/
+uint64_t timing_cycles()
+{
+	switch (TIMING) {
+		case TIMING_PIPELINE:
+			return PIPE_STATS.cycles;
+		case TIMING_SAMPLED:
+			return sample_cycles();
+		case TIMING_OOO:
+			return OOO.cycles;
+		default:
+			return 0;
+	}
+}
+
+/***************************************************************/
+/* Print the pipeline counters                                                                 */
+/***************************************************************/
+void pipe_report()
+{
+	printf("# Cycles\t\t: %llu\n", (unsigned long long)PIPE_STATS.cycles);
+	printf("# Instructions Retired\t: %llu\n", (unsigned long long)PIPE_STATS.retired);
+	printf("CPI\t\t\t: %.3f\n", PIPE_STATS.retired ? (double)PIPE_STATS.cycles / PIPE_STATS.retired : 0.0);
+	printf("Data stalls\t\t: %llu (%llu load-use)\n", (unsigned long long)PIPE_STATS.data_stalls,
+			(unsigned long long)PIPE_STATS.load_use_stalls);
+	printf("Control bubbles\t\t: %llu\n", (unsigned long long)PIPE_STATS.control_bubbles);
+	printf("Cache stalls\t\t: %llu instruction, %llu data\n", (unsigned long long)PIPE_STATS.icache_stalls,
+			(unsigned long long)PIPE_STATS.dcache_stalls);
+	printf("Forwarding %s, branches resolved in %s\n\n", PIPE_FORWARDING ? "on" : "off",
+			PIPE_RESOLVE == PIPE_RESOLVE_ID ? "ID" : "EX");
+	bpred_report();
+	cache_report(&L1I);
+	cache_report(&L1D);
+	dram_report();
+	if (L1I.lines != NULL || L1D.lines != NULL || DRAM.enabled) {
+		printf("\n");
+	}
+}
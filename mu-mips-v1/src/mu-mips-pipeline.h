@@ -0,0 +1,74 @@
+#include <stdint.h>
+
+/***************************************************************/
+/* Five-stage pipeline timing model (IF/ID/EX/MEM/WB).                        */
+/* Functional-first: an instruction executes on the functional model */
+/* when it is fetched, then only its timing moves through the               */
+/* pipeline registers. The architectural state therefore runs up to   */
+/* four instructions ahead of the instruction in WB.                            */
+/***************************************************************/
+
+/* timing model selected at startup */
+enum { TIMING_FUNCTIONAL, TIMING_PIPELINE, TIMING_SAMPLED, TIMING_OOO };
+extern int TIMING;
+
+/* stage where a taken branch or jump register redirects fetch */
+enum { PIPE_RESOLVE_ID, PIPE_RESOLVE_EX };
+
+#define PIPE_HI (1ULL << 32)               /* HI and LO hazards share the GPR masks */
+#define PIPE_LO (1ULL << 33)
+
+typedef struct {
+	int valid;                             /* FALSE for a bubble */
+	uint32_t pc;
+	uint32_t word;
+	uint8_t op;
+	uint64_t reads, writes;                /* GPR masks plus PIPE_HI/PIPE_LO, R0 never set */
+	int load, store;
+	uint32_t mem_addr;                     /* effective address of a load or store */
+	int redirect;                          /* mispredicted, fetch went down the wrong path after this one */
+	int halt;                              /* retiring this instruction stops the simulation */
+} pipe_slot_t;
+
+typedef struct {
+	pipe_slot_t if_id, id_ex, ex_mem, mem_wb;
+	pipe_slot_t fetching;                  /* fetched, waiting for the instruction cache */
+	uint32_t fetch_wait, mem_wait;         /* cache stall cycles left in IF and MEM */
+	uint32_t redirect_wait;                /* misprediction penalty cycles left */
+	int fetch_done;                        /* the halting instruction has been fetched */
+} pipe_state_t;
+
+typedef struct {
+	uint64_t cycles;
+	uint64_t retired;
+	uint64_t data_stalls;                  /* cycles ID waited on a register, load-use included */
+	uint64_t load_use_stalls;
+	uint64_t control_bubbles;              /* cycles fetch waited on a redirect */
+	uint64_t icache_stalls;                /* cycles fetch waited on L1I */
+	uint64_t dcache_stalls;                /* cycles the pipeline waited on L1D */
+} pipe_stats_t;
+
+extern int PIPE_FORWARDING;
+extern int PIPE_RESOLVE;
+
+/* a machine's pipeline */
+struct pipe_struct {
+	pipe_state_t state;
+	pipe_stats_t stats;
+};
+
+#define PIPE (MACHINE->pipe->state)
+#define PIPE_STATS (MACHINE->pipe->stats)
+
+int timing_option(const char *opt);
+int timing_init();
+void timing_release();
+void pipe_reset();
+void timing_resume();
+uint32_t pipe_run(uint32_t max);
+uint64_t pipe_window(uint32_t warm, uint32_t n, uint32_t *measured);
+int pipe_control(uint8_t op);
+void pipe_execute(pipe_slot_t *s);
+void pipe_report();
+int timing_report();
+uint64_t timing_cycles();
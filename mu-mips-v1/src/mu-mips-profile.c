@@ -0,0 +1,393 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "mu-mips-ops.h"
+#include "mu-mips-profile.h"
+
+/***************************************************************/
+/* Profiler reports. Per-PC counts are collected in address order;     */
+/* a basic block is a run of consecutive PCs with the same count that  */
+/* ends at a control instruction, a loop is a taken backward branch  */
+/* or J together with the instructions it spans.                                  */
+/***************************************************************/
+
+int PROFILE;
+
+/* unmapped or misaligned fetches */
+#define PROFILE_OTHER (MACHINE->profile_other)
+
+static const char *OP_NAMES[NUM_OPS] = {
+	[OP_INVALID] = "INVALID",
+#define X(name, ...) [OP_##name] = #name,
+	MIPS_OPS(X)
+#undef X
+};
+
+static const char *CLASS_NAMES[NUM_CLASSES] = {
+	"alu", "mult/div", "load", "store", "branch taken", "branch not taken", "jump", "syscall", "other"
+};
+
+typedef struct {
+	uint32_t pc;
+	uint64_t count, taken;
+	uint8_t op;
+} profile_pc_t;
+
+typedef struct {
+	uint32_t begin, end;                   /* first and last instruction */
+	uint64_t count;                        /* block executions, or loop iterations */
+	uint64_t insts;                        /* instructions executed inside */
+} profile_range_t;
+
+/* what the reports are built from, scratch space of the reporting thread */
+static MACHINE_LOCAL profile_pc_t *PCS;
+static MACHINE_LOCAL profile_range_t *BLOCKS, *LOOPS;
+static MACHINE_LOCAL uint32_t NUM_PCS, NUM_BLOCKS, NUM_LOOPS;
+static MACHINE_LOCAL uint64_t TOTAL;
+
+/***************************************************************/
+/* Counter of an instruction outside the per-page fast path, the page */
+/* gets its counters on the first execution while profiling                */
+/***************************************************************/
+profile_count_t *profile_slow(uint32_t pc)
+{
+	mem_page_t *page = mem_page(pc, FALSE);
+
+	if (page == NULL || (pc & 0x3)) {
+		return &PROFILE_OTHER;
+	}
+	if (page->profile == NULL) {
+		page->profile = calloc(MEM_PAGE_SIZE / 4, sizeof(profile_count_t));
+		if (page->profile == NULL) {
+			printf("Error: Can't allocate profile counters for address 0x%08x\n", pc);
+			exit(-1);
+		}
+	}
+	return &page->profile[(pc & MEM_PAGE_MASK) >> 2];
+}
+
+/***************************************************************/
+/* Clear every counter                                                                               */
+/***************************************************************/
+void profile_reset()
+{
+	mem_page_t *page;
+
+	for (page = MEM_PAGES; page != NULL; page = page->next) {
+		if (page->profile != NULL) {
+			memset(page->profile, 0, (MEM_PAGE_SIZE / 4) * sizeof(profile_count_t));
+		}
+	}
+	memset(&PROFILE_OTHER, 0, sizeof(PROFILE_OTHER));
+}
+
+/***************************************************************/
+/* Free the report built by the last profile_report or profile_dump */
+/***************************************************************/
+void profile_release()
+{
+	free(PCS);
+	free(BLOCKS);
+	free(LOOPS);
+	PCS = NULL;
+	BLOCKS = LOOPS = NULL;
+	NUM_PCS = NUM_BLOCKS = NUM_LOOPS = 0;
+}
+
+static int profile_class(uint8_t op, int taken)
+{
+	switch (op) {
+		case OP_MULT: case OP_MULTU: case OP_DIV: case OP_DIVU:
+			return CLASS_MULDIV;
+		case OP_LB: case OP_LH: case OP_LW: case OP_LBU: case OP_LHU: case OP_LL:
+			return CLASS_LOAD;
+		case OP_SB: case OP_SH: case OP_SW: case OP_SC:
+			return CLASS_STORE;
+		case OP_BEQ: case OP_BNE: case OP_BLEZ: case OP_BGTZ: case OP_BLTZ: case OP_BGEZ:
+			return taken ? CLASS_BRANCH_TAKEN : CLASS_BRANCH_NOT_TAKEN;
+		case OP_J: case OP_JAL: case OP_JR: case OP_JALR:
+			return CLASS_JUMP;
+		case OP_SYSCALL:
+			return CLASS_SYSCALL;
+		case OP_INVALID: case OP_UNIMPLEMENTED:
+			return CLASS_OTHER;
+		default:
+			return CLASS_ALU;
+	}
+}
+
+static int profile_control(uint8_t op)
+{
+	int class = profile_class(op, FALSE);
+	return class == CLASS_BRANCH_NOT_TAKEN || class == CLASS_JUMP;
+}
+
+static int compare_pages(const void *a, const void *b)
+{
+	const mem_page_t *x = *(mem_page_t *const *)a, *y = *(mem_page_t *const *)b;
+	return x->vpn < y->vpn ? -1 : x->vpn > y->vpn;
+}
+
+static int compare_pcs(const void *a, const void *b)
+{
+	const profile_pc_t *x = a, *y = b;
+	if (x->count != y->count) {
+		return x->count < y->count ? 1 : -1;
+	}
+	return x->pc < y->pc ? -1 : x->pc > y->pc;
+}
+
+static int compare_ranges(const void *a, const void *b)
+{
+	const profile_range_t *x = a, *y = b;
+	if (x->insts != y->insts) {
+		return x->insts < y->insts ? 1 : -1;
+	}
+	return x->begin < y->begin ? -1 : x->begin > y->begin;
+}
+
+static void *profile_alloc(size_t n, size_t size)
+{
+	void *p = calloc(n ? n : 1, size);
+
+	if (p == NULL) {
+		printf("Error: Can't allocate profile report\n");
+		exit(-1);
+	}
+	return p;
+}
+
+/***************************************************************/
+/* Index of the first collected PC at or above pc                               */
+/***************************************************************/
+static uint32_t profile_lower_bound(uint32_t pc)
+{
+	uint32_t lo = 0, hi = NUM_PCS, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (PCS[mid].pc < pc) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/***************************************************************/
+/* Gather counts in address order and derive blocks and loops          */
+/***************************************************************/
+static void profile_collect()
+{
+	mem_page_t *page, **pages;
+	profile_range_t *block = NULL;
+	decoded_inst_t d;
+	uint64_t *prefix;
+	uint32_t n = 0, i, j, pc, first, last;
+
+	profile_release();
+	TOTAL = 0;
+
+	for (page = MEM_PAGES; page != NULL; page = page->next) {
+		n += page->profile != NULL;
+	}
+	pages = profile_alloc(n, sizeof(*pages));
+	n = 0;
+	for (page = MEM_PAGES; page != NULL; page = page->next) {
+		if (page->profile != NULL) {
+			pages[n++] = page;
+		}
+	}
+	qsort(pages, n, sizeof(*pages), compare_pages);
+
+	PCS = profile_alloc(n * (MEM_PAGE_SIZE / 4), sizeof(*PCS));
+	BLOCKS = profile_alloc(n * (MEM_PAGE_SIZE / 4), sizeof(*BLOCKS));
+	LOOPS = profile_alloc(n * (MEM_PAGE_SIZE / 4), sizeof(*LOOPS));
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < MEM_PAGE_SIZE / 4; j++) {
+			if (pages[i]->profile[j].count == 0) {
+				continue;
+			}
+			pc = (pages[i]->vpn << MEM_PAGE_SHIFT) + j * 4;
+			/* decode again, the cached entry may have been invalidated */
+			decode_instruction(pc, mem_peek(pc, 4), &d);
+			PCS[NUM_PCS].pc = pc;
+			PCS[NUM_PCS].count = pages[i]->profile[j].count;
+			PCS[NUM_PCS].taken = pages[i]->profile[j].taken;
+			PCS[NUM_PCS].op = d.op;
+			TOTAL += PCS[NUM_PCS].count;
+
+			if (block == NULL || block->end + 4 != pc || block->count != PCS[NUM_PCS].count) {
+				block = &BLOCKS[NUM_BLOCKS++];
+				block->begin = pc;
+				block->count = PCS[NUM_PCS].count;
+				block->insts = 0;
+			}
+			block->end = pc;
+			block->insts += PCS[NUM_PCS].count;
+			if (profile_control(d.op)) {
+				block = NULL;
+				/* taken backward branches and jumps close a loop, calls and returns do not */
+				if (PCS[NUM_PCS].taken > 0 && d.op != OP_JR && d.op != OP_JALR && d.op != OP_JAL &&
+						d.target <= pc) {
+					LOOPS[NUM_LOOPS].begin = d.target;
+					LOOPS[NUM_LOOPS].end = pc;
+					LOOPS[NUM_LOOPS].count = PCS[NUM_PCS].taken;
+					NUM_LOOPS++;
+				}
+			}
+			NUM_PCS++;
+		}
+	}
+	free(pages);
+
+	/* instructions executed inside each loop, from prefix sums over the sorted PCs */
+	prefix = profile_alloc(NUM_PCS + 1, sizeof(*prefix));
+	for (i = 0; i < NUM_PCS; i++) {
+		prefix[i + 1] = prefix[i] + PCS[i].count;
+	}
+	for (i = 0; i < NUM_LOOPS; i++) {
+		first = profile_lower_bound(LOOPS[i].begin);
+		last = profile_lower_bound(LOOPS[i].end + 4);
+		LOOPS[i].insts = prefix[last] - prefix[first];
+	}
+	free(prefix);
+	TOTAL += PROFILE_OTHER.count;
+}
+
+static double percent(uint64_t part)
+{
+	return TOTAL ? 100.0 * part / TOTAL : 0.0;
+}
+
+/***************************************************************/
+/* Opcode-class counts, from the collected PCs                                    */
+/***************************************************************/
+static void profile_mix(uint64_t *mix)
+{
+	uint32_t i;
+
+	memset(mix, 0, NUM_CLASSES * sizeof(*mix));
+	for (i = 0; i < NUM_PCS; i++) {
+		mix[profile_class(PCS[i].op, TRUE)] += PCS[i].taken;
+		mix[profile_class(PCS[i].op, FALSE)] += PCS[i].count - PCS[i].taken;
+	}
+	mix[CLASS_OTHER] += PROFILE_OTHER.count;
+}
+
+/***************************************************************/
+/* Print the hot spots, most executed first                                          */
+/***************************************************************/
+void profile_report()
+{
+	uint64_t mix[NUM_CLASSES];
+	profile_pc_t *hot;
+	uint32_t i;
+	int c;
+
+	profile_collect();
+	profile_mix(mix);
+
+	printf("Profile: %llu instructions, %u distinct PCs\n\n", (unsigned long long)TOTAL, NUM_PCS);
+	printf("Opcode mix:\n");
+	for (c = 0; c < NUM_CLASSES; c++) {
+		printf("  %-18s %12llu  %6.2f%%\n", CLASS_NAMES[c], (unsigned long long)mix[c], percent(mix[c]));
+	}
+
+	hot = profile_alloc(NUM_PCS, sizeof(*hot));
+	memcpy(hot, PCS, NUM_PCS * sizeof(*hot));
+	qsort(hot, NUM_PCS, sizeof(*hot), compare_pcs);
+	printf("\nHot instructions:\n");
+	for (i = 0; i < NUM_PCS && i < PROFILE_REPORT_TOP; i++) {
+		printf("  [0x%08x] %12llu  %6.2f%%  ", hot[i].pc, (unsigned long long)hot[i].count, percent(hot[i].count));
+		print_instruction(hot[i].pc);
+	}
+	free(hot);
+
+	qsort(BLOCKS, NUM_BLOCKS, sizeof(*BLOCKS), compare_ranges);
+	printf("\nHot basic blocks:\t\t\texecutions\tinstructions\n");
+	for (i = 0; i < NUM_BLOCKS && i < PROFILE_REPORT_TOP; i++) {
+		printf("  [0x%08x-0x%08x] %3u insts\t%llu\t\t%llu (%.2f%%)\n", BLOCKS[i].begin, BLOCKS[i].end,
+				(BLOCKS[i].end - BLOCKS[i].begin) / 4 + 1, (unsigned long long)BLOCKS[i].count,
+				(unsigned long long)BLOCKS[i].insts, percent(BLOCKS[i].insts));
+	}
+
+	qsort(LOOPS, NUM_LOOPS, sizeof(*LOOPS), compare_ranges);
+	printf("\nHot loops:\t\t\t\titerations\tinstructions\n");
+	for (i = 0; i < NUM_LOOPS && i < PROFILE_REPORT_TOP; i++) {
+		printf("  [0x%08x-0x%08x] %3u insts\t%llu\t\t%llu (%.2f%%)\n", LOOPS[i].begin, LOOPS[i].end,
+				(LOOPS[i].end - LOOPS[i].begin) / 4 + 1, (unsigned long long)LOOPS[i].count,
+				(unsigned long long)LOOPS[i].insts, percent(LOOPS[i].insts));
+	}
+	if (PROFILE_OTHER.count) {
+		printf("\n%llu instructions executed outside mapped, aligned memory\n",
+				(unsigned long long)PROFILE_OTHER.count);
+	}
+	printf("\n");
+}
+
+/***************************************************************/
+/* Write the profile as CSV (one row per PC) or as JSON (totals, mix, */
+/* PCs, blocks and loops)                                                                         */
+/***************************************************************/
+int profile_dump(const char *path, int json)
+{
+	uint64_t mix[NUM_CLASSES];
+	FILE *fp;
+	uint32_t i;
+	int c;
+
+	fp = fopen(path, "w");
+	if (fp == NULL) {
+		printf("Error: Can't open profile file %s\n", path);
+		return FALSE;
+	}
+	profile_collect();
+	profile_mix(mix);
+
+	if (!json) {
+		fprintf(fp, "pc,count,taken,instruction,op,class\n");
+		for (i = 0; i < NUM_PCS; i++) {
+			fprintf(fp, "0x%08x,%llu,%llu,0x%08x,%s,%s\n", PCS[i].pc, (unsigned long long)PCS[i].count,
+					(unsigned long long)PCS[i].taken, mem_peek(PCS[i].pc, 4), OP_NAMES[PCS[i].op],
+					CLASS_NAMES[profile_class(PCS[i].op, PCS[i].taken > 0)]);
+		}
+	} else {
+		qsort(BLOCKS, NUM_BLOCKS, sizeof(*BLOCKS), compare_ranges);
+		qsort(LOOPS, NUM_LOOPS, sizeof(*LOOPS), compare_ranges);
+		fprintf(fp, "{\n  \"instructions\": %llu,\n  \"mix\": {", (unsigned long long)TOTAL);
+		for (c = 0; c < NUM_CLASSES; c++) {
+			fprintf(fp, "%s\"%s\": %llu", c ? ", " : "", CLASS_NAMES[c], (unsigned long long)mix[c]);
+		}
+		fprintf(fp, "},\n  \"pcs\": [");
+		for (i = 0; i < NUM_PCS; i++) {
+			fprintf(fp, "%s\n    {\"pc\": %u, \"count\": %llu, \"taken\": %llu, \"op\": \"%s\"}", i ? "," : "",
+					PCS[i].pc, (unsigned long long)PCS[i].count, (unsigned long long)PCS[i].taken,
+					OP_NAMES[PCS[i].op]);
+		}
+		fprintf(fp, "\n  ],\n  \"blocks\": [");
+		for (i = 0; i < NUM_BLOCKS; i++) {
+			fprintf(fp, "%s\n    {\"begin\": %u, \"end\": %u, \"executions\": %llu, \"instructions\": %llu}",
+					i ? "," : "", BLOCKS[i].begin, BLOCKS[i].end, (unsigned long long)BLOCKS[i].count,
+					(unsigned long long)BLOCKS[i].insts);
+		}
+		fprintf(fp, "\n  ],\n  \"loops\": [");
+		for (i = 0; i < NUM_LOOPS; i++) {
+			fprintf(fp, "%s\n    {\"begin\": %u, \"end\": %u, \"iterations\": %llu, \"instructions\": %llu}",
+					i ? "," : "", LOOPS[i].begin, LOOPS[i].end, (unsigned long long)LOOPS[i].count,
+					(unsigned long long)LOOPS[i].insts);
+		}
+		fprintf(fp, "\n  ]\n}\n");
+	}
+
+	if (fclose(fp) != 0) {
+		printf("Error: Can't write profile file %s\n", path);
+		return FALSE;
+	}
+	printf("Profile written to %s (%u PCs).\n", path, NUM_PCS);
+	return TRUE;
+}
@@ -0,0 +1,43 @@
+#include <stdint.h>
+
+/***************************************************************/
+/* Execution profiler.                                                                                         */
+/* Counts every executed instruction per PC, in per-page arrays that  */
+/* sit next to the decoded instructions. The opcode mix, basic blocks */
+/* and loops are derived from those counts when the report is made.   */
+/***************************************************************/
+
+#define PROFILE_REPORT_TOP 20
+
+/* instruction classes of the opcode mix */
+enum {
+	CLASS_ALU, CLASS_MULDIV, CLASS_LOAD, CLASS_STORE,
+	CLASS_BRANCH_TAKEN, CLASS_BRANCH_NOT_TAKEN, CLASS_JUMP, CLASS_SYSCALL, CLASS_OTHER,
+	NUM_CLASSES
+};
+
+extern int PROFILE;                         /* count executed instructions */
+
+profile_count_t *profile_slow(uint32_t pc);
+void profile_reset();
+void profile_release();
+void profile_report();
+int profile_dump(const char *path, int json);
+
+/***************************************************************/
+/* Count the instruction at CURRENT_STATE.PC once it has executed,     */
+/* NEXT_STATE.PC tells whether it was taken                                        */
+/***************************************************************/
+static inline void profile_after(const decoded_inst_t *d)
+{
+	uint32_t pc = CURRENT_STATE.PC;
+	profile_count_t *c;
+
+	if ((pc >> MEM_PAGE_SHIFT) == FETCH_VPN && FETCH_PAGE->profile != NULL) {
+		c = &FETCH_PAGE->profile[(pc & MEM_PAGE_MASK) >> 2];
+	} else {
+		c = profile_slow(pc);
+	}
+	c->count++;
+	c->taken += NEXT_STATE.PC != pc + 4;
+}
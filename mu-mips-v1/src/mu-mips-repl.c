@@ -0,0 +1,596 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "mu-mips.h"
+#include "mu-mips-pipeline.h"
+#include "mu-mips-profile.h"
+#include "mu-mips-jit.h"
+#include "mu-mips-batch.h"
+#include "mu-mips-runner.h"
+#include "mu-mips-syscall.h"
+#include "mu-mips-debug.h"
+#include "mumips.h"
+
+/***************************************************************/
+/* The interactive simulator and the command line, a client of the   */
+/* library: one machine, driven from the REPL, batch mode or the job */
+/* runner.                                                                                                  */
+/***************************************************************/
+
+/***************************************************************/
+/* Print out a list of commands available                                                                  */
+/***************************************************************/
+void help() {        
+	printf("------------------------------------------------------------------\n\n");
+	printf("\t**********MU-MIPS Help MENU**********\n\n");
+	printf("sim\t-- simulate program to completion \n");
+	printf("run <n>\t-- simulate program for <n> instructions\n");
+	printf("rdump\t-- dump register values\n");
+	printf("reset\t-- clears all registers/memory and re-loads the program\n");
+	printf("input <reg> <val>\t-- set GPR <reg> to <val>\n");
+	printf("mdump <start> <stop>\t-- dump memory from <start> to <stop> address\n");
+	printf("high <val>\t-- set the HI register to <val>\n");
+	printf("low <val>\t-- set the LO register to <val>\n");
+	printf("print\t-- print the program loaded into memory\n");
+	printf("profile <on|off|reset>\t-- count executed instructions per PC and per opcode class\n");
+	printf("profile report\t-- print hot instructions, basic blocks, loops and the opcode mix\n");
+	printf("profile <csv|json> <path>\t-- write the profile to a file\n");
+	printf("trace <on|off>\t-- print every executed instruction (off runs at full speed)\n");
+	printf("trace file <path>\t-- record executed instructions to a binary trace file, see mu-mips-replay\n");
+	printf("trace close\t-- stop recording the binary trace\n");
+	printf("stats\t-- print the timing model's cycle and stall counters\n");
+	printf("snapshot save\t-- remember the machine state in memory (replaces the post-load state)\n");
+	printf("snapshot restore\t-- return to the remembered state, copying back only dirtied pages\n");
+	printf("snapshot write <path>\t-- save registers and memory to a snapshot file\n");
+	printf("snapshot read <path>\t-- replace registers and memory with a snapshot file\n");
+	printf("break <address> [if <reg> <op> <val>]\t-- stop before the instruction at <address>,\n");
+	printf("\t\t<op> is one of == != < <= > >= (signed), <reg> as in input or $a0\n");
+	printf("watch <read|write|access> <start> [<stop>] [if ...]\t-- stop after an access to the word\n");
+	printf("\t\tat <start>, or to any byte of <start>..<stop>\n");
+	printf("delete <id|all>\t-- delete a breakpoint or watchpoint\n");
+	printf("list\t-- list breakpoints and watchpoints with their hit counts\n");
+	printf("?\t-- display help menu\n");
+	printf("quit\t-- exit the simulator\n\n");
+	printf("------------------------------------------------------------------\n\n");
+}
+
+/***************************************************************/
+/* Simulate MIPS for n cycles                                                                                       */
+/***************************************************************/
+void run(int num_cycles) {                                      
+	
+	if (RUN_FLAG == FALSE) {
+		printf("Simulation Stopped\n\n");
+		return;
+	}
+
+	printf("Running simulator for %d cycles...\n\n", num_cycles);
+	if (run_engine(num_cycles) < (uint32_t)num_cycles) {
+		if (debug_stopped()) {
+			debug_report();
+			return;
+		}
+		printf("Simulation Stopped.\n\n");
+	}
+}
+
+/***************************************************************/
+/* simulate to completion                                                                                               */
+/***************************************************************/
+void runAll() {                                                     
+	struct timespec start, stop;
+	struct rusage usage;
+	uint64_t executed = INSTRUCTION_COUNT;
+	double seconds;
+
+	if (RUN_FLAG == FALSE) {
+		printf("Simulation Stopped.\n\n");
+		return;
+	}
+
+	printf("Simulation Started...\n\n");
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (RUN_FLAG){
+		run_engine(UINT32_MAX);
+		if (debug_stopped()) {
+			debug_report();
+			return;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	printf("Simulation Finished.\n\n");
+	if (SYS_PROC.exited) {
+		printf("Exit code\t: %d\n\n", SYS_PROC.exit_code);
+	}
+	if (!TRACE) {
+		/* host figures let the benchmark harness measure throughput */
+		executed = INSTRUCTION_COUNT - executed;
+		seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+		getrusage(RUSAGE_SELF, &usage);
+		printf("# Instructions Executed\t: %llu\n", (unsigned long long)INSTRUCTION_COUNT);
+		printf("PC\t: 0x%08x\n", CURRENT_STATE.PC);
+		printf("Host time\t: %.3f s (%.2f MIPS/s)\n", seconds,
+				seconds > 0 ? executed / seconds / 1e6 : 0.0);
+		printf("Peak RSS\t: %ld KB\n\n", usage.ru_maxrss);
+	}
+	timing_report();
+}
+
+/***************************************************************/ 
+/* Dump a word-aligned region of memory to the terminal                              */
+/***************************************************************/
+void mdump(uint32_t start, uint32_t stop) {          
+	uint32_t address;
+
+	printf("-------------------------------------------------------------\n");
+	printf("Memory content [0x%08x..0x%08x] :\n", start, stop);
+	printf("-------------------------------------------------------------\n");
+	printf("\t[Address in Hex (Dec) ]\t[Value]\n");
+	for (address = start; address <= stop; address += 4){
+		printf("\t0x%08x (%d) :\t0x%08x\n", address, address, mem_read_32(address));
+	}
+	printf("\n");
+}
+
+/***************************************************************/
+/* Dump current values of registers to the teminal                                              */   
+/***************************************************************/
+void rdump() {                               
+	int i; 
+	printf("-------------------------------------\n");
+	printf("Dumping Register Content\n");
+	printf("-------------------------------------\n");
+	printf("# Instructions Executed\t: %llu\n", (unsigned long long)INSTRUCTION_COUNT);
+	printf("PC\t: 0x%08x\n", CURRENT_STATE.PC);
+	printf("-------------------------------------\n");
+	printf("[Register]\t[Value]\n");
+	printf("-------------------------------------\n");
+	for (i = 0; i < MIPS_REGS; i++){
+		printf("[R%d]\t: 0x%08x\n", i, CURRENT_STATE.REGS[i]);
+	}
+	printf("-------------------------------------\n");
+	printf("[HI]\t: 0x%08x\n", CURRENT_STATE.HI);
+	printf("[LO]\t: 0x%08x\n", CURRENT_STATE.LO);
+	printf("-------------------------------------\n");
+}
+
+/***************************************************************/
+/* The program reads the console from where the REPL left off: drop  */
+/* the end of the command's line so its first read starts on a new one */
+/***************************************************************/
+static void end_of_command() {
+	int c;
+
+	while ((c = getchar()) == ' ' || c == '\t' || c == '\r') {
+	}
+	if (c != '\n' && c != EOF) {
+		ungetc(c, stdin);
+	}
+}
+
+/***************************************************************/
+/* break, watch and delete, their arguments are the rest of the line  */
+/***************************************************************/
+static void debug_command(char command) {
+	static const char *ops[] = { "", "==", "!=", "<", "<=", ">", ">=" };
+	debug_cond_t cond = { DEBUG_COND_NONE, 0, 0 };
+	char line[256], *arg[8];
+	uint32_t begin, end;
+	int n = 0, i, kind, id;
+
+	if (fgets(line, sizeof(line), stdin) == NULL) {
+		return;
+	}
+	for (arg[0] = strtok(line, " \t\r\n"); arg[n] != NULL && n < 7; arg[++n] = strtok(NULL, " \t\r\n")) {
+	}
+
+	if (command == 'd') {
+		if (n != 1) {
+			printf("Invalid Command.\n");
+		} else if (strcmp(arg[0], "all") == 0) {
+			debug_delete(0);
+		} else if (!debug_delete(atoi(arg[0]))) {
+			printf("Error: No breakpoint or watchpoint %s\n\n", arg[0]);
+		}
+		return;
+	}
+
+	/* the condition is the last four words */
+	for (i = 0; i < n && strcmp(arg[i], "if") != 0; i++) {
+	}
+	if (i < n) {
+		if (i + 4 != n || !batch_reg(arg[i + 1], &cond.reg)) {
+			printf("Invalid Command.\n");
+			return;
+		}
+		for (cond.op = DEBUG_EQ; cond.op <= DEBUG_GE && strcmp(arg[i + 2], ops[cond.op]) != 0; cond.op++) {
+		}
+		if (cond.op > DEBUG_GE) {
+			printf("Invalid Command.\n");
+			return;
+		}
+		cond.value = (uint32_t)strtoll(arg[i + 3], NULL, 0);
+	}
+
+	if (command == 'b') {
+		if (i != 1) {
+			printf("Invalid Command.\n");
+			return;
+		}
+		begin = strtoul(arg[0], NULL, 16);
+		if ((id = debug_add(DEBUG_BREAK, begin, begin, &cond)) != 0) {
+			printf("Breakpoint %d at 0x%08x\n\n", id, begin);
+		}
+		return;
+	}
+	kind = i < 2 ? -1 : strcmp(arg[0], "read") == 0 ? DEBUG_READ : strcmp(arg[0], "write") == 0 ? DEBUG_WRITE :
+			strcmp(arg[0], "access") == 0 ? DEBUG_ACCESS : -1;
+	if (kind < 0 || i > 3) {
+		printf("Invalid Command.\n");
+		return;
+	}
+	begin = strtoul(arg[1], NULL, 16);
+	end = i == 3 ? strtoul(arg[2], NULL, 16) : begin + 3;
+	if ((id = debug_add(kind, begin, end, &cond)) != 0) {
+		printf("Watchpoint %d on 0x%08x..0x%08x\n\n", id, begin, end);
+	}
+}
+
+/***************************************************************/
+/* Read a command from standard input.                                                               */  
+/***************************************************************/
+void handle_command() {                         
+	char buffer[20];
+	uint32_t start, stop, cycles;
+	uint32_t register_no;
+	int register_value;
+	int hi_reg_value, lo_reg_value;
+	char arg[256];
+
+	printf("MU-MIPS SIM:> ");
+
+	if (scanf("%s", buffer) == EOF){
+		trace_sink_close();
+		exit(0);
+	}
+
+	switch(buffer[0]) {
+		case 'S':
+		case 's':
+			if (buffer[1] == 't' || buffer[1] == 'T') {
+				if (!timing_report()) {
+					printf("No timing model, start with -m pipeline, -m sampled or -m ooo.\n");
+				}
+				break;
+			}
+			if (buffer[1] == 'n' || buffer[1] == 'N') {
+				if (scanf("%255s", arg) != 1) {
+					break;
+				}
+				if (strcmp(arg, "save") == 0) {
+					snapshot_save(SNAPSHOT_USER);
+				} else if (strcmp(arg, "restore") == 0) {
+					snapshot_restore();
+				} else if (strcmp(arg, "write") == 0 && scanf("%255s", arg) == 1) {
+					snapshot_write(arg);
+				} else if (strcmp(arg, "read") == 0 && scanf("%255s", arg) == 1) {
+					snapshot_read(arg);
+				} else {
+					printf("Invalid Command.\n");
+				}
+				break;
+			}
+			end_of_command();
+			runAll(); 
+			break;
+		case 'M':
+		case 'm':
+			if (scanf("%x %x", &start, &stop) != 2){
+				break;
+			}
+			mdump(start, stop);
+			break;
+		case '?':
+			help();
+			break;
+		case 'Q':
+		case 'q':
+			trace_sink_close();
+			printf("**************************\n");
+			printf("Exiting MU-MIPS! Good Bye...\n");
+			printf("**************************\n");
+			exit(0);
+		case 'R':
+		case 'r':
+			if (buffer[1] == 'd' || buffer[1] == 'D'){
+				rdump();
+			}else if(buffer[1] == 'e' || buffer[1] == 'E'){
+				reset();
+			}
+			else {
+				if (scanf("%d", &cycles) != 1) {
+					break;
+				}
+				end_of_command();
+				run(cycles);
+			}
+			break;
+		case 'I':
+		case 'i':
+			if (scanf("%u %i", &register_no, &register_value) != 2){
+				break;
+			}
+			if (register_no >= MIPS_REGS || mumips_write_reg(MACHINE, register_no, register_value) != 0) {
+				printf("Error: No register %u\n\n", register_no);
+			}
+			break;
+		case 'H':
+		case 'h':
+			if (scanf("%i", &hi_reg_value) != 1){
+				break;
+			}
+			mumips_write_reg(MACHINE, MUMIPS_HI, hi_reg_value);
+			break;
+		case 'L':
+		case 'l':
+			if (buffer[1] == 'i' || buffer[1] == 'I') {
+				debug_list();
+				break;
+			}
+			if (scanf("%i", &lo_reg_value) != 1){
+				break;
+			}
+			mumips_write_reg(MACHINE, MUMIPS_LO, lo_reg_value);
+			break;
+		case 'P':
+		case 'p':
+			if (buffer[1] == 'r' && buffer[2] == 'o') {
+				if (scanf("%255s", arg) != 1) {
+					break;
+				}
+				if (strcmp(arg, "on") == 0) {
+					PROFILE = TRUE;
+				} else if (strcmp(arg, "off") == 0) {
+					PROFILE = FALSE;
+				} else if (strcmp(arg, "reset") == 0) {
+					profile_reset();
+				} else if (strcmp(arg, "report") == 0) {
+					profile_report();
+				} else if (strcmp(arg, "csv") == 0 && scanf("%255s", arg) == 1) {
+					profile_dump(arg, FALSE);
+				} else if (strcmp(arg, "json") == 0 && scanf("%255s", arg) == 1) {
+					profile_dump(arg, TRUE);
+				} else {
+					printf("Invalid Command.\n");
+				}
+				break;
+			}
+			print_program(); 
+			break;
+		case 'T':
+		case 't':
+			if (scanf("%255s", arg) != 1) {
+				break;
+			}
+			if (strcmp(arg, "on") == 0) {
+				TRACE = TRUE;
+			} else if (strcmp(arg, "off") == 0) {
+				TRACE = FALSE;
+			} else if (strcmp(arg, "close") == 0) {
+				trace_sink_close();
+			} else if (strcmp(arg, "file") == 0 && scanf("%255s", arg) == 1) {
+				trace_sink_open(arg);
+			} else {
+				printf("Invalid Command.\n");
+			}
+			break;
+		case 'B':
+		case 'b':
+			debug_command('b');
+			break;
+		case 'W':
+		case 'w':
+			debug_command('w');
+			break;
+		case 'D':
+		case 'd':
+			debug_command('d');
+			break;
+		default:
+			printf("Invalid Command.\n");
+			break;
+	}
+}
+
+/***************************************************************/
+/* Print command-line usage and exit                                                              */
+/***************************************************************/
+static void usage(const char *prog) {
+	printf("Error: You should provide input file.\nUsage: %s [-c <cores>] [-e switch|table|threaded|jit] [-f auto|hex|bin|binle|elf] [-m functional|pipeline|sampled|ooo] [-o <option>] [-p] [-q] [-t <trace file>] [-V]\n", prog);
+	printf("       [-b] [-n <limit>] [-s <location>=<value>] [-a <location>=<value>] [-O text|json|none] <input program> \n");
+	printf("       %s [-M <manifest>] [-j <threads>] ...\n\n", prog);
+	printf("  -c <cores> \tguest cores sharing memory, each on a host thread, default 1\n");
+	printf("             \t(same as -o cores=<n>, see -o for the multicore options)\n");
+	printf("  -e <engine>\texecution engine: switch (reference), table (handler table),\n");
+	printf("             \tthreaded (computed goto) or jit (x86-64 translation), default switch\n");
+	printf("  -f <format>\tprogram format: hex words (one per line), raw big- or little-endian\n");
+	printf("             \tbinary, or a MIPS32 ELF executable, default auto-detect\n");
+	printf("  -m <model> \ttiming model: functional (instruction counts only), pipeline\n");
+	printf("             \t(five-stage, cycle counts), sampled (pipeline on sampled windows,\n");
+	printf("             \tfunctional in between, estimated CPI) or ooo (out-of-order\n");
+	printf("             \tsuperscalar, cycle counts), default functional\n");
+	printf("  -o <k=v>   \ttiming model option, e.g. forwarding=off, l1d.size=8k or bpred=gshare\n");
+	printf("  -p         \tprofile from the start, see the profile command\n");
+	printf("  -q         \tquiet: no per-instruction trace, only the final summary\n");
+	printf("  -t <file>  \trecord executed instructions with their register and memory effects\n");
+	printf("             \tto a binary trace, mu-mips-replay reads it back\n");
+	printf("  -V         \trun the program on the interpreter and the JIT, compare and exit\n\n");
+	printf("Batch mode (-b, or any of -n -s -a -O) runs without the REPL and exits with\n");
+	printf("0 when the program halts and every assertion holds, 2 when an assertion fails,\n");
+	printf("3 when the run limit is reached first, 1 when the program can't be loaded:\n");
+	printf("  -n <limit> \tstop after <limit> instructions (cycles with -m pipeline or ooo)\n");
+	printf("  -s <loc>=<v>\tinitial value, <loc> is a register (4, r4, $a0, a0), hi, lo, pc\n");
+	printf("             \tor a memory word mem:<address>\n");
+	printf("  -a <loc>=<v>\tassert the final value, <loc> may also be count (instructions)\n");
+	printf("  -O <format>\tresult format: text (default), json or none (exit status only)\n\n");
+	printf("Job runner, batch mode over many programs:\n");
+	printf("  -M <file>  \tmanifest, one job per line: <program> [-n <limit>] [-s ...] [-a ...]\n");
+	printf("             \tadded to the -n, -s and -a given on the command line\n");
+	printf("  -j <n>     \tworker threads, one simulated machine each, default one per CPU\n\n");
+	exit(1);
+}
+
+/***************************************************************/
+/* Pass a -e, -f or -m value on as a library option                         */
+/***************************************************************/
+static void option(const char *key, const char *value) {
+	char opt[64];
+
+	snprintf(opt, sizeof(opt), "%s=%s", key, value);
+	if (mumips_option(opt) != 0) {
+		printf("\n");
+		exit(1);
+	}
+}
+
+/***************************************************************/
+/* main                                                                                                                                   */
+/***************************************************************/
+int main(int argc, char *argv[]) {                              
+	int opt, verify = FALSE, threads = 0;
+	const char *manifest = NULL;
+
+	/* -t records from this machine, the timing model is set up again once the options are read */
+	if (machine_create() == NULL) {
+		exit(1);
+	}
+	TRACE = TRUE;
+	while ((opt = getopt(argc, argv, "a:bc:e:f:j:m:M:n:o:O:pqs:t:V")) != -1) {
+		switch (opt) {
+			case 'a':
+				if (!batch_assert(&BATCH_JOB, optarg)) {
+					exit(1);
+				}
+				BATCH = TRUE;
+				break;
+			case 'b':
+				BATCH = TRUE;
+				break;
+			case 'c':
+				option("cores", optarg);
+				break;
+			case 'e':
+				option("engine", optarg);
+				break;
+			case 'f':
+				option("format", optarg);
+				break;
+			case 'j':
+				threads = atoi(optarg);
+				break;
+			case 'M':
+				manifest = optarg;
+				BATCH = TRUE;
+				break;
+			case 'm':
+				option("model", optarg);
+				break;
+			case 'n':
+				if (!batch_limit(&BATCH_JOB, optarg)) {
+					exit(1);
+				}
+				BATCH = TRUE;
+				break;
+			case 'o':
+				if (!timing_option(optarg)) {
+					exit(1);
+				}
+				break;
+			case 'O':
+				if (!batch_output(optarg)) {
+					exit(1);
+				}
+				BATCH = TRUE;
+				break;
+			case 'p':
+				PROFILE = TRUE;
+				break;
+			case 'q':
+				TRACE = FALSE;
+				break;
+			case 's':
+				if (!batch_set(&BATCH_JOB, optarg)) {
+					exit(1);
+				}
+				BATCH = TRUE;
+				break;
+			case 'V':
+				verify = TRUE;
+				break;
+			case 't':
+				if (!trace_sink_open(optarg)) {
+					exit(1);
+				}
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+
+	if (manifest != NULL) {
+		if (TRACE_FILE != NULL || PROFILE || verify) {
+			printf("Error: -t, -p and -V work on a single program, not with -M\n\n");
+			exit(1);
+		}
+		TRACE = FALSE;
+		exit(runner_run(manifest, threads));
+	}
+	if (optind >= argc) {
+		usage(argv[0]);
+	}
+	VERBOSE = !BATCH;
+	if (BATCH) {
+		TRACE = FALSE;
+	} else {
+		printf("\n**************************\n");
+		printf("Welcome to MU-MIPS SIM...\n");
+		printf("**************************\n\n");
+	}
+	if (!timing_init()) {
+		exit(1);
+	}
+
+	if (!machine_load(argv[optind])) {
+		printf("\n");
+		exit(1);
+	}
+	if (verify) {
+		exit(jit_verify() ? 0 : 1);
+	}
+	if (BATCH) {
+		BATCH_JOB.program = prog_file;
+		batch_run(&BATCH_JOB);
+		trace_sink_close();
+		if (BATCH_OUTPUT != BATCH_OUTPUT_NONE) {
+			batch_print(&BATCH_JOB);
+		}
+		if (BATCH_OUTPUT == BATCH_OUTPUT_TEXT && (TIMING != TIMING_FUNCTIONAL || MACHINE->smp != NULL)) {
+			printf("\n");
+			timing_report();
+		}
+		if (BATCH_OUTPUT == BATCH_OUTPUT_TEXT && PROFILE) {
+			profile_report();
+		}
+		exit(BATCH_JOB.status);
+	}
+	help();
+	while (1){
+		handle_command();
+	}
+	return 0;
+}
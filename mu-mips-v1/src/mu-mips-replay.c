@@ -0,0 +1,465 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "mu-mips.h"
+#include "mu-mips-pipeline.h"
+#include "mu-mips-cache.h"
+#include "mu-mips-bpred.h"
+#include "mu-mips-dram.h"
+#include "mu-mips-trace.h"
+
+/***************************************************************/
+/* Trace replay. Rebuilds the machine state record by record from a */
+/* binary trace (see mu-mips-trace.h) without executing anything, and */
+/* can send the recorded fetches, loads, stores and control flow      */
+/* through the cache and branch predictor models, so one recorded   */
+/* run can be measured under any number of configurations.             */
+/***************************************************************/
+
+static FILE *TRACE_IN;
+static uint64_t TRACE_BYTES;
+static const char *PROGRAM;                /* replaces the path recorded in the trace */
+
+/* reader state, mirrors the writer's */
+static uint32_t LAST_PC, LAST_ADDR;
+static uint32_t WORDS[TRACE_WORD_CACHE][2];
+
+/* what was asked for */
+static int DUMP, MODELS;
+static uint64_t STOP = UINT64_MAX;
+static uint32_t DUMP_BEGIN, DUMP_END;
+
+/* summary */
+static uint64_t INSTRUCTIONS, LOADS, STORES, CONTROL, TAKEN, RELOADS, POKES;
+static uint64_t LOAD_MISMATCHES, WORD_MISMATCHES;
+
+static int get_byte()
+{
+	int c = getc_unlocked(TRACE_IN);
+
+	TRACE_BYTES += c != EOF;
+	return c;
+}
+
+static int get_varint64(uint64_t *value)
+{
+	int c, shift = 0;
+
+	*value = 0;
+	do {
+		if ((c = get_byte()) == EOF || shift > 63) {
+			return FALSE;
+		}
+		*value |= (uint64_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+	return TRUE;
+}
+
+static int get_varint(uint32_t *value)
+{
+	int c, shift = 0;
+
+	*value = 0;
+	do {
+		if ((c = get_byte()) == EOF || shift > 28) {
+			return FALSE;
+		}
+		*value |= (uint32_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+	return TRUE;
+}
+
+static int get_delta(uint32_t *value)
+{
+	if (!get_varint(value)) {
+		return FALSE;
+	}
+	*value = trace_undelta(*value);
+	return TRUE;
+}
+
+static int get32(uint32_t *value)
+{
+	uint8_t b[4];
+
+	if (fread(b, 1, 4, TRACE_IN) != 4) {
+		return FALSE;
+	}
+	TRACE_BYTES += 4;
+	*value = b[0] | b[1] << 8 | b[2] << 16 | (uint32_t)b[3] << 24;
+	return TRUE;
+}
+
+static int is_control(uint8_t op)
+{
+	return op == OP_J || op == OP_JAL || op == OP_JR || op == OP_JALR ||
+			op == OP_BEQ || op == OP_BNE || op == OP_BLEZ || op == OP_BGTZ ||
+			op == OP_BLTZ || op == OP_BGEZ;
+}
+
+/***************************************************************/
+/* Memory is the program image after count instructions: load it and */
+/* run the functional model that far                                                */
+/***************************************************************/
+static int replay_reload()
+{
+	static int warned;
+	char path[PROG_FILE_SIZE];
+	uint64_t count, left;
+	uint32_t len, n;
+
+	if (!get_varint64(&count) || !get_varint(&len) || len >= PROG_FILE_SIZE ||
+			fread(path, 1, len, TRACE_IN) != len) {
+		return FALSE;
+	}
+	TRACE_BYTES += len;
+	path[len] = '\0';
+	RELOADS++;
+
+	if (PROGRAM != NULL) {
+		strcpy(path, PROGRAM);
+	}
+	if (path[0] == '\0' || !machine_load(path)) {
+		if (!warned && path[0] != '\0') {
+			printf("Warning: memory starts empty, only what the trace records is known\n");
+			warned = TRUE;
+		}
+		free_memory();
+		return TRUE;
+	}
+	while (RUN_FLAG && INSTRUCTION_COUNT < count) {
+		left = count - INSTRUCTION_COUNT;
+		n = run_engine(left > UINT32_MAX ? UINT32_MAX : (uint32_t)left);
+		if (n == 0) {
+			break;
+		}
+	}
+	return TRUE;
+}
+
+static int replay_regs()
+{
+	uint32_t count_low, count_high;
+	int i;
+
+	if (!get32(&count_low) || !get32(&count_high) || !get32(&CURRENT_STATE.PC)) {
+		return FALSE;
+	}
+	for (i = 0; i < MIPS_REGS; i++) {
+		if (!get32(&CURRENT_STATE.REGS[i])) {
+			return FALSE;
+		}
+	}
+	if (!get32(&CURRENT_STATE.HI) || !get32(&CURRENT_STATE.LO)) {
+		return FALSE;
+	}
+	NEXT_STATE = CURRENT_STATE;
+	INSTRUCTION_COUNT = (uint64_t)count_high << 32 | count_low;
+	LAST_PC = CURRENT_STATE.PC - 4;
+	return TRUE;
+}
+
+static int replay_poke()
+{
+	uint32_t address, value;
+
+	if (!get32(&address) || !get32(&value)) {
+		return FALSE;
+	}
+	mem_write_32(address, value);
+	POKES++;
+	return TRUE;
+}
+
+/***************************************************************/
+/* Print the registers and the requested memory words                         */
+/***************************************************************/
+static void replay_state()
+{
+	uint32_t address;
+	int i;
+
+	printf("State after %llu traced instructions (instruction count %llu)\n",
+			(unsigned long long)INSTRUCTIONS, (unsigned long long)INSTRUCTION_COUNT);
+	printf("PC\t: 0x%08x\tHI\t: 0x%08x\tLO\t: 0x%08x\n", CURRENT_STATE.PC, CURRENT_STATE.HI, CURRENT_STATE.LO);
+	for (i = 0; i < MIPS_REGS; i++) {
+		printf("[R%d]\t: 0x%08x%s", i, CURRENT_STATE.REGS[i], i % 4 == 3 ? "\n" : "\t");
+	}
+	if (DUMP_END > DUMP_BEGIN) {
+		printf("\n");
+		for (address = DUMP_BEGIN & ~3u; address < DUMP_END; address += 4) {
+			printf("\t0x%08x :\t0x%08x\n", address, mem_read_32(address));
+		}
+	}
+	printf("\n");
+}
+
+/***************************************************************/
+/* Read the trace to its end or to the requested instruction             */
+/***************************************************************/
+static int replay()
+{
+	decoded_inst_t d;
+	uint32_t pc, word, *slot, delta, hi, lo, addr = 0, value = 0, memory;
+	uint32_t pending_pc = 0, predicted = 0;
+	uint8_t pending_op = 0, pending_rs = 0, reg;
+	int flags, size, pending = FALSE;
+
+	while (INSTRUCTIONS < STOP && (flags = get_byte()) != EOF) {
+		if (flags & 0x80) {
+			/* the state jumped, the control instruction before has no successor */
+			pending = FALSE;
+			if ((flags == TRACE_RELOAD && !replay_reload()) || (flags == TRACE_REGS && !replay_regs()) ||
+					(flags == TRACE_POKE && !replay_poke()) || flags > TRACE_POKE) {
+				return FALSE;
+			}
+			continue;
+		}
+
+		pc = LAST_PC + 4;
+		if (flags & TRACE_JUMP) {
+			if (!get_delta(&delta)) {
+				return FALSE;
+			}
+			pc += delta;
+		}
+		LAST_PC = pc;
+		slot = WORDS[(pc >> 2) & (TRACE_WORD_CACHE - 1)];
+		if (flags & TRACE_WORD) {
+			if (!get32(&word)) {
+				return FALSE;
+			}
+			slot[0] = pc;
+			slot[1] = word;
+		}
+		word = slot[1];
+		if (mem_read_32(pc) != word) {
+			/* the program did run this word, so memory held it */
+			WORD_MISMATCHES++;
+			mem_write_32(pc, word);
+		}
+		decode_instruction(pc, word, &d);
+
+		/* this is the successor of the last control instruction */
+		if (pending) {
+			TAKEN += pc != pending_pc + 4;
+			if (MODELS) {
+				bpred_update(pending_pc, pending_op, pending_rs, pc, predicted);
+			}
+			pending = FALSE;
+		}
+		if (MODELS) {
+			/* a cycle per instruction plus the memory stalls, for the DRAM model's clock */
+			DRAM.now += 1 + cache_access(&L1I, pc, FALSE);
+		}
+		if (is_control(d.op)) {
+			CONTROL++;
+			if (MODELS) {
+				predicted = bpred_predict(pc, d.op, d.rs);
+			}
+			pending_pc = pc;
+			pending_op = d.op;
+			pending_rs = d.rs;
+			pending = TRUE;
+		}
+		CURRENT_STATE.PC = pc;
+
+		if (DUMP) {
+			printf("%llu\t[0x%08x]\t%08x\t", (unsigned long long)INSTRUCTIONS, pc, word);
+		}
+		if (flags & TRACE_REG) {
+			if ((reg = get_byte()) >= MIPS_REGS || !get_delta(&delta)) {
+				return FALSE;
+			}
+			CURRENT_STATE.REGS[reg] += delta;
+			if (DUMP) {
+				printf("r%u=0x%x ", reg, CURRENT_STATE.REGS[reg]);
+			}
+		}
+		if (flags & TRACE_HILO) {
+			if (!get_delta(&hi) || !get_delta(&lo)) {
+				return FALSE;
+			}
+			CURRENT_STATE.HI += hi;
+			CURRENT_STATE.LO += lo;
+			if (DUMP) {
+				printf("hi=0x%x lo=0x%x ", CURRENT_STATE.HI, CURRENT_STATE.LO);
+			}
+		}
+		size = trace_mem_size(d.op);
+		if (flags & TRACE_MEM) {
+			if (size == 0 || !get_delta(&delta) || !get_varint(&value)) {
+				return FALSE;
+			}
+			addr = LAST_ADDR += delta;
+			if (d.op >= OP_SB) {
+				STORES++;
+				if (size == 1) {
+					mem_write_8(addr, value);
+				} else if (size == 2) {
+					mem_write_16(addr, value);
+				} else {
+					mem_write_32(addr, value);
+				}
+			} else {
+				LOADS++;
+				memory = size == 1 ? mem_read_8(addr) : size == 2 ? mem_read_16(addr) : mem_read_32(addr);
+				LOAD_MISMATCHES += memory != value;
+			}
+			if (MODELS) {
+				DRAM.now += cache_access(&L1D, addr, d.op >= OP_SB);
+			}
+			if (DUMP) {
+				printf("%s[0x%08x]=0x%x ", d.op >= OP_SB ? "store" : "load", addr, value);
+			}
+		}
+		if (flags & TRACE_ARGS) {
+			if (!get_delta(&delta) || !get_delta(&value)) {
+				return FALSE;
+			}
+			CURRENT_STATE.REGS[4] += delta;
+			CURRENT_STATE.REGS[5] += value;
+			if (DUMP) {
+				printf("r4=0x%x r5=0x%x ", CURRENT_STATE.REGS[4], CURRENT_STATE.REGS[5]);
+			}
+		}
+		if (!pending) {
+			CURRENT_STATE.PC = pc + 4;
+		}
+		NEXT_STATE = CURRENT_STATE;
+		INSTRUCTION_COUNT++;
+		INSTRUCTIONS++;
+		if (DUMP) {
+			printf("\t");
+			print_instruction(pc);
+		}
+	}
+	/* stopped after a control instruction: the next record knows where it went */
+	if (pending && INSTRUCTIONS == STOP && (flags = get_byte()) != EOF && !(flags & 0x80)) {
+		CURRENT_STATE.PC = LAST_PC + 4;
+		if ((flags & TRACE_JUMP) && get_delta(&delta)) {
+			CURRENT_STATE.PC += delta;
+		}
+	} else if (pending) {
+		/* the trace ends on it, execute it again to find out */
+		CURRENT_STATE.PC = pending_pc;
+		NEXT_STATE = CURRENT_STATE;
+		execute_instruction();
+		INSTRUCTION_COUNT--;
+	}
+	return TRUE;
+}
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [-d] [-s <n>] [-x <start>:<end>] [-o <option>]... [-P <program>] <trace>\n\n", prog);
+	printf("  -d         \tlist every instruction with its register and memory effects\n");
+	printf("  -s <n>     \tstop after n instructions and print the registers then\n");
+	printf("  -x <a>:<b> \twith -s, also print the memory words from a up to b\n");
+	printf("  -o <k=v>   \tsend the trace through the caches, DRAM and branch predictor, with\n");
+	printf("             \tthe same options as mu-mips -o, e.g. l1d.size=8k, dram=on or bpred=gshare\n");
+	printf("  -P <file>  \tprogram image to start from instead of the one the trace names\n\n");
+	exit(1);
+}
+
+/***************************************************************/
+/* main                                                                                                                                   */
+/***************************************************************/
+int main(int argc, char *argv[])
+{
+	char magic[4], *end;
+	uint32_t version;
+	int opt, ok;
+
+	while ((opt = getopt(argc, argv, "do:P:s:x:")) != -1) {
+		switch (opt) {
+			case 'd':
+				DUMP = TRUE;
+				break;
+			case 'o':
+				if (!timing_option(optarg)) {
+					exit(1);
+				}
+				MODELS = TRUE;
+				break;
+			case 'P':
+				PROGRAM = optarg;
+				break;
+			case 's':
+				STOP = strtoull(optarg, NULL, 0);
+				break;
+			case 'x':
+				DUMP_BEGIN = strtoul(optarg, &end, 0);
+				if (*end != ':') {
+					usage(argv[0]);
+				}
+				DUMP_END = strtoul(end + 1, NULL, 0);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind >= argc) {
+		usage(argv[0]);
+	}
+
+	TRACE_IN = fopen(argv[optind], "rb");
+	if (TRACE_IN == NULL) {
+		printf("Error: Can't open trace file %s\n", argv[optind]);
+		exit(1);
+	}
+	if (fread(magic, 1, 4, TRACE_IN) != 4 || memcmp(magic, TRACE_MAGIC, 4) != 0 || !get32(&version)) {
+		printf("Error: %s is not a trace file\n", argv[optind]);
+		exit(1);
+	}
+	if (version != TRACE_VERSION) {
+		printf("Error: %s is a version %u trace, this replays version %u\n", argv[optind], version, TRACE_VERSION);
+		exit(1);
+	}
+	TRACE_BYTES += 4;
+
+	/* the functional model only runs to rebuild memory, the timing models are fed by hand */
+	if (machine_create() == NULL) {
+		exit(1);
+	}
+	TIMING = TIMING_FUNCTIONAL;
+	if (!timing_init()) {
+		exit(1);
+	}
+	ok = replay();
+	fclose(TRACE_IN);
+	if (!ok) {
+		printf("Warning: %s ends in a truncated or malformed record\n", argv[optind]);
+	}
+	if (DUMP) {
+		printf("\n");
+	}
+
+	if (STOP != UINT64_MAX) {
+		replay_state();
+	}
+	printf("Trace\t\t: %s, %llu bytes, %.2f per instruction\n", argv[optind], (unsigned long long)TRACE_BYTES,
+			INSTRUCTIONS ? (double)TRACE_BYTES / INSTRUCTIONS : 0.0);
+	printf("# Instructions\t: %llu (%llu loads, %llu stores, %llu control, %llu taken)\n",
+			(unsigned long long)INSTRUCTIONS, (unsigned long long)LOADS, (unsigned long long)STORES,
+			(unsigned long long)CONTROL, (unsigned long long)TAKEN);
+	printf("State changes\t: %llu reloads, %llu memory writes\n", (unsigned long long)RELOADS,
+			(unsigned long long)POKES);
+	if (LOAD_MISMATCHES || WORD_MISMATCHES) {
+		printf("Memory differs\t: %llu loads and %llu instruction words did not match the rebuilt memory\n",
+				(unsigned long long)LOAD_MISMATCHES, (unsigned long long)WORD_MISMATCHES);
+	}
+	if (MODELS) {
+		printf("\n");
+		bpred_report();
+		cache_report(&L1I);
+		cache_report(&L1D);
+		dram_report();
+	}
+	exit(ok ? 0 : 1);
+}
@@ -0,0 +1,275 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "mu-mips.h"
+#include "mu-mips-batch.h"
+#include "mu-mips-runner.h"
+
+/***************************************************************/
+/* Job runner. A manifest line is a program followed by its own -n, -s */
+/* and -a options, which add to the ones given on the command line.    */
+/* Each worker creates its own machine, with the timing model options */
+/* of the command line, and loads and runs one job after another in    */
+/* it. Results are printed in manifest order once all are done.          */
+/***************************************************************/
+
+static batch_job_t *JOBS;
+static int NUM_JOBS;
+static runner_worker_t *WORKERS;
+static int NUM_WORKERS;
+
+/***************************************************************/
+/* Parse one manifest line into a new job, FALSE on a malformed line   */
+/***************************************************************/
+static int runner_parse(char *line, int lineno)
+{
+	batch_job_t *job;
+	char *tok, *arg;
+	int ok = TRUE;
+
+	line[strcspn(line, "#\r\n")] = '\0';
+	tok = strtok(line, " \t");
+	if (tok == NULL) {
+		return TRUE;
+	}
+	if (strlen(tok) >= PROG_FILE_SIZE || access(tok, R_OK) != 0) {
+		printf("Error: Manifest line %d: can't read program %s\n", lineno, tok);
+		return FALSE;
+	}
+
+	JOBS = realloc(JOBS, (NUM_JOBS + 1) * sizeof(*JOBS));
+	if (JOBS == NULL) {
+		printf("Error: Can't allocate manifest jobs\n");
+		exit(-1);
+	}
+	job = &JOBS[NUM_JOBS++];
+	*job = BATCH_JOB;
+	job->program = strdup(tok);
+
+	while (ok && (tok = strtok(NULL, " \t")) != NULL) {
+		arg = strtok(NULL, " \t");
+		if (arg == NULL || tok[0] != '-' || tok[1] == '\0' || tok[2] != '\0') {
+			ok = FALSE;
+		} else if (tok[1] == 'n') {
+			ok = batch_limit(job, arg);
+		} else if (tok[1] == 's') {
+			ok = batch_set(job, strdup(arg));
+		} else if (tok[1] == 'a') {
+			ok = batch_assert(job, strdup(arg));
+		} else {
+			ok = FALSE;
+		}
+	}
+	if (!ok) {
+		printf("Error: Manifest line %d: expected <program> [-n <limit>] [-s <loc>=<v>] [-a <loc>=<v>]...\n",
+				lineno);
+	}
+	return ok;
+}
+
+static int runner_load(const char *manifest)
+{
+	char line[RUNNER_LINE_SIZE];
+	FILE *fp;
+	int lineno = 0, ok = TRUE;
+
+	fp = fopen(manifest, "r");
+	if (fp == NULL) {
+		printf("Error: Can't open manifest %s\n", manifest);
+		return FALSE;
+	}
+	while (ok && fgets(line, sizeof(line), fp) != NULL) {
+		ok = runner_parse(line, ++lineno);
+	}
+	fclose(fp);
+	return ok;
+}
+
+/***************************************************************/
+/* Next job for worker w: its own newest, else the oldest of another  */
+/***************************************************************/
+static int runner_next(int w)
+{
+	runner_worker_t *self = &WORKERS[w], *victim;
+	int i, job = -1;
+
+	pthread_mutex_lock(&self->lock);
+	if (self->tail > self->head) {
+		job = self->queue[--self->tail];
+	}
+	pthread_mutex_unlock(&self->lock);
+
+	for (i = 1; job < 0 && i < NUM_WORKERS; i++) {
+		victim = &WORKERS[(w + i) % NUM_WORKERS];
+		pthread_mutex_lock(&victim->lock);
+		if (victim->tail > victim->head) {
+			job = victim->queue[victim->head++];
+			self->stolen++;
+		}
+		pthread_mutex_unlock(&victim->lock);
+	}
+	return job;
+}
+
+/***************************************************************/
+/* Load a job into this thread's machine and run it                             */
+/***************************************************************/
+static void runner_job(batch_job_t *job)
+{
+	if (!machine_load(job->program)) {
+		job->status = BATCH_LOAD_ERROR;
+		return;
+	}
+	batch_run(job);
+}
+
+static void *runner_worker(void *arg)
+{
+	runner_worker_t *self = arg;
+	machine_t *m = machine_create();
+	int job;
+
+	while ((job = runner_next(self - WORKERS)) >= 0) {
+		if (m == NULL) {
+			/* no machine to run it on */
+			JOBS[job].status = BATCH_LOAD_ERROR;
+			continue;
+		}
+		runner_job(&JOBS[job]);
+		self->jobs++;
+		self->instructions += JOBS[job].instructions;
+		self->busy += JOBS[job].seconds;
+	}
+	if (m != NULL) {
+		machine_destroy(m);
+	}
+	return NULL;
+}
+
+/***************************************************************/
+/* Per-job results, worker statistics and totals                                 */
+/***************************************************************/
+static void runner_report(double wall)
+{
+	static const char *status[] = { "halted", "error", "failed", "limit" };
+	uint32_t counts[4] = { 0 };
+	uint64_t total = 0;
+	int i, k;
+
+	for (i = 0; i < NUM_JOBS; i++) {
+		counts[JOBS[i].status]++;
+		total += JOBS[i].instructions;
+	}
+
+	if (BATCH_OUTPUT == BATCH_OUTPUT_JSON) {
+		printf("{\n\"jobs\": [\n");
+		for (i = 0; i < NUM_JOBS; i++) {
+			batch_print(&JOBS[i]);
+			printf("%s", i + 1 < NUM_JOBS ? ",\n" : "");
+		}
+		printf("],\n\"workers\": [");
+		for (i = 0; i < NUM_WORKERS; i++) {
+			printf("%s\n  {\"jobs\": %u, \"stolen\": %u, \"instructions\": %llu, \"busy\": %.6f}", i ? "," : "",
+					WORKERS[i].jobs, WORKERS[i].stolen, (unsigned long long)WORKERS[i].instructions,
+					WORKERS[i].busy);
+		}
+		printf("\n],\n\"summary\": {\"jobs\": %d, \"passed\": %u, \"failed\": %u, \"limit\": %u, \"errors\": %u, "
+				"\"instructions\": %llu, \"seconds\": %.6f}\n}\n", NUM_JOBS, counts[BATCH_PASSED],
+				counts[BATCH_FAILED], counts[BATCH_LIMIT_REACHED], counts[BATCH_LOAD_ERROR],
+				(unsigned long long)total, wall);
+		return;
+	}
+
+	printf("Job\tStatus\tInstructions\tSeconds\tMIPS/s\tProgram\n");
+	for (i = 0; i < NUM_JOBS; i++) {
+		printf("%d\t%s\t%llu\t%.3f\t%.2f\t%s\n", i + 1, status[JOBS[i].status],
+				(unsigned long long)JOBS[i].instructions,
+				JOBS[i].seconds, JOBS[i].seconds > 0 ? JOBS[i].instructions / JOBS[i].seconds / 1e6 : 0.0,
+				JOBS[i].program);
+		for (k = 0; k < JOBS[i].num_asserts; k++) {
+			if (JOBS[i].actual[k] != JOBS[i].asserts[k].value) {
+				printf("\tFAIL %s (actual 0x%08llx)\n", JOBS[i].asserts[k].text,
+						(unsigned long long)JOBS[i].actual[k]);
+			}
+		}
+	}
+	printf("\nWorker\tJobs\tStolen\tInstructions\tBusy(s)\n");
+	for (i = 0; i < NUM_WORKERS; i++) {
+		printf("%d\t%u\t%u\t%llu\t%.3f\n", i, WORKERS[i].jobs, WORKERS[i].stolen,
+				(unsigned long long)WORKERS[i].instructions, WORKERS[i].busy);
+	}
+	printf("\nJobs\t\t: %d (%u halted, %u failed, %u limit reached, %u load errors)\n", NUM_JOBS,
+			counts[BATCH_PASSED], counts[BATCH_FAILED], counts[BATCH_LIMIT_REACHED], counts[BATCH_LOAD_ERROR]);
+	printf("# Instructions Executed\t: %llu\n", (unsigned long long)total);
+	printf("Wall time\t: %.3f s (%.2f MIPS/s on %d threads)\n", wall,
+			wall > 0 ? total / wall / 1e6 : 0.0, NUM_WORKERS);
+}
+
+/***************************************************************/
+/* Run every job of the manifest on threads workers (0 = one per CPU)  */
+/* and return the exit status: a load error, else the worst job status */
+/***************************************************************/
+int runner_run(const char *manifest, int threads)
+{
+	struct timespec start, stop;
+	int i, status = BATCH_PASSED;
+
+	if (!runner_load(manifest)) {
+		return 1;
+	}
+	if (threads <= 0) {
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	NUM_WORKERS = threads < NUM_JOBS ? threads : NUM_JOBS;
+	if (NUM_WORKERS < 1) {
+		NUM_WORKERS = 1;
+	}
+
+	WORKERS = calloc(NUM_WORKERS, sizeof(*WORKERS));
+	if (WORKERS == NULL) {
+		printf("Error: Can't allocate %d workers\n", NUM_WORKERS);
+		exit(-1);
+	}
+	for (i = 0; i < NUM_WORKERS; i++) {
+		pthread_mutex_init(&WORKERS[i].lock, NULL);
+		WORKERS[i].queue = malloc((NUM_JOBS / NUM_WORKERS + 1) * sizeof(int));
+		if (WORKERS[i].queue == NULL) {
+			printf("Error: Can't allocate the job queues\n");
+			exit(-1);
+		}
+	}
+	/* round-robin, each worker starts with the first of its share */
+	for (i = NUM_JOBS - 1; i >= 0; i--) {
+		WORKERS[i % NUM_WORKERS].queue[WORKERS[i % NUM_WORKERS].tail++] = i;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < NUM_WORKERS; i++) {
+		if (pthread_create(&WORKERS[i].thread, NULL, runner_worker, &WORKERS[i]) != 0) {
+			printf("Error: Can't start worker %d\n", i);
+			exit(-1);
+		}
+	}
+	for (i = 0; i < NUM_WORKERS; i++) {
+		pthread_join(WORKERS[i].thread, NULL);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	if (BATCH_OUTPUT != BATCH_OUTPUT_NONE) {
+		runner_report((stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9);
+	}
+	for (i = 0; i < NUM_JOBS; i++) {
+		if (JOBS[i].status == BATCH_LOAD_ERROR) {
+			status = BATCH_LOAD_ERROR;
+		} else if (status != BATCH_LOAD_ERROR && (JOBS[i].status == BATCH_FAILED ||
+				(JOBS[i].status == BATCH_LIMIT_REACHED && status == BATCH_PASSED))) {
+			status = JOBS[i].status;
+		}
+	}
+	return status;
+}
@@ -0,0 +1,24 @@
+#include <stdint.h>
+#include <pthread.h>
+
+/***************************************************************/
+/* Parallel job runner.                                                                                    */
+/* Runs the batch jobs of a manifest on a pool of threads, one machine */
+/* per thread. Jobs are dealt round-robin to per-worker queues; a worker */
+/* whose queue is empty steals from the front of the others.                */
+/***************************************************************/
+
+#define RUNNER_LINE_SIZE 4096
+
+typedef struct {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	int *queue;                            /* job indices */
+	int head, tail;                        /* owner pops at the tail, thieves take at the head */
+	/* statistics */
+	uint32_t jobs, stolen;
+	uint64_t instructions;
+	double busy;                           /* seconds spent running jobs */
+} runner_worker_t;
+
+int runner_run(const char *manifest, int threads);
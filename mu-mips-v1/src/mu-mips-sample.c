@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "mu-mips.h"
+#include "mu-mips-pipeline.h"
+#include "mu-mips-cache.h"
+#include "mu-mips-bpred.h"
+#include "mu-mips-dram.h"
+#include "mu-mips-sample.h"
+
+/***************************************************************/
+/* Sampling driver. A machine walks through the phases of a period   */
+/* whatever the sizes of the run_engine calls: a call too short for a */
+/* whole detailed window keeps warming and the window waits for the */
+/* next call. Windows cut short by the end of the program are not      */
+/* counted, they would bias the estimate towards the program's tail. */
+/***************************************************************/
+
+enum { SAMPLE_FAST, SAMPLE_WARM, SAMPLE_DETAIL };
+
+/* instructions the pipeline can hold executed but not retired */
+#define SAMPLE_IN_FLIGHT 5
+
+sample_config_t SAMPLE_CONFIG = { 0, 1000000, 50000, 2000, 1000, 95 };
+
+/* a machine's place in the period and its measurements */
+struct sample_struct {
+	int phase;
+	uint64_t left;                         /* instructions left in the phase */
+	uint64_t fast, warmed, detailed;
+	uint64_t samples;
+	double sum, sum2;                      /* of the windows' CPI */
+};
+
+#define SAMPLE (*MACHINE->sample)
+
+static int parse_count(const char *s, uint64_t *value)
+{
+	char *end;
+
+	*value = strtoull(s, &end, 0);
+	if (*end == 'k' || *end == 'K') {
+		*value *= 1000;
+		end++;
+	} else if (*end == 'm' || *end == 'M') {
+		*value *= 1000000;
+		end++;
+	}
+	return end != s && *end == '\0';
+}
+
+/***************************************************************/
+/* Parse a sampling option, FALSE if it is not one                                */
+/***************************************************************/
+int sample_option(const char *opt)
+{
+	static const char *keys[] = { "sample.skip=", "sample.period=", "sample.warm=", "sample.detail=",
+			"sample.window=", "sample.confidence=" };
+	uint64_t value;
+	int i;
+
+	for (i = 0; i < 6; i++) {
+		if (strncmp(opt, keys[i], strlen(keys[i])) == 0) {
+			break;
+		}
+	}
+	if (i == 6) {
+		return FALSE;
+	}
+	if (!parse_count(opt + strlen(keys[i]), &value) || (i > 0 && value > UINT32_MAX)) {
+		return FALSE;
+	}
+	switch (i) {
+		case 0:
+			SAMPLE_CONFIG.skip = value;
+			break;
+		case 1:
+			SAMPLE_CONFIG.period = value;
+			break;
+		case 2:
+			SAMPLE_CONFIG.warm = value;
+			break;
+		case 3:
+			SAMPLE_CONFIG.detail = value;
+			break;
+		case 4:
+			SAMPLE_CONFIG.window = value;
+			return value > 0;
+		default:
+			SAMPLE_CONFIG.confidence = value;
+			return value == 90 || value == 95 || value == 99;
+	}
+	return TRUE;
+}
+
+/* fast-forwarded instructions of every period */
+static uint64_t sample_fast_length()
+{
+	uint64_t busy = (uint64_t)SAMPLE_CONFIG.warm + SAMPLE_CONFIG.detail + SAMPLE_CONFIG.window;
+
+	return SAMPLE_CONFIG.period > busy ? SAMPLE_CONFIG.period - busy : 0;
+}
+
+int sample_init()
+{
+	if (MACHINE->sample == NULL) {
+		MACHINE->sample = malloc(sizeof(struct sample_struct));
+		if (MACHINE->sample == NULL) {
+			printf("Error: Can't allocate the sampler\n");
+			return FALSE;
+		}
+	}
+	sample_reset();
+	return TRUE;
+}
+
+/***************************************************************/
+/* Start over from the first period and drop the measurements          */
+/***************************************************************/
+void sample_reset()
+{
+	if (MACHINE->sample == NULL) {
+		return;
+	}
+	memset(MACHINE->sample, 0, sizeof(struct sample_struct));
+	SAMPLE.phase = SAMPLE_FAST;
+	SAMPLE.left = SAMPLE_CONFIG.skip + sample_fast_length();
+}
+
+void sample_release()
+{
+	free(MACHINE->sample);
+	MACHINE->sample = NULL;
+}
+
+/***************************************************************/
+/* Execute one instruction, training the caches and predictor the     */
+/* way the pipeline model would. DRAM time moves as for a core that  */
+/* takes a cycle per instruction plus its memory stalls.                   */
+/***************************************************************/
+static void sample_warm_step()
+{
+	decoded_inst_t *d = fetch_decoded(CURRENT_STATE.PC), e;
+	uint32_t pc = CURRENT_STATE.PC, predicted = pc + 4;
+	uint8_t op, rs;
+	int control;
+
+	if (d->op == OP_BREAKPOINT) {
+		/* warm with the instruction under the breakpoint */
+		decode_instruction(pc, d->word, &e);
+		d = &e;
+	}
+	op = d->op;
+	rs = d->rs;
+	control = pipe_control(op);
+
+	DRAM.now += 1 + cache_access(&L1I, pc, FALSE);
+	if (op >= OP_LB && op <= OP_SC) {
+		DRAM.now += cache_access(&L1D, CURRENT_STATE.REGS[rs] + d->imm, op >= OP_SB);
+	}
+	if (control) {
+		predicted = bpred_predict(pc, op, rs);
+	}
+	execute_instruction();
+	if (control) {
+		bpred_update(pc, op, rs, CURRENT_STATE.PC, predicted);
+	}
+}
+
+/***************************************************************/
+/* Run up to max instructions, returns how many ran before the program */
+/* stopped                                                                                                        */
+/***************************************************************/
+uint32_t sample_run(uint32_t max)
+{
+	uint32_t done = 0, n, measured;
+	uint64_t start;
+	uint64_t cycles;
+	double cpi;
+
+	while (done < max && RUN_FLAG) {
+		switch (SAMPLE.phase) {
+			case SAMPLE_FAST:
+				n = SAMPLE.left < max - done ? SAMPLE.left : max - done;
+				n = run_functional(n);
+				SAMPLE.fast += n;
+				SAMPLE.left -= n;
+				done += n;
+				if (SAMPLE.left == 0) {
+					SAMPLE.phase = SAMPLE_WARM;
+					SAMPLE.left = SAMPLE_CONFIG.warm;
+				}
+				break;
+			case SAMPLE_WARM:
+				for (; SAMPLE.left > 0 && done < max && RUN_FLAG; SAMPLE.left--, done++) {
+					sample_warm_step();
+					SAMPLE.warmed++;
+				}
+				if (SAMPLE.left == 0) {
+					SAMPLE.phase = SAMPLE_DETAIL;
+				}
+				break;
+			default:
+				if (max - done < SAMPLE_CONFIG.detail + SAMPLE_CONFIG.window + SAMPLE_IN_FLIGHT) {
+					sample_warm_step();
+					SAMPLE.warmed++;
+					done++;
+					break;
+				}
+				start = INSTRUCTION_COUNT;
+				cycles = pipe_window(SAMPLE_CONFIG.detail, SAMPLE_CONFIG.window, &measured);
+				SAMPLE.detailed += INSTRUCTION_COUNT - start;
+				done += INSTRUCTION_COUNT - start;
+				if (measured == SAMPLE_CONFIG.window) {
+					cpi = (double)cycles / measured;
+					SAMPLE.samples++;
+					SAMPLE.sum += cpi;
+					SAMPLE.sum2 += cpi * cpi;
+				}
+				SAMPLE.phase = SAMPLE_FAST;
+				SAMPLE.left = sample_fast_length();
+				break;
+		}
+	}
+	return done;
+}
+
+static double sample_mean()
+{
+	return SAMPLE.samples ? SAMPLE.sum / SAMPLE.samples : 0.0;
+}
+
+/* normal quantile of the confidence level */
+static double sample_z()
+{
+	return SAMPLE_CONFIG.confidence == 90 ? 1.645 : SAMPLE_CONFIG.confidence == 99 ? 2.576 : 1.960;
+}
+
+/***************************************************************/
+/* Half width of the confidence interval of the mean CPI                   */
+/***************************************************************/
+static double sample_error(double *cv)
+{
+	double mean = sample_mean(), var;
+
+	*cv = 0.0;
+	if (SAMPLE.samples < 2) {
+		return 0.0;
+	}
+	var = (SAMPLE.sum2 - SAMPLE.samples * mean * mean) / (SAMPLE.samples - 1);
+	if (var < 0.0) {
+		var = 0.0;
+	}
+	*cv = mean > 0.0 ? sqrt(var) / mean : 0.0;
+	return sample_z() * sqrt(var / SAMPLE.samples);
+}
+
+/***************************************************************/
+/* Cycles the whole run would have taken on the pipeline model            */
+/***************************************************************/
+uint64_t sample_cycles()
+{
+	return (uint64_t)(sample_mean() * INSTRUCTION_COUNT + 0.5);
+}
+
+/***************************************************************/
+/* Print the estimate and how the instructions were simulated           */
+/***************************************************************/
+void sample_report()
+{
+	double mean = sample_mean(), cv, error = sample_error(&cv), z = sample_z();
+
+	printf("Sampling\t\t: every %u instructions, %u warmed, %u detailed, %u measured\n",
+			SAMPLE_CONFIG.period, SAMPLE_CONFIG.warm, SAMPLE_CONFIG.detail, SAMPLE_CONFIG.window);
+	printf("# Instructions\t\t: %llu (%llu fast-forwarded, %llu warmed, %llu detailed)\n",
+			(unsigned long long)INSTRUCTION_COUNT,
+			(unsigned long long)SAMPLE.fast, (unsigned long long)SAMPLE.warmed,
+			(unsigned long long)SAMPLE.detailed);
+	if (SAMPLE.samples == 0) {
+		printf("No window measured yet, fewer instructions ran than one period\n\n");
+		return;
+	}
+	printf("# Windows\t\t: %llu\n", (unsigned long long)SAMPLE.samples);
+	printf("CPI\t\t\t: %.4f +/- %.4f (%u%% confidence, +/- %.2f%%)\n", mean, error,
+			SAMPLE_CONFIG.confidence, mean > 0.0 ? 100.0 * error / mean : 0.0);
+	printf("# Cycles (estimated)\t: %llu +/- %llu\n", (unsigned long long)sample_cycles(),
+			(unsigned long long)(error * INSTRUCTION_COUNT + 0.5));
+	if (SAMPLE.samples < 30) {
+		printf("  fewer than 30 windows, the interval is only approximate\n");
+	}
+	if (cv > 0.0) {
+		/* windows for a +/-2% interval at the same confidence */
+		printf("  coefficient of variation %.3f, %.0f windows give +/- 2%%\n", cv, ceil(z * z * cv * cv / 0.0004));
+	}
+	printf("\n");
+	bpred_report();
+	cache_report(&L1I);
+	cache_report(&L1D);
+	dram_report();
+	if (L1I.lines != NULL || L1D.lines != NULL || DRAM.enabled) {
+		printf("\n");
+	}
+}
@@ -0,0 +1,30 @@
+#include <stdint.h>
+
+/***************************************************************/
+/* Sampled timing (SMARTS-style systematic sampling).                      */
+/* Every period instructions the program is fast-forwarded on the    */
+/* functional engine, then warmed: instructions still execute one at */
+/* a time but only train the caches and branch predictor. A detailed */
+/* window follows on the pipeline model, whose first instructions   */
+/* refill the pipeline and whose rest are measured. The CPI of the    */
+/* windows estimates the program's, with a confidence interval.       */
+/***************************************************************/
+
+typedef struct {
+	uint64_t skip;                         /* fast-forwarded before the first period */
+	uint32_t period;                       /* instructions from one window to the next */
+	uint32_t warm;                         /* functional warming before each window */
+	uint32_t detail;                       /* detailed warming, not measured */
+	uint32_t window;                       /* measured instructions */
+	uint32_t confidence;                   /* percent: 90, 95 or 99 */
+} sample_config_t;
+
+extern sample_config_t SAMPLE_CONFIG;
+
+int sample_option(const char *opt);
+int sample_init();
+void sample_reset();
+void sample_release();
+uint32_t sample_run(uint32_t max);
+uint64_t sample_cycles();
+void sample_report();
@@ -0,0 +1,465 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "mu-mips.h"
+#include "mu-mips-pipeline.h"
+#include "mu-mips-cache.h"
+#include "mu-mips-profile.h"
+#include "mu-mips-smp.h"
+#include "mu-mips-syscall.h"
+
+/***************************************************************/
+/* Multicore machine. Host threads are started for each run and      */
+/* meet at a barrier after every quantum; core 0's thread is the        */
+/* caller's and decides the length of the next quantum. Within a      */
+/* quantum the cores interleave as the host schedules them, so runs */
+/* with shared data are not repeatable. Directory entries are read   */
+/* without their lock on read hits; everything else about an entry  */
+/* changes under its lock.                                                                           */
+/***************************************************************/
+
+smp_t SMP_CONFIG = { 1, 10000, 10, 64 * 1024 };
+
+static int parse_uint(const char *s, uint32_t *value)
+{
+	char *end;
+
+	*value = strtoul(s, &end, 0);
+	if (*end == 'k' || *end == 'K') {
+		*value *= 1024;
+		end++;
+	}
+	return end != s && *end == '\0' && *value > 0;
+}
+
+/***************************************************************/
+/* Parse a multicore option, FALSE if it is not one                               */
+/***************************************************************/
+int smp_option(const char *opt)
+{
+	if (strncmp(opt, "cores=", 6) == 0) {
+		return parse_uint(opt + 6, &SMP_CONFIG.cores);
+	} else if (strncmp(opt, "smp.quantum=", 12) == 0) {
+		return parse_uint(opt + 12, &SMP_CONFIG.quantum);
+	} else if (strncmp(opt, "smp.latency=", 12) == 0) {
+		return parse_uint(opt + 12, &SMP_CONFIG.latency);
+	} else if (strncmp(opt, "smp.dir=", 8) == 0) {
+		return parse_uint(opt + 8, &SMP_CONFIG.dir_size);
+	}
+	return FALSE;
+}
+
+/***************************************************************/
+/* Turn the current machine into core 0 of a multicore machine and  */
+/* give it the other cores. FALSE if the options are invalid or the   */
+/* cores can't be allocated, the machine is left single core               */
+/***************************************************************/
+static int smp_create()
+{
+	machine_t *m0 = MACHINE, *m;
+	smp_t *smp;
+	uint32_t k;
+
+	if (SMP_CONFIG.cores > SMP_MAX_CORES) {
+		printf("Error: At most %u cores\n", SMP_MAX_CORES);
+		return FALSE;
+	}
+	if (SMP_CONFIG.dir_size & (SMP_CONFIG.dir_size - 1)) {
+		printf("Error: The coherence directory size (%u) must be a power of two\n", SMP_CONFIG.dir_size);
+		return FALSE;
+	}
+	if (ENGINE == ENGINE_JIT) {
+		printf("Error: The JIT engine runs a single core, use -e switch, table or threaded\n");
+		return FALSE;
+	}
+	smp = calloc(1, sizeof(smp_t));
+	if (smp == NULL) {
+		printf("Error: Can't allocate the multicore machine\n");
+		return FALSE;
+	}
+	memcpy(smp, &SMP_CONFIG, offsetof(smp_t, core));
+	smp->core = calloc(smp->cores, sizeof(machine_t *));
+	smp->dir = malloc(smp->dir_size * sizeof(smp_dir_entry_t));
+	smp->stats = aligned_alloc(64, smp->cores * sizeof(smp_stats_t));
+	if (smp->core == NULL || smp->dir == NULL || smp->stats == NULL) {
+		printf("Error: Can't allocate the multicore machine\n");
+		free(smp->core);
+		free(smp->dir);
+		free(smp->stats);
+		free(smp);
+		return FALSE;
+	}
+	pthread_mutex_init(&smp->mem_lock, NULL);
+	for (k = 0; k < SMP_LOCKS; k++) {
+		pthread_mutex_init(&smp->lock[k], NULL);
+	}
+	pthread_barrier_init(&smp->barrier, NULL, smp->cores);
+
+	smp->core[0] = m0;
+	m0->smp = smp;
+	m0->core = 0;
+	m0->mem->lock = &smp->mem_lock;
+	for (k = 1; k < smp->cores; k++) {
+		m = calloc(1, sizeof(machine_t));
+		if (m == NULL) {
+			printf("Error: Can't allocate a machine\n");
+			/* smp_release() frees the cores made so far */
+			MACHINE = m0;
+			smp->cores = k;
+			smp_release();
+			return FALSE;
+		}
+		m->mem = m0->mem;
+		m->proc = m0->proc;
+		m->smp = smp;
+		m->core = k;
+		smp->core[k] = m;
+		MACHINE = m;
+		if (!timing_init()) {
+			MACHINE = m0;
+			smp->cores = k + 1;
+			smp_release();
+			return FALSE;
+		}
+	}
+	MACHINE = m0;
+	return TRUE;
+}
+
+/***************************************************************/
+/* Start every core from core 0's state, with empty caches and a      */
+/* clear directory. Called once a program is loaded or reset. FALSE    */
+/* if the cores can't be made                                                                    */
+/***************************************************************/
+int smp_start()
+{
+	machine_t *m0 = MACHINE, *m;
+	smp_t *smp;
+	uint32_t k;
+
+	if (SMP_CONFIG.cores <= 1 && m0->smp == NULL) {
+		return TRUE;
+	}
+	if (m0->smp == NULL && !smp_create()) {
+		return FALSE;
+	}
+	smp = m0->smp;
+	for (k = 0; k < smp->dir_size; k++) {
+		smp->dir[k].tag = 0;
+		smp->dir[k].owner = -1;
+		smp->dir[k].modified = FALSE;
+	}
+	memset(smp->stats, 0, smp->cores * sizeof(smp_stats_t));
+	for (k = 1; k < smp->cores; k++) {
+		m = smp->core[k];
+		MACHINE = m;
+		m->current = m0->current;
+		m->instruction_count = 0;
+		m->run_flag = TRUE;
+		m->ll_valid = FALSE;
+		mem_tlb_flush();
+		FETCH_VPN = MEM_TLB_INVALID;
+		FETCH_PAGE = NULL;
+		pipe_reset();
+	}
+	MACHINE = m0;
+	for (k = 0; k < smp->cores; k++) {
+		m = smp->core[k];
+		m->current.REGS[26] = k;
+		m->current.REGS[27] = smp->cores;
+		m->next = m->current;
+	}
+	return TRUE;
+}
+
+/***************************************************************/
+/* Free the other cores, back to a single core                                    */
+/***************************************************************/
+void smp_release()
+{
+	machine_t *m0 = MACHINE;
+	smp_t *smp = m0->smp;
+	uint32_t k;
+
+	if (smp == NULL || m0->core != 0) {
+		return;
+	}
+	for (k = 1; k < smp->cores; k++) {
+		MACHINE = smp->core[k];
+		syscall_flush();
+		timing_release();
+		free(smp->core[k]);
+	}
+	MACHINE = m0;
+	m0->mem->lock = NULL;
+	m0->smp = NULL;
+	pthread_mutex_destroy(&smp->mem_lock);
+	for (k = 0; k < SMP_LOCKS; k++) {
+		pthread_mutex_destroy(&smp->lock[k]);
+	}
+	pthread_barrier_destroy(&smp->barrier);
+	free(smp->core);
+	free(smp->dir);
+	free(smp->stats);
+	free(smp);
+}
+
+/***************************************************************/
+/* Drop the other cores' translations after core 0 changed the pages */
+/***************************************************************/
+void smp_tlb_flush()
+{
+	machine_t *m0 = MACHINE;
+	smp_t *smp = m0->smp;
+	uint32_t k;
+
+	for (k = 1; k < smp->cores; k++) {
+		if (smp->core[k] == NULL) {
+			/* still being created */
+			continue;
+		}
+		MACHINE = smp->core[k];
+		mem_tlb_flush();
+		FETCH_VPN = MEM_TLB_INVALID;
+		FETCH_PAGE = NULL;
+	}
+	MACHINE = m0;
+}
+
+/***************************************************************/
+/* One core's side of a run: quanta until core 0 has run max or halted. */
+/* Returns how many the core ran                                                                */
+/***************************************************************/
+static uint32_t smp_loop(smp_t *smp, uint32_t k, uint32_t max)
+{
+	uint32_t done = 0;
+
+	MACHINE = smp->core[k];
+	for (;;) {
+		if (k == 0) {
+			smp->chunk = !RUN_FLAG ? 0 : max - done < smp->quantum ? max - done : smp->quantum;
+		}
+		pthread_barrier_wait(&smp->barrier);
+		if (smp->chunk == 0) {
+			break;
+		}
+		/* a halted core idles until the machine stops */
+		if (RUN_FLAG) {
+			done += run_core(smp->chunk);
+		}
+		pthread_barrier_wait(&smp->barrier);
+	}
+	return done;
+}
+
+static void *smp_thread(void *arg)
+{
+	machine_t *m = arg;
+
+	/* only core 0 looks at max */
+	smp_loop(m->smp, m->core, 0);
+	return NULL;
+}
+
+/***************************************************************/
+/* Run every core, up to max on core 0 (instructions, or cycles under */
+/* the cycle-level models). Returns how many core 0 ran                      */
+/***************************************************************/
+uint32_t smp_run(uint32_t max)
+{
+	smp_t *smp = MACHINE->smp;
+	pthread_t threads[SMP_MAX_CORES];
+	uint32_t k, n;
+
+	if (max == 0 || !RUN_FLAG) {
+		return 0;
+	}
+	/* both keep per-machine records of shared pages */
+	if (PROFILE) {
+		printf("Profiling is not available with several cores, turned off\n");
+		PROFILE = FALSE;
+	}
+	if (TRACE_FILE != NULL) {
+		printf("Binary traces are not available with several cores, closed\n");
+		trace_sink_close();
+	}
+	for (k = 1; k < smp->cores; k++) {
+		if (pthread_create(&threads[k], NULL, smp_thread, smp->core[k]) != 0) {
+			printf("Error: Can't start the thread of core %u\n", k);
+			exit(-1);
+		}
+	}
+	n = smp_loop(smp, 0, max);
+	for (k = 1; k < smp->cores; k++) {
+		pthread_join(threads[k], NULL);
+	}
+	MACHINE = smp->core[0];
+	return n;
+}
+
+/***************************************************************/
+/* Coherence action for an L1D access to block. held tells whether   */
+/* the directory still lists this core's copy, supplied whether the  */
+/* line comes from another core's cache. Returns the cycles spent on */
+/* the other cores: an upgrade, invalidations or a transfer                */
+/***************************************************************/
+uint32_t smp_coherence(uint32_t block, int write, int *held, int *supplied)
+{
+	smp_t *smp = MACHINE->smp;
+	int core = MACHINE->core;
+	uint32_t me = 1u << core, sharers, others, latency = 0;
+	smp_dir_entry_t *e = &smp->dir[block & (smp->dir_size - 1)];
+	pthread_mutex_t *lock = &smp->lock[block & (SMP_LOCKS - 1)];
+	smp_stats_t *stats = &smp->stats[core];
+	uint64_t tag;
+
+	*supplied = FALSE;
+	if (!write) {
+		/* any valid copy can be read */
+		tag = __atomic_load_n(&e->tag, __ATOMIC_ACQUIRE);
+		if ((uint32_t)(tag >> 32) == block && ((uint32_t)tag & me)) {
+			*held = TRUE;
+			return 0;
+		}
+	}
+
+	pthread_mutex_lock(lock);
+	tag = e->tag;
+	sharers = (uint32_t)tag;
+	if (sharers != 0 && (uint32_t)(tag >> 32) != block) {
+		/* the entry tracks another line, which has to leave every cache */
+		stats->recalls++;
+		sharers = 0;
+		e->owner = -1;
+		e->modified = FALSE;
+	}
+	*held = (sharers & me) != 0;
+	others = sharers & ~me;
+	if (e->owner >= 0 && e->owner != core && e->modified) {
+		/* the only up-to-date copy is in the owner's cache */
+		stats->transfers++;
+		*supplied = TRUE;
+		latency = smp->latency;
+	}
+	if (write) {
+		if (*held && e->owner != core) {
+			stats->upgrades++;
+			latency = smp->latency;
+		}
+		if (others != 0) {
+			stats->invalidations += __builtin_popcount(others);
+			latency = smp->latency;
+		}
+		sharers = me;
+		e->owner = core;
+		e->modified = TRUE;
+	} else {
+		if (e->owner >= 0 && e->owner != core) {
+			stats->downgrades++;
+			e->owner = -1;
+			e->modified = FALSE;
+		}
+		if (sharers == 0) {
+			/* nobody else has it: exclusive */
+			e->owner = core;
+			e->modified = FALSE;
+		}
+		sharers |= me;
+	}
+	__atomic_store_n(&e->tag, (uint64_t)block << 32 | sharers, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(lock);
+	return latency;
+}
+
+/***************************************************************/
+/* This core's L1D evicts block. TRUE if it held the line modified,    */
+/* so that it has to be written back                                                         */
+/***************************************************************/
+int smp_evict(uint32_t block)
+{
+	smp_t *smp = MACHINE->smp;
+	int core = MACHINE->core, modified = FALSE;
+	uint32_t me = 1u << core, sharers;
+	smp_dir_entry_t *e = &smp->dir[block & (smp->dir_size - 1)];
+	pthread_mutex_t *lock = &smp->lock[block & (SMP_LOCKS - 1)];
+
+	pthread_mutex_lock(lock);
+	sharers = (uint32_t)e->tag;
+	if ((uint32_t)(e->tag >> 32) == block && (sharers & me)) {
+		if (e->owner == core) {
+			modified = e->modified;
+			e->owner = -1;
+			e->modified = FALSE;
+		}
+		sharers &= ~me;
+		__atomic_store_n(&e->tag, sharers ? (uint64_t)block << 32 | sharers : 0, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(lock);
+	return modified;
+}
+
+/***************************************************************/
+/* Count a store conditional                                                                      */
+/***************************************************************/
+void smp_sc(int success)
+{
+	if (MACHINE->smp == NULL) {
+		return;
+	}
+	if (success) {
+		SMP.stats[MACHINE->core].sc_success++;
+	} else {
+		SMP.stats[MACHINE->core].sc_failure++;
+	}
+}
+
+/***************************************************************/
+/* Print each core's progress and coherence counters, and the totals */
+/***************************************************************/
+void smp_report()
+{
+	machine_t *m0 = MACHINE;
+	smp_t *smp = m0->smp;
+	smp_stats_t total, *s;
+	uint64_t cycles, misses;
+	uint32_t k;
+
+	memset(&total, 0, sizeof(total));
+	printf("%u cores, quantum %u, cache-to-cache latency %u cycles, %u directory entries\n",
+			smp->cores, smp->quantum, smp->latency, smp->dir_size);
+	printf("  core  instructions        cycles  L1D misses  coh. misses  invalidations  upgrades  downgrades"
+			"  transfers  SC ok/failed\n");
+	for (k = 0; k < smp->cores; k++) {
+		MACHINE = smp->core[k];
+		s = &smp->stats[k];
+		cycles = timing_cycles();
+		misses = MACHINE->l1d->read_misses + MACHINE->l1d->write_misses;
+		printf("  %4u  %12llu  %12llu  %10llu  %11llu  %13llu  %8llu  %10llu  %9llu  %llu/%llu%s\n", k,
+				(unsigned long long)INSTRUCTION_COUNT, (unsigned long long)cycles, (unsigned long long)misses,
+				(unsigned long long)MACHINE->l1d->coherence_misses,
+				(unsigned long long)s->invalidations, (unsigned long long)s->upgrades,
+				(unsigned long long)s->downgrades, (unsigned long long)s->transfers,
+				(unsigned long long)s->sc_success, (unsigned long long)s->sc_failure,
+				RUN_FLAG ? "" : " halted");
+		total.invalidations += s->invalidations;
+		total.upgrades += s->upgrades;
+		total.downgrades += s->downgrades;
+		total.transfers += s->transfers;
+		total.recalls += s->recalls;
+		total.sc_success += s->sc_success;
+		total.sc_failure += s->sc_failure;
+	}
+	MACHINE = m0;
+	printf("  coherence messages %llu, %llu bytes between caches, %llu directory recalls\n",
+			(unsigned long long)(total.invalidations + total.upgrades + total.downgrades + total.transfers),
+			(unsigned long long)total.transfers * L1D.line_size, (unsigned long long)total.recalls);
+	printf("  store conditionals %llu, %llu failed\n\n",
+			(unsigned long long)(total.sc_success + total.sc_failure), (unsigned long long)total.sc_failure);
+	if (TIMING != TIMING_FUNCTIONAL) {
+		printf("Core 0:\n");
+	}
+}
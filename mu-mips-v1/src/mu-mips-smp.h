@@ -0,0 +1,70 @@
+#include <stdint.h>
+#include <pthread.h>
+
+/***************************************************************/
+/* Multicore machines.                                                                                  */
+/* With cores=<n> a machine is n cores over one guest memory. Each   */
+/* core is a machine_t of its own (registers, TLBs, decode state,    */
+/* caches, predictor and timing model) whose memory points at core */
+/* 0's. Every core runs on its own host thread for a quantum of      */
+/* instructions, or cycles under the cycle-level models, then waits   */
+/* for the others, so no core gets more than a quantum ahead.          */
+/* The L1 data caches are kept coherent with MESI through a direct- */
+/* mapped directory of sharer masks. A core does not touch another  */
+/* core's cache: it takes the line away in the directory, and the     */
+/* other core finds its copy gone on its next access to the line.      */
+/* All cores start at the program entry with $k0 holding the core    */
+/* number and $k1 the number of cores; the machine halts when core */
+/* 0 does. Reset starts every core over, snapshots hold core 0's       */
+/* registers only.                                                                                       */
+/***************************************************************/
+
+#define SMP_MAX_CORES 32                   /* bits of a sharer mask */
+#define SMP_LOCKS     64                   /* directory lock stripes */
+
+typedef struct {
+	uint64_t tag;                          /* block << 32 | sharer mask, no sharers = free */
+	int owner;                             /* core holding the line in E or M, -1 if none */
+	int modified;                          /* the owner has written it (M) */
+} smp_dir_entry_t;
+
+/* one core's coherence counters, each on its own host cache line */
+typedef struct {
+	uint64_t invalidations;                /* other cores' copies this core's writes invalidated */
+	uint64_t upgrades;                     /* writes to a line held shared (S to M) */
+	uint64_t downgrades;                   /* reads that took another core's E or M copy to S */
+	uint64_t transfers;                    /* lines supplied by another core's cache */
+	uint64_t recalls;                      /* lines dropped from every cache on a directory conflict */
+	uint64_t sc_success, sc_failure;
+} __attribute__((aligned(64))) smp_stats_t;
+
+typedef struct smp_struct {
+	/* configuration */
+	uint32_t cores;
+	uint32_t quantum;                      /* instructions, or cycles, between synchronizations */
+	uint32_t latency;                      /* cycles of a cache-to-cache transfer or an upgrade */
+	uint32_t dir_size;                     /* directory entries, power of two */
+	/* state */
+	machine_t **core;                      /* core[0] owns the memory and the other cores */
+	pthread_mutex_t mem_lock;              /* MEM_LOCK of the shared memory */
+	smp_dir_entry_t *dir;
+	pthread_mutex_t lock[SMP_LOCKS];       /* entry i is guarded by lock[i % SMP_LOCKS] */
+	pthread_barrier_t barrier;
+	uint32_t chunk;                        /* length of the next quantum, 0 to stop */
+	/* statistics */
+	smp_stats_t *stats;                    /* per core */
+} smp_t;
+
+extern smp_t SMP_CONFIG;                   /* options, copied into each multicore machine */
+
+#define SMP (*MACHINE->smp)
+
+int smp_option(const char *opt);
+int smp_start();
+void smp_release();
+void smp_tlb_flush();
+uint32_t smp_run(uint32_t max);
+uint32_t smp_coherence(uint32_t block, int write, int *held, int *supplied);
+int smp_evict(uint32_t block);
+void smp_sc(int success);
+void smp_report();
@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "mu-mips-jit.h"
+#include "mu-mips-pipeline.h"
+#include "mu-mips-syscall.h"
+#include "mu-mips-debug.h"
+
+/***************************************************************/
+/* Machine snapshots.                                                                                         */
+/* The in-memory snapshot keeps its page contents in page->saved and  */
+/* relies on the memory layer's dirty list: every store marks its page */
+/* before the write TLB maps it, so saving or restoring only copies  */
+/* the pages written since the previous snapshot. A page with no       */
+/* saved copy was all zero when the snapshot was taken.                     */
+/* Snapshot files hold the CPU state and every materialized page.      */
+/***************************************************************/
+
+#define SNAPSHOT_CPU      (MACHINE->snapshot_cpu)
+#define SNAPSHOT_COUNT    (MACHINE->snapshot_count)
+#define SNAPSHOT_RUN_FLAG (MACHINE->snapshot_run_flag)
+#define SNAPSHOT_BRK      (MACHINE->snapshot_brk)
+
+/***************************************************************/
+/* Take the in-memory snapshot of the current machine. FALSE if the  */
+/* copies can't be allocated, the last snapshot is then kept               */
+/***************************************************************/
+int snapshot_save(int kind)
+{
+	mem_page_t *page;
+
+	for (page = MEM_DIRTY; page != NULL; page = page->dirty_next) {
+		if (page->saved == NULL) {
+			page->saved = malloc(MEM_PAGE_SIZE);
+			if (page->saved == NULL) {
+				printf("Error: Can't allocate snapshot page for address 0x%08x\n", page->vpn << MEM_PAGE_SHIFT);
+				return FALSE;
+			}
+		}
+	}
+	for (page = MEM_DIRTY; page != NULL; page = page->dirty_next) {
+		memcpy(page->saved, page->data, MEM_PAGE_SIZE);
+		page->dirty = FALSE;
+	}
+	MEM_DIRTY = NULL;
+	/* the next store to any page has to put it back on the dirty list */
+	mem_tlb_flush();
+
+	SNAPSHOT_CPU = CURRENT_STATE;
+	SNAPSHOT_COUNT = INSTRUCTION_COUNT;
+	SNAPSHOT_RUN_FLAG = RUN_FLAG;
+	SNAPSHOT_BRK = SYS_PROC.brk;
+	SNAPSHOT_STATE = kind;
+	return TRUE;
+}
+
+/***************************************************************/
+/* Return to the in-memory snapshot, copying back dirtied pages only */
+/***************************************************************/
+void snapshot_restore()
+{
+	mem_page_t *page;
+
+	if (SNAPSHOT_STATE == SNAPSHOT_NONE) {
+		printf("No snapshot to restore.\n");
+		return;
+	}
+	for (page = MEM_DIRTY; page != NULL; page = page->dirty_next) {
+		if (page->saved != NULL) {
+			memcpy(page->data, page->saved, MEM_PAGE_SIZE);
+		} else {
+			memset(page->data, 0, MEM_PAGE_SIZE);
+		}
+		if (page->decoded != NULL) {
+			memset(page->decoded, 0, (MEM_PAGE_SIZE / 4) * sizeof(decoded_inst_t));
+			if (page->jit) {
+				JIT_STALE = TRUE;
+			}
+		}
+		page->dirty = FALSE;
+	}
+	MEM_DIRTY = NULL;
+	mem_tlb_flush();
+
+	/* the pipeline held instructions of the abandoned run */
+	pipe_reset();
+	CURRENT_STATE = SNAPSHOT_CPU;
+	NEXT_STATE = CURRENT_STATE;
+	INSTRUCTION_COUNT = SNAPSHOT_COUNT;
+	RUN_FLAG = SNAPSHOT_RUN_FLAG;
+	SYS_PROC.brk = SNAPSHOT_BRK;
+	MACHINE->ll_valid = FALSE;
+	debug_apply();
+	trace_sink_state(TRUE);
+}
+
+/* snapshot files are little-endian words */
+static void put32(FILE *fp, uint32_t value)
+{
+	uint8_t b[4] = { value, value >> 8, value >> 16, value >> 24 };
+	fwrite(b, 1, 4, fp);
+}
+
+static int get32(FILE *fp, uint32_t *value)
+{
+	uint8_t b[4];
+
+	if (fread(b, 1, 4, fp) != 4) {
+		return FALSE;
+	}
+	*value = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+	return TRUE;
+}
+
+/***************************************************************/
+/* Write the machine to a snapshot file:                                               */
+/*   magic, version, PC, REGS[32], HI, LO, INSTRUCTION_COUNT as low  */
+/*   and high word, RUN_FLAG, heap begin, program break, page count, */
+/*   then                                                                                                  */
+/*   (page address, page bytes) per page                                                */
+/***************************************************************/
+int snapshot_write(const char *path)
+{
+	FILE *fp;
+	mem_page_t *page;
+	uint32_t pages = 0;
+	int i;
+
+	fp = fopen(path, "wb");
+	if (fp == NULL) {
+		printf("Error: Can't open snapshot file %s\n", path);
+		return FALSE;
+	}
+	for (page = MEM_PAGES; page != NULL; page = page->next) {
+		pages++;
+	}
+
+	fwrite(SNAPSHOT_MAGIC, 1, 4, fp);
+	put32(fp, SNAPSHOT_VERSION);
+	put32(fp, CURRENT_STATE.PC);
+	for (i = 0; i < MIPS_REGS; i++) {
+		put32(fp, CURRENT_STATE.REGS[i]);
+	}
+	put32(fp, CURRENT_STATE.HI);
+	put32(fp, CURRENT_STATE.LO);
+	put32(fp, (uint32_t)INSTRUCTION_COUNT);
+	put32(fp, (uint32_t)(INSTRUCTION_COUNT >> 32));
+	put32(fp, RUN_FLAG);
+	put32(fp, SYS_PROC.heap_begin);
+	put32(fp, SYS_PROC.brk);
+	put32(fp, pages);
+	for (page = MEM_PAGES; page != NULL; page = page->next) {
+		put32(fp, page->vpn << MEM_PAGE_SHIFT);
+		fwrite(page->data, 1, MEM_PAGE_SIZE, fp);
+	}
+
+	if (fclose(fp) != 0) {
+		printf("Error: Can't write snapshot file %s\n", path);
+		return FALSE;
+	}
+	printf("Snapshot written to %s (%u pages).\n", path, pages);
+	return TRUE;
+}
+
+/***************************************************************/
+/* Replace the machine with the contents of a snapshot file. The     */
+/* whole file is read before anything is replaced, so a bad file      */
+/* leaves the machine alone. The post-load snapshot is gone                */
+/* afterwards, reset reloads the program                                             */
+/***************************************************************/
+int snapshot_read(const char *path)
+{
+	FILE *fp;
+	char magic[4];
+	uint8_t *data, *record;
+	uint32_t version, address, pages, count_low, count_high, run_flag, heap_begin, brk, i;
+	CPU_State state;
+	long here, end;
+	int ok;
+
+	fp = fopen(path, "rb");
+	if (fp == NULL) {
+		printf("Error: Can't open snapshot file %s\n", path);
+		return FALSE;
+	}
+	if (fread(magic, 1, 4, fp) != 4 || memcmp(magic, SNAPSHOT_MAGIC, 4) != 0 ||
+			!get32(fp, &version) || version != SNAPSHOT_VERSION) {
+		printf("Error: %s is not a snapshot file\n", path);
+		fclose(fp);
+		return FALSE;
+	}
+	/* read the CPU state first so a short file leaves the machine alone */
+	memset(&state, 0, sizeof(state));
+	ok = get32(fp, &state.PC);
+	for (i = 0; i < MIPS_REGS; i++) {
+		ok = ok && get32(fp, &state.REGS[i]);
+	}
+	ok = ok && get32(fp, &state.HI) && get32(fp, &state.LO) && get32(fp, &count_low) && get32(fp, &count_high) &&
+			get32(fp, &run_flag) && get32(fp, &heap_begin) && get32(fp, &brk) && get32(fp, &pages);
+	if (!ok) {
+		printf("Error: Snapshot file %s is truncated\n", path);
+		fclose(fp);
+		return FALSE;
+	}
+
+	/* stage the pages: (address, page bytes) per page */
+	here = ftell(fp);
+	if (here < 0 || fseek(fp, 0, SEEK_END) != 0 || (end = ftell(fp)) < 0 ||
+			(uint64_t)(end - here) < (uint64_t)pages * (4 + MEM_PAGE_SIZE) || fseek(fp, here, SEEK_SET) != 0) {
+		printf("Error: Snapshot file %s is truncated\n", path);
+		fclose(fp);
+		return FALSE;
+	}
+	data = malloc((size_t)pages * (4 + MEM_PAGE_SIZE) + 1);
+	if (data == NULL) {
+		printf("Error: Can't allocate %u snapshot pages\n", pages);
+		fclose(fp);
+		return FALSE;
+	}
+	ok = fread(data, 4 + MEM_PAGE_SIZE, pages, fp) == pages;
+	fclose(fp);
+	if (!ok) {
+		printf("Error: Snapshot file %s is truncated\n", path);
+		free(data);
+		return FALSE;
+	}
+
+	free_memory();
+	for (i = 0; i < pages; i++) {
+		record = data + (size_t)i * (4 + MEM_PAGE_SIZE);
+		address = record[0] | (record[1] << 8) | (record[2] << 16) | ((uint32_t)record[3] << 24);
+		mem_write_block(address & ~MEM_PAGE_MASK, record + 4, MEM_PAGE_SIZE, FALSE);
+	}
+	free(data);
+
+	pipe_reset();
+	CURRENT_STATE = state;
+	NEXT_STATE = CURRENT_STATE;
+	INSTRUCTION_COUNT = (uint64_t)count_high << 32 | count_low;
+	RUN_FLAG = run_flag;
+	SYS_PROC.heap_begin = heap_begin;
+	SYS_PROC.brk = brk;
+	/* a reservation from before the restore must not let an SC succeed */
+	MACHINE->ll_valid = FALSE;
+	/* the pages the points were marked on are gone */
+	debug_apply();
+	trace_sink_state(TRUE);
+	printf("Snapshot restored from %s (%u pages).\n", path, pages);
+	return TRUE;
+}
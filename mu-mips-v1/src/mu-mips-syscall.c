@@ -0,0 +1,433 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "mu-mips.h"
+#include "mu-mips-syscall.h"
+
+/***************************************************************/
+/* SYSCALL services. Guest buffers are copied a byte at a time through */
+/* the memory layer, so stores invalidate decoded code and mark pages  */
+/* dirty like the guest's own, and words written to memory are           */
+/* recorded in the binary trace. Host files are read and written in      */
+/* chunks through stdio.                                                                             */
+/***************************************************************/
+
+#define SYS_CHUNK 4096
+
+/***************************************************************/
+/* The descriptors and the break of a multicore machine are shared,  */
+/* the memory lock guards them too. Never held across a guest access */
+/***************************************************************/
+static inline void sys_lock()
+{
+	if (MEM_LOCK != NULL) {
+		pthread_mutex_lock(MEM_LOCK);
+	}
+}
+
+static inline void sys_unlock()
+{
+	if (MEM_LOCK != NULL) {
+		pthread_mutex_unlock(MEM_LOCK);
+	}
+}
+
+/***************************************************************/
+/* Write out the console output this core has buffered                     */
+/***************************************************************/
+void syscall_flush()
+{
+	if (MACHINE->output_len > 0) {
+		fwrite(MACHINE->output, 1, MACHINE->output_len, stdout);
+		fflush(stdout);
+		MACHINE->output_len = 0;
+	}
+}
+
+/***************************************************************/
+/* Close the guest's files and forget its exit status. A load also     */
+/* moves the heap back, the loader then raises it past the data         */
+/***************************************************************/
+void syscall_reset(int load)
+{
+	int fd;
+
+	syscall_flush();
+	for (fd = 3; fd < SYS_MAX_FILES; fd++) {
+		if (SYS_PROC.files[fd] != NULL) {
+			fclose(SYS_PROC.files[fd]);
+			SYS_PROC.files[fd] = NULL;
+		}
+	}
+	SYS_PROC.exited = FALSE;
+	SYS_PROC.exit_code = 0;
+	if (load) {
+		SYS_PROC.heap_begin = SYS_HEAP_BEGIN;
+		SYS_PROC.brk = SYS_HEAP_BEGIN;
+	}
+}
+
+/***************************************************************/
+/* Flush, and close the files if this core owns them                          */
+/***************************************************************/
+void syscall_release()
+{
+	syscall_flush();
+	if (MACHINE->proc == &MACHINE->own_proc) {
+		syscall_reset(FALSE);
+	}
+}
+
+/***************************************************************/
+/* Start the heap past a loaded segment ending at end                         */
+/***************************************************************/
+void syscall_heap(uint32_t end)
+{
+	end = (end + MEM_PAGE_MASK) & ~MEM_PAGE_MASK;
+	if (end > SYS_PROC.heap_begin) {
+		SYS_PROC.heap_begin = end;
+		SYS_PROC.brk = end;
+	}
+}
+
+/***************************************************************/
+/* Append to the console output, writing it out when the buffer fills */
+/***************************************************************/
+static void sys_output(const char *s, uint32_t len)
+{
+	if (MACHINE->output_len + len > SYS_OUTPUT_SIZE) {
+		syscall_flush();
+	}
+	if (len >= SYS_OUTPUT_SIZE) {
+		fwrite(s, 1, len, stdout);
+	} else {
+		memcpy(MACHINE->output + MACHINE->output_len, s, len);
+		MACHINE->output_len += len;
+	}
+	if (TRACE) {
+		/* keep the program's output between the lines of its trace */
+		syscall_flush();
+	}
+}
+
+static void sys_copy_in(uint32_t address, uint8_t *buf, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i < len; i++) {
+		buf[i] = mem_read_8(address + i);
+	}
+}
+
+static void sys_copy_out(uint32_t address, const uint8_t *buf, uint32_t len)
+{
+	uint32_t i, word;
+
+	for (i = 0; i < len; i++) {
+		mem_write_8(address + i, buf[i]);
+	}
+	if (TRACE_FILE != NULL) {
+		for (word = address & ~3; word - (address & ~3) < len + (address & 3); word += 4) {
+			trace_sink_poke(word, mem_peek(word, 4));
+		}
+	}
+}
+
+/***************************************************************/
+/* A guest string into buf, FALSE if it is not terminated within size */
+/***************************************************************/
+static int sys_copy_string(uint32_t address, char *buf, uint32_t size)
+{
+	uint32_t i;
+
+	for (i = 0; i < size; i++) {
+		if ((buf[i] = mem_read_8(address + i)) == '\0') {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/***************************************************************/
+/* Up to max bytes of console input, stopping after a newline. The   */
+/* output so far is written first, it may be the prompt                     */
+/***************************************************************/
+static uint32_t sys_read_console(uint8_t *buf, uint32_t max)
+{
+	uint32_t n = 0;
+	int c;
+
+	syscall_flush();
+	while (n < max && (c = getchar()) != EOF) {
+		buf[n++] = c;
+		if (c == '\n') {
+			break;
+		}
+	}
+	return n;
+}
+
+/***************************************************************/
+/* Host file behind a guest descriptor, NULL if it is not open           */
+/***************************************************************/
+static FILE *sys_file(uint32_t fd)
+{
+	return fd >= 3 && fd < SYS_MAX_FILES ? SYS_PROC.files[fd] : NULL;
+}
+
+static void sys_print_string(uint32_t address)
+{
+	char c;
+
+	while ((c = mem_read_8(address++)) != '\0' && address != 0) {
+		if (MACHINE->output_len == SYS_OUTPUT_SIZE) {
+			syscall_flush();
+		}
+		MACHINE->output[MACHINE->output_len++] = c;
+	}
+	if (TRACE) {
+		syscall_flush();
+	}
+}
+
+static uint32_t sys_read_string(uint32_t address, uint32_t size, int terminate)
+{
+	uint8_t buf[SYS_CHUNK];
+	uint32_t total = 0, chunk, n;
+
+	if (terminate) {
+		if (size == 0) {
+			return 0;
+		}
+		size--;
+	}
+	while (total < size) {
+		chunk = size - total < SYS_CHUNK ? size - total : SYS_CHUNK;
+		n = sys_read_console(buf, chunk);
+		sys_copy_out(address + total, buf, n);
+		total += n;
+		if (n < chunk || buf[n - 1] == '\n') {
+			break;
+		}
+	}
+	if (terminate) {
+		sys_copy_out(address + total, (const uint8_t *)"", 1);
+	}
+	return total;
+}
+
+static uint32_t sys_sbrk(int32_t increment)
+{
+	uint32_t old, limit;
+	int64_t brk;
+
+	sys_lock();
+	old = SYS_PROC.brk;
+	brk = ((int64_t)old + increment + 3) & ~3LL;
+	/* the heap grows towards the stack */
+	limit = CURRENT_STATE.REGS[29] > old ? CURRENT_STATE.REGS[29] : (uint32_t)MEM_DATA_END + 1;
+	if (brk < SYS_PROC.heap_begin || brk > limit) {
+		old = 0xFFFFFFFF;
+	} else {
+		SYS_PROC.brk = brk;
+	}
+	sys_unlock();
+	return old;
+}
+
+static uint32_t sys_open(uint32_t path, uint32_t flags)
+{
+	char name[PROG_FILE_SIZE];
+	const char *mode;
+	FILE *fp;
+	uint32_t fd;
+
+	switch (flags) {
+		case 0: mode = "rb"; break;
+		case 1: mode = "wb"; break;
+		case 9: mode = "ab"; break;
+		default: return 0xFFFFFFFF;
+	}
+	if (!sys_copy_string(path, name, sizeof(name)) || (fp = fopen(name, mode)) == NULL) {
+		return 0xFFFFFFFF;
+	}
+	sys_lock();
+	for (fd = 3; fd < SYS_MAX_FILES && SYS_PROC.files[fd] != NULL; fd++) {
+	}
+	if (fd < SYS_MAX_FILES) {
+		SYS_PROC.files[fd] = fp;
+	}
+	sys_unlock();
+	if (fd == SYS_MAX_FILES) {
+		fclose(fp);
+		return 0xFFFFFFFF;
+	}
+	return fd;
+}
+
+static uint32_t sys_read(uint32_t fd, uint32_t address, uint32_t count)
+{
+	uint8_t buf[SYS_CHUNK];
+	uint32_t total = 0, chunk, n;
+	FILE *fp;
+
+	if (fd == 0) {
+		return sys_read_string(address, count, FALSE);
+	}
+	while (total < count) {
+		chunk = count - total < SYS_CHUNK ? count - total : SYS_CHUNK;
+		sys_lock();
+		fp = sys_file(fd);
+		n = fp != NULL ? fread(buf, 1, chunk, fp) : 0;
+		sys_unlock();
+		if (fp == NULL) {
+			return 0xFFFFFFFF;
+		}
+		sys_copy_out(address + total, buf, n);
+		total += n;
+		if (n < chunk) {
+			break;
+		}
+	}
+	return total;
+}
+
+static uint32_t sys_write(uint32_t fd, uint32_t address, uint32_t count)
+{
+	uint8_t buf[SYS_CHUNK];
+	uint32_t total = 0, chunk, n;
+	FILE *fp;
+
+	if (fd == 0 || (fd > 2 && sys_file(fd) == NULL)) {
+		return 0xFFFFFFFF;
+	}
+	while (total < count) {
+		chunk = count - total < SYS_CHUNK ? count - total : SYS_CHUNK;
+		sys_copy_in(address + total, buf, chunk);
+		if (fd == 1) {
+			sys_output((const char *)buf, chunk);
+			n = chunk;
+		} else if (fd == 2) {
+			syscall_flush();
+			n = fwrite(buf, 1, chunk, stderr);
+		} else {
+			sys_lock();
+			fp = sys_file(fd);
+			n = fp != NULL ? fwrite(buf, 1, chunk, fp) : 0;
+			sys_unlock();
+		}
+		total += n;
+		if (n < chunk) {
+			break;
+		}
+	}
+	return total;
+}
+
+static uint32_t sys_close(uint32_t fd)
+{
+	FILE *fp;
+
+	if (fd < 3) {
+		return 0;              /* the console stays open */
+	}
+	sys_lock();
+	fp = sys_file(fd);
+	if (fp != NULL) {
+		SYS_PROC.files[fd] = NULL;
+	}
+	sys_unlock();
+	if (fp == NULL) {
+		return 0xFFFFFFFF;
+	}
+	return fclose(fp) == 0 ? 0 : 0xFFFFFFFF;
+}
+
+/***************************************************************/
+/* Run the service $v0 selects. Results go to next; the decoder makes */
+/* $v0 the instruction's destination, and $a0/$a1 for the time            */
+/***************************************************************/
+void syscall_emulate(CPU_State *current, CPU_State *next)
+{
+	uint32_t a0 = current->REGS[4], a1 = current->REGS[5], a2 = current->REGS[6];
+	uint8_t buf[SYS_STRING_MAX + 1];
+	char text[40];
+	struct timespec now;
+	uint64_t ms;
+	uint32_t n;
+	int i;
+
+	switch (current->REGS[2]) {
+		case SYS_PRINT_INT:
+			sys_output(text, snprintf(text, sizeof(text), "%d", (int32_t)a0));
+			break;
+		case SYS_PRINT_STRING:
+			sys_print_string(a0);
+			break;
+		case SYS_READ_INT:
+			n = sys_read_console(buf, SYS_STRING_MAX);
+			buf[n] = '\0';
+			next->REGS[2] = (uint32_t)strtoll((const char *)buf, NULL, 10);
+			break;
+		case SYS_READ_STRING:
+			sys_read_string(a0, a1, TRUE);
+			break;
+		case SYS_SBRK:
+			next->REGS[2] = sys_sbrk(a0);
+			break;
+		case SYS_EXIT:
+			RUN_FLAG = FALSE;
+			break;
+		case SYS_PRINT_CHAR:
+			text[0] = a0;
+			sys_output(text, 1);
+			break;
+		case SYS_READ_CHAR:
+			syscall_flush();
+			i = getchar();
+			next->REGS[2] = i == EOF ? 0xFFFFFFFF : (uint32_t)i;
+			break;
+		case SYS_OPEN:
+			next->REGS[2] = sys_open(a0, a1);
+			break;
+		case SYS_READ:
+			next->REGS[2] = sys_read(a0, a1, a2);
+			break;
+		case SYS_WRITE:
+			next->REGS[2] = sys_write(a0, a1, a2);
+			break;
+		case SYS_CLOSE:
+			next->REGS[2] = sys_close(a0);
+			break;
+		case SYS_EXIT2:
+			SYS_PROC.exited = TRUE;
+			SYS_PROC.exit_code = (int32_t)a0;
+			RUN_FLAG = FALSE;
+			break;
+		case SYS_TIME:
+			clock_gettime(CLOCK_REALTIME, &now);
+			ms = (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+			next->REGS[4] = (uint32_t)ms;
+			next->REGS[5] = (uint32_t)(ms >> 32);
+			break;
+		case SYS_PRINT_HEX:
+			sys_output(text, snprintf(text, sizeof(text), "0x%08x", a0));
+			break;
+		case SYS_PRINT_BIN:
+			for (i = 0; i < 32; i++) {
+				text[i] = (a0 >> (31 - i)) & 1 ? '1' : '0';
+			}
+			sys_output(text, 32);
+			break;
+		case SYS_PRINT_UNSIGNED:
+			sys_output(text, snprintf(text, sizeof(text), "%u", a0));
+			break;
+		default:
+			syscall_flush();
+			printf("Warning: Unknown syscall %u at 0x%08x\n", current->REGS[2], current->PC);
+			break;
+	}
+}
@@ -0,0 +1,42 @@
+#include <stdint.h>
+
+/***************************************************************/
+/* SYSCALL emulation, SPIM/MARS numbering.                                           */
+/* $v0 selects the service, $a0-$a2 carry its arguments and the      */
+/* result comes back in $v0 ($a0/$a1 for time). Console output is       */
+/* buffered per core and written when a run stops, before the guest */
+/* reads the console and when the buffer fills. Descriptors 0-2 are   */
+/* the simulator's stdin, stdout and stderr; files the guest opens   */
+/* are host stdio streams. The heap starts at SYS_HEAP_BEGIN, or past  */
+/* the highest loaded data segment.                                              */
+/***************************************************************/
+
+#define SYS_HEAP_BEGIN 0x10040000
+#define SYS_STRING_MAX 4096                /* console lines read at once */
+
+enum {
+	SYS_PRINT_INT = 1,
+	SYS_PRINT_STRING = 4,
+	SYS_READ_INT = 5,
+	SYS_READ_STRING = 8,
+	SYS_SBRK = 9,
+	SYS_EXIT = 10,
+	SYS_PRINT_CHAR = 11,
+	SYS_READ_CHAR = 12,
+	SYS_OPEN = 13,                         /* $a1: 0 read, 1 write, 9 append (MARS) */
+	SYS_READ = 14,
+	SYS_WRITE = 15,
+	SYS_CLOSE = 16,
+	SYS_EXIT2 = 17,
+	SYS_TIME = 30,                         /* milliseconds since the epoch, low word in $a0 */
+	SYS_PRINT_HEX = 34,
+	SYS_PRINT_BIN = 35,
+	SYS_PRINT_UNSIGNED = 36
+};
+
+#define SYS_PROC (*MACHINE->proc)
+
+void syscall_flush();
+void syscall_reset(int load);
+void syscall_release();
+void syscall_heap(uint32_t end);
@@ -0,0 +1,87 @@
+#include <stdint.h>
+
+/***************************************************************/
+/* Binary trace format.                                                                                       */
+/* "MUTR" and the version as a 4-byte word, then one record per      */
+/* executed instruction. A record is a flags byte                                */
+/* and the fields the flags announce, in flag order:                          */
+/*   TRACE_JUMP  PC differs from the previous PC + 4: zigzag delta   */
+/*   TRACE_WORD  instruction word, 4 bytes, left out when it matches */
+/*               the word last recorded in its TRACE_WORD_CACHE slot */
+/*   TRACE_REG   GPR changed: register byte, zigzag delta of its value */
+/*   TRACE_HILO  HI or LO changed: zigzag deltas of HI and LO            */
+/*   TRACE_MEM   load or store: zigzag delta from the previous address, */
+/*               then the value loaded or stored                                 */
+/*   TRACE_ARGS  a SYSCALL changed $a0 or $a1: zigzag deltas of both   */
+/* Numbers are LEB128 varints. Flags with the top bit set mark the     */
+/* records written when the state changes outside execution:              */
+/*   TRACE_RELOAD  count, path length and path: memory is the image of */
+/*                 that program after running count instructions        */
+/*   TRACE_REGS    count in 8 bytes, then PC, the 32 GPRs, HI and LO */
+/*                 in 4 bytes each                                                       */
+/*   TRACE_POKE    a word was written: address, value, 4 bytes each     */
+/***************************************************************/
+
+#define TRACE_MAGIC "MUTR"
+#define TRACE_VERSION 3
+#define TRACE_RECORD_MAX 160              /* longest record but TRACE_RELOAD */
+
+enum {
+	TRACE_JUMP = 0x01, TRACE_WORD = 0x02, TRACE_REG = 0x04, TRACE_HILO = 0x08, TRACE_MEM = 0x10,
+	TRACE_ARGS = 0x20,
+	TRACE_RELOAD = 0x80, TRACE_REGS = 0x81, TRACE_POKE = 0x82
+};
+
+static inline uint8_t *trace_put_varint(uint8_t *p, uint32_t value)
+{
+	while (value >= 0x80) {
+		*p++ = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	*p++ = value;
+	return p;
+}
+
+static inline uint8_t *trace_put_varint64(uint8_t *p, uint64_t value)
+{
+	while (value >= 0x80) {
+		*p++ = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	*p++ = value;
+	return p;
+}
+
+/* small differences either way take one byte */
+static inline uint8_t *trace_put_delta(uint8_t *p, uint32_t delta)
+{
+	return trace_put_varint(p, (delta << 1) ^ (uint32_t)((int32_t)delta >> 31));
+}
+
+static inline uint8_t *trace_put32(uint8_t *p, uint32_t value)
+{
+	p[0] = value;
+	p[1] = value >> 8;
+	p[2] = value >> 16;
+	p[3] = value >> 24;
+	return p + 4;
+}
+
+static inline uint32_t trace_undelta(uint32_t zigzag)
+{
+	return (zigzag >> 1) ^ -(zigzag & 1);
+}
+
+/* bytes a load or store accesses, 0 for other instructions */
+static inline int trace_mem_size(uint8_t op)
+{
+	switch (op) {
+		case OP_LB: case OP_LBU: case OP_SB:
+			return 1;
+		case OP_LH: case OP_LHU: case OP_SH:
+			return 2;
+		case OP_LW: case OP_SW: case OP_LL: case OP_SC:
+			return 4;
+	}
+	return 0;
+}
@@ -5,597 +5,1176 @@
 #include <assert.h>
 
 #include "mu-mips.h"
+#include "mu-mips-ops.h"
+#include "mu-mips-jit.h"
+#include "mu-mips-pipeline.h"
+#include "mu-mips-cache.h"
+#include "mu-mips-bpred.h"
+#include "mu-mips-profile.h"
+#include "mu-mips-sample.h"
+#include "mu-mips-ooo.h"
+#include "mu-mips-smp.h"
+#include "mu-mips-syscall.h"
+#include "mu-mips-trace.h"
+#include "mu-mips-debug.h"
 
 /***************************************************************/
-/* Print out a list of commands available                                                                  */
+/* Simulator state (declared in mu-mips.h)                                                  */
 /***************************************************************/
-void help() {        
-	printf("------------------------------------------------------------------\n\n");
-	printf("\t**********MU-MIPS Help MENU**********\n\n");
-	printf("sim\t-- simulate program to completion \n");
-	printf("run <n>\t-- simulate program for <n> instructions\n");
-	printf("rdump\t-- dump register values\n");
-	printf("reset\t-- clears all registers/memory and re-loads the program\n");
-	printf("input <reg> <val>\t-- set GPR <reg> to <val>\n");
-	printf("mdump <start> <stop>\t-- dump memory from <start> to <stop> address\n");
-	printf("high <val>\t-- set the HI register to <val>\n");
-	printf("low <val>\t-- set the LO register to <val>\n");
-	printf("print\t-- print the program loaded into memory\n");
-	printf("?\t-- display help menu\n");
-	printf("quit\t-- exit the simulator\n\n");
-	printf("------------------------------------------------------------------\n\n");
-}
+mem_region_t MEM_REGIONS[] = {
+	{ MEM_TEXT_BEGIN, MEM_TEXT_END },
+	{ MEM_DATA_BEGIN, MEM_DATA_END },
+	{ MEM_KDATA_BEGIN, MEM_KDATA_END },
+	{ MEM_KTEXT_BEGIN, MEM_KTEXT_END }
+};
+
+MACHINE_LOCAL machine_t *MACHINE;
+
+int PROGRAM_FORMAT;
+int ENGINE;
+int TRACE;
+int VERBOSE;
+
 
 /***************************************************************/
-/* Read a 32-bit word from memory                                                                            */
+/* Check whether an address belongs to a memory region                    */
 /***************************************************************/
-uint32_t mem_read_32(uint32_t address)
+static int mem_mapped(uint32_t address)
 {
 	int i;
 	for (i = 0; i < NUM_MEM_REGION; i++) {
-		if ( (address >= MEM_REGIONS[i].begin) &&  ( address <= MEM_REGIONS[i].end) ) {
-			uint32_t offset = address - MEM_REGIONS[i].begin;
-			return (MEM_REGIONS[i].mem[offset+3] << 24) |
-					(MEM_REGIONS[i].mem[offset+2] << 16) |
-					(MEM_REGIONS[i].mem[offset+1] <<  8) |
-					(MEM_REGIONS[i].mem[offset+0] <<  0);
+		if ( (address >= MEM_REGIONS[i].begin) && (address <= MEM_REGIONS[i].end) ) {
+			return TRUE;
 		}
 	}
-	return 0;
+	return FALSE;
 }
 
 /***************************************************************/
-/* Write a 32-bit word to memory                                                                                */
+/* Serialize changes to memory shared by several cores. A single       */
+/* core never takes the lock                                                                          */
 /***************************************************************/
-void mem_write_32(uint32_t address, uint32_t value)
+static inline void mem_lock()
 {
-	int i;
-	uint32_t offset;
-	for (i = 0; i < NUM_MEM_REGION; i++) {
-		if ( (address >= MEM_REGIONS[i].begin) && (address <= MEM_REGIONS[i].end) ) {
-			offset = address - MEM_REGIONS[i].begin;
+	if (MEM_LOCK != NULL) {
+		pthread_mutex_lock(MEM_LOCK);
+	}
+}
+
+static inline void mem_unlock()
+{
+	if (MEM_LOCK != NULL) {
+		pthread_mutex_unlock(MEM_LOCK);
+	}
+}
+
+/***************************************************************/
+/* Materialize the page holding address, under the memory lock.     */
+/* NULL if it can't be allocated, the address then acts unmapped     */
+/***************************************************************/
+static mem_page_t *mem_page_create(uint32_t address)
+{
+	uint32_t vpn = address >> MEM_PAGE_SHIFT;
+	mem_page_t **table = MEM_PAGE_DIR[address >> MEM_DIR_SHIFT];
+	mem_page_t *page;
 
-			MEM_REGIONS[i].mem[offset+3] = (value >> 24) & 0xFF;
-			MEM_REGIONS[i].mem[offset+2] = (value >> 16) & 0xFF;
-			MEM_REGIONS[i].mem[offset+1] = (value >>  8) & 0xFF;
-			MEM_REGIONS[i].mem[offset+0] = (value >>  0) & 0xFF;
+	if (table == NULL) {
+		table = calloc(MEM_TABLE_SIZE, sizeof(mem_page_t *));
+		if (table == NULL) {
+			printf("Error: Can't allocate page table for address 0x%08x\n", address);
+			return NULL;
 		}
+		__atomic_store_n(&MEM_PAGE_DIR[address >> MEM_DIR_SHIFT], table, __ATOMIC_RELEASE);
+	}
+	page = table[vpn & (MEM_TABLE_SIZE - 1)];
+	if (page != NULL) {
+		/* another core got here first */
+		return page;
 	}
+	page = calloc(1, sizeof(mem_page_t));
+	if (page == NULL) {
+		printf("Error: Can't allocate memory page for address 0x%08x\n", address);
+		return NULL;
+	}
+	page->vpn = vpn;
+	page->next = MEM_PAGES;
+	MEM_PAGES = page;
+	__atomic_store_n(&table[vpn & (MEM_TABLE_SIZE - 1)], page, __ATOMIC_RELEASE);
+	return page;
 }
 
 /***************************************************************/
-/* Execute one cycle                                                                                                              */
+/* Walk the page directory, materializing the page if asked. Other    */
+/* cores may add pages meanwhile, so the walk reads them atomically */
 /***************************************************************/
-void cycle() {                                                
-	handle_instruction();
-	CURRENT_STATE = NEXT_STATE;
-	INSTRUCTION_COUNT++;
+mem_page_t *mem_page(uint32_t address, int create)
+{
+	uint32_t vpn = address >> MEM_PAGE_SHIFT;
+	mem_page_t **table = __atomic_load_n(&MEM_PAGE_DIR[address >> MEM_DIR_SHIFT], __ATOMIC_ACQUIRE);
+	mem_page_t *page = table ? __atomic_load_n(&table[vpn & (MEM_TABLE_SIZE - 1)], __ATOMIC_ACQUIRE) : NULL;
+
+	if (page == NULL) {
+		if (!create || !mem_mapped(address)) {
+			return NULL;
+		}
+		mem_lock();
+		page = mem_page_create(address);
+		mem_unlock();
+	}
+	return page;
 }
 
 /***************************************************************/
-/* Simulate MIPS for n cycles                                                                                       */
+/* Put a page on the dirty list on its first write after a snapshot  */
 /***************************************************************/
-void run(int num_cycles) {                                      
-	
-	if (RUN_FLAG == FALSE) {
-		printf("Simulation Stopped\n\n");
-		return;
+static inline void mem_mark_dirty(mem_page_t *page)
+{
+	if (!__atomic_load_n(&page->dirty, __ATOMIC_RELAXED)) {
+		mem_lock();
+		if (!page->dirty) {
+			page->dirty_next = MEM_DIRTY;
+			MEM_DIRTY = page;
+			__atomic_store_n(&page->dirty, TRUE, __ATOMIC_RELAXED);
+		}
+		mem_unlock();
 	}
+}
 
-	printf("Running simulator for %d cycles...\n\n", num_cycles);
-	int i;
-	for (i = 0; i < num_cycles; i++) {
-		if (RUN_FLAG == FALSE) {
-			printf("Simulation Stopped.\n\n");
-			break;
+/***************************************************************/
+/* Translate on a TLB miss and refill the TLB                                       */
+/***************************************************************/
+static uint8_t *mem_translate_slow(uint32_t address, uint32_t size, int write)
+{
+	mem_page_t *page = mem_page(address, write);
+	mem_tlb_entry_t *tlb;
+
+	if (page == NULL) {
+		return NULL;
+	}
+	if (write) {
+		/* every store reaches a page through here before the write TLB maps it */
+		mem_mark_dirty(page);
+	}
+	if (page->watch & (write ? MEM_WATCH_WRITE : MEM_WATCH_READ)) {
+		/* watched accesses stay on the slow path so each one is checked */
+		debug_watch(address, size, write);
+		if (write && __atomic_load_n(&page->decoded, __ATOMIC_ACQUIRE) != NULL) {
+			decode_invalidate(page, address);
 		}
-		cycle();
+		return page->data + (address & MEM_PAGE_MASK);
 	}
+	if (!write) {
+		tlb = &MEM_TLB[page->vpn & (MEM_TLB_SIZE - 1)];
+	} else if (__atomic_load_n(&page->decoded, __ATOMIC_ACQUIRE) == NULL) {
+		tlb = &MEM_WTLB[page->vpn & (MEM_TLB_SIZE - 1)];
+	} else {
+		/* stores into decoded code stay on the slow path so they can invalidate it */
+		decode_invalidate(page, address);
+		return page->data + (address & MEM_PAGE_MASK);
+	}
+	tlb->vpn = page->vpn;
+	tlb->page = page;
+	return page->data + (address & MEM_PAGE_MASK);
 }
 
 /***************************************************************/
-/* simulate to completion                                                                                               */
+/* Translate a guest address to a host pointer, NULL if never written  */
 /***************************************************************/
-void runAll() {                                                     
-	if (RUN_FLAG == FALSE) {
-		printf("Simulation Stopped.\n\n");
-		return;
+static inline uint8_t *mem_translate(uint32_t address, uint32_t size, int write)
+{
+	mem_tlb_entry_t *tlb = write ? &MEM_WTLB[(address >> MEM_PAGE_SHIFT) & (MEM_TLB_SIZE - 1)]
+	                             : &MEM_TLB[(address >> MEM_PAGE_SHIFT) & (MEM_TLB_SIZE - 1)];
+
+	if (tlb->vpn == (address >> MEM_PAGE_SHIFT)) {
+		return tlb->page->data + (address & MEM_PAGE_MASK);
 	}
+	return mem_translate_slow(address, size, write);
+}
+
+/* guest memory is little-endian, swap on big-endian hosts */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define MEM_LE16(x) __builtin_bswap16(x)
+#define MEM_LE32(x) __builtin_bswap32(x)
+#else
+#define MEM_LE16(x) (x)
+#define MEM_LE32(x) (x)
+#endif
+
+/***************************************************************/
+/* Read a byte from memory, untouched pages read as zero                 */
+/***************************************************************/
+uint8_t mem_read_8(uint32_t address)
+{
+	uint8_t *p = mem_translate(address, 1, FALSE);
+	return p ? *p : 0;
+}
+
+/***************************************************************/
+/* Read a 16-bit halfword from memory                                                                        */
+/***************************************************************/
+uint16_t mem_read_16(uint32_t address)
+{
+	uint8_t *p;
+	uint16_t value;
 
-	printf("Simulation Started...\n\n");
-	while (RUN_FLAG){
-		cycle();
+	if ((address & MEM_PAGE_MASK) > MEM_PAGE_SIZE - 2) {
+		/* halfword straddles a page boundary */
+		return (mem_read_8(address+1) << 8) | mem_read_8(address);
 	}
-	printf("Simulation Finished.\n\n");
+	p = mem_translate(address, 2, FALSE);
+	if (p == NULL) {
+		return 0;
+	}
+	memcpy(&value, p, sizeof(value));
+	return MEM_LE16(value);
 }
 
-/***************************************************************/ 
-/* Dump a word-aligned region of memory to the terminal                              */
 /***************************************************************/
-void mdump(uint32_t start, uint32_t stop) {          
-	uint32_t address;
+/* Read a 32-bit word from memory                                                                            */
+/***************************************************************/
+uint32_t mem_read_32(uint32_t address)
+{
+	uint8_t *p;
+	uint32_t value;
 
-	printf("-------------------------------------------------------------\n");
-	printf("Memory content [0x%08x..0x%08x] :\n", start, stop);
-	printf("-------------------------------------------------------------\n");
-	printf("\t[Address in Hex (Dec) ]\t[Value]\n");
-	for (address = start; address <= stop; address += 4){
-		printf("\t0x%08x (%d) :\t0x%08x\n", address, address, mem_read_32(address));
+	if ((address & MEM_PAGE_MASK) > MEM_PAGE_SIZE - 4) {
+		/* word straddles a page boundary */
+		return (mem_read_8(address+3) << 24) |
+				(mem_read_8(address+2) << 16) |
+				(mem_read_8(address+1) <<  8) |
+				(mem_read_8(address+0) <<  0);
+	}
+	p = mem_translate(address, 4, FALSE);
+	if (p == NULL) {
+		return 0;
 	}
-	printf("\n");
+	memcpy(&value, p, sizeof(value));
+	return MEM_LE32(value);
 }
 
 /***************************************************************/
-/* Dump current values of registers to the teminal                                              */   
+/* Read size bytes for the simulator itself (decode, traces): walks   */
+/* the page directory rather than the TLB, so no watchpoint sees it   */
 /***************************************************************/
-void rdump() {                               
-	int i; 
-	printf("-------------------------------------\n");
-	printf("Dumping Register Content\n");
-	printf("-------------------------------------\n");
-	printf("# Instructions Executed\t: %u\n", INSTRUCTION_COUNT);
-	printf("PC\t: 0x%08x\n", CURRENT_STATE.PC);
-	printf("-------------------------------------\n");
-	printf("[Register]\t[Value]\n");
-	printf("-------------------------------------\n");
-	for (i = 0; i < MIPS_REGS; i++){
-		printf("[R%d]\t: 0x%08x\n", i, CURRENT_STATE.REGS[i]);
+uint32_t mem_peek(uint32_t address, uint32_t size)
+{
+	mem_page_t *page;
+	uint32_t value = 0;
+	int i;
+
+	if ((address & MEM_PAGE_MASK) > MEM_PAGE_SIZE - size) {
+		/* straddles a page boundary */
+		for (i = size - 1; i >= 0; i--) {
+			value = (value << 8) | mem_peek(address + i, 1);
+		}
+		return value;
+	}
+	page = mem_page(address, FALSE);
+	if (page == NULL) {
+		return 0;
+	}
+	for (i = size - 1; i >= 0; i--) {
+		value = (value << 8) | page->data[(address & MEM_PAGE_MASK) + i];
 	}
-	printf("-------------------------------------\n");
-	printf("[HI]\t: 0x%08x\n", CURRENT_STATE.HI);
-	printf("[LO]\t: 0x%08x\n", CURRENT_STATE.LO);
-	printf("-------------------------------------\n");
+	return value;
 }
 
 /***************************************************************/
-/* Read a command from standard input.                                                               */  
+/* Write a byte to memory                                                                                        */
 /***************************************************************/
-void handle_command() {                         
-	char buffer[20];
-	uint32_t start, stop, cycles;
-	uint32_t register_no;
-	int register_value;
-	int hi_reg_value, lo_reg_value;
+void mem_write_8(uint32_t address, uint8_t value)
+{
+	uint8_t *p = mem_translate(address, 1, TRUE);
+	if (p != NULL) {
+		*p = value;
+	}
+}
 
-	printf("MU-MIPS SIM:> ");
+/***************************************************************/
+/* Write a 16-bit halfword to memory                                                                          */
+/***************************************************************/
+void mem_write_16(uint32_t address, uint16_t value)
+{
+	uint8_t *p;
 
-	if (scanf("%s", buffer) == EOF){
-		exit(0);
+	if ((address & MEM_PAGE_MASK) > MEM_PAGE_SIZE - 2) {
+		/* halfword straddles a page boundary */
+		mem_write_8(address+1, (value >> 8) & 0xFF);
+		mem_write_8(address+0, (value >> 0) & 0xFF);
+		return;
 	}
+	p = mem_translate(address, 2, TRUE);
+	if (p != NULL) {
+		value = MEM_LE16(value);
+		memcpy(p, &value, sizeof(value));
+	}
+}
 
-	switch(buffer[0]) {
-		case 'S':
-		case 's':
-			runAll(); 
-			break;
-		case 'M':
-		case 'm':
-			if (scanf("%x %x", &start, &stop) != 2){
-				break;
-			}
-			mdump(start, stop);
-			break;
-		case '?':
-			help();
-			break;
-		case 'Q':
-		case 'q':
-			printf("**************************\n");
-			printf("Exiting MU-MIPS! Good Bye...\n");
-			printf("**************************\n");
-			exit(0);
-		case 'R':
-		case 'r':
-			if (buffer[1] == 'd' || buffer[1] == 'D'){
-				rdump();
-			}else if(buffer[1] == 'e' || buffer[1] == 'E'){
-				reset();
-			}
-			else {
-				if (scanf("%d", &cycles) != 1) {
-					break;
+/***************************************************************/
+/* Write a 32-bit word to memory                                                                                */
+/***************************************************************/
+void mem_write_32(uint32_t address, uint32_t value)
+{
+	uint8_t *p;
+
+	if ((address & MEM_PAGE_MASK) > MEM_PAGE_SIZE - 4) {
+		/* word straddles a page boundary */
+		mem_write_8(address+3, (value >> 24) & 0xFF);
+		mem_write_8(address+2, (value >> 16) & 0xFF);
+		mem_write_8(address+1, (value >>  8) & 0xFF);
+		mem_write_8(address+0, (value >>  0) & 0xFF);
+		return;
+	}
+	p = mem_translate(address, 4, TRUE);
+	if (p != NULL) {
+		value = MEM_LE32(value);
+		memcpy(p, &value, sizeof(value));
+	}
+}
+
+/***************************************************************/
+/* Copy a host buffer into guest memory a page at a time. With swap */
+/* set the buffer holds big-endian words, each is byte-swapped on   */
+/* the way in (a trailing partial word is copied as is). Addresses   */
+/* outside every region are skipped, like single stores. FALSE if   */
+/* any were                                                                                           */
+/***************************************************************/
+int mem_write_block(uint32_t address, const uint8_t *buf, uint32_t len, int swap)
+{
+	mem_page_t *page;
+	uint32_t done = 0, offset, chunk, i, k;
+	int whole = TRUE;
+
+	while (done < len) {
+		offset = (address + done) & MEM_PAGE_MASK;
+		chunk = MEM_PAGE_SIZE - offset;
+		if (chunk > len - done) {
+			chunk = len - done;
+		}
+		page = mem_page(address + done, TRUE);
+		if (page != NULL) {
+			mem_mark_dirty(page);
+			if (!swap) {
+				memcpy(page->data + offset, buf + done, chunk);
+			} else {
+				for (i = 0; i < chunk; i++) {
+					k = done + i;
+					page->data[offset + i] = buf[(k | 0x3) < len ? k ^ 0x3 : k];
 				}
-				run(cycles);
-			}
-			break;
-		case 'I':
-		case 'i':
-			if (scanf("%u %i", &register_no, &register_value) != 2){
-				break;
 			}
-			CURRENT_STATE.REGS[register_no] = register_value;
-			NEXT_STATE.REGS[register_no] = register_value;
-			break;
-		case 'H':
-		case 'h':
-			if (scanf("%i", &hi_reg_value) != 1){
-				break;
-			}
-			CURRENT_STATE.HI = hi_reg_value; 
-			NEXT_STATE.HI = hi_reg_value; 
-			break;
-		case 'L':
-		case 'l':
-			if (scanf("%i", &lo_reg_value) != 1){
-				break;
+			if (page->decoded != NULL) {
+				memset(page->decoded, 0, (MEM_PAGE_SIZE / 4) * sizeof(decoded_inst_t));
+				if (page->jit) {
+					JIT_STALE = TRUE;
+				}
 			}
-			CURRENT_STATE.LO = lo_reg_value;
-			NEXT_STATE.LO = lo_reg_value;
-			break;
-		case 'P':
-		case 'p':
-			print_program(); 
-			break;
-		default:
-			printf("Invalid Command.\n");
-			break;
+		} else {
+			whole = FALSE;
+		}
+		done += chunk;
+	}
+	return whole;
+}
+
+/***************************************************************/
+/* LL: load a word and remember it, for the SC that follows                */
+/***************************************************************/
+uint32_t mem_load_linked(uint32_t address)
+{
+	uint8_t *p = mem_translate(address, 4, FALSE);
+	uint32_t value;
+
+	if (p != NULL && !(address & 0x3)) {
+		/* another core may be storing conditionally to the same word */
+		value = MEM_LE32(__atomic_load_n((uint32_t *)p, __ATOMIC_ACQUIRE));
+	} else {
+		value = mem_read_32(address);
 	}
+	MACHINE->ll_valid = TRUE;
+	MACHINE->ll_addr = address;
+	MACHINE->ll_value = value;
+	return value;
+}
+
+/***************************************************************/
+/* SC: store the word if it still holds what the last LL of the same  */
+/* address read, atomically against the other cores. Returns 1 on  */
+/* success, 0 (and no store) otherwise. Misaligned addresses fail       */
+/***************************************************************/
+uint32_t mem_store_conditional(uint32_t address, uint32_t value)
+{
+	uint8_t *p;
+	uint32_t expected;
+	int linked = MACHINE->ll_valid && MACHINE->ll_addr == address;
+
+	MACHINE->ll_valid = FALSE;
+	if (!linked || (address & 0x3)) {
+		smp_sc(FALSE);
+		return 0;
+	}
+	p = mem_translate(address, 4, TRUE);
+	if (p == NULL) {
+		smp_sc(FALSE);
+		return 0;
+	}
+	expected = MEM_LE32(MACHINE->ll_value);
+	if (!__atomic_compare_exchange_n((uint32_t *)p, &expected, MEM_LE32(value), FALSE,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		smp_sc(FALSE);
+		return 0;
+	}
+	smp_sc(TRUE);
+	return 1;
+}
+
+/***************************************************************/
+/* Execute one cycle                                                                                                              */
+/***************************************************************/
+void cycle() {                                                
+	decoded_inst_t *d = fetch_decoded(CURRENT_STATE.PC);
+	handle_instruction();
+	commit_state(d);
+	INSTRUCTION_COUNT++;
 }
 
 /***************************************************************/
 /* reset registers/memory and reload program                                                    */
 /***************************************************************/
 void reset() {   
-	int i;
-	/*reset registers*/
-	for (i = 0; i < MIPS_REGS; i++){
-		CURRENT_STATE.REGS[i] = 0;
+	pipe_reset();
+	profile_reset();
+
+	/* rewinding to the post-load snapshot only touches the pages the run dirtied */
+	if (SNAPSHOT_STATE == SNAPSHOT_LOAD) {
+		snapshot_restore();
+		syscall_reset(FALSE);
+		smp_start();
+		return;
 	}
-	CURRENT_STATE.HI = 0;
-	CURRENT_STATE.LO = 0;
-	
-	for (i = 0; i < NUM_MEM_REGION; i++) {
-		uint32_t region_size = MEM_REGIONS[i].end - MEM_REGIONS[i].begin + 1;
-		memset(MEM_REGIONS[i].mem, 0, region_size);
+	if (!machine_load(prog_file)) {
+		exit(-1);
+	}
+}
+
+/***************************************************************/
+/* A new machine with empty memory, made current for this thread.  */
+/* NULL if it or its timing model can't be allocated                       */
+/***************************************************************/
+machine_t *machine_create() {
+	machine_t *m = calloc(1, sizeof(machine_t));
+
+	if (m == NULL) {
+		printf("Error: Can't allocate a machine\n");
+		return NULL;
+	}
+	MACHINE = m;
+	m->mem = &m->own_mem;
+	m->proc = &m->own_proc;
+	init_memory();
+	if (!timing_init()) {
+		machine_destroy(m);
+		return NULL;
+	}
+	return m;
+}
+
+/***************************************************************/
+/* Free a machine and everything it allocated                                        */
+/***************************************************************/
+void machine_destroy(machine_t *m) {
+	machine_t *current = MACHINE;
+
+	MACHINE = m;
+	smp_release();
+	syscall_release();
+	trace_sink_close();
+	if (m->mem == &m->own_mem) {
+		free_memory();
+		profile_reset();
+	}
+	profile_release();
+	jit_release();
+	timing_release();
+	debug_release();
+	free(m);
+	MACHINE = current == m ? NULL : current;
+}
+
+/***************************************************************/
+/* Load a program into the current machine, replacing whatever it  */
+/* held, and snapshot it so reset() can rewind cheaply. FALSE if the  */
+/* file can't be loaded                                                                                 */
+/***************************************************************/
+int machine_load(const char *path) {
+	if (strlen(path) >= PROG_FILE_SIZE) {
+		printf("Error: Program file name %s is too long\n", path);
+		return FALSE;
+	}
+	if (path != prog_file) {
+		strcpy(prog_file, path);
+	}
+	free_memory();
+	pipe_reset();
+	profile_reset();
+	memset(&CURRENT_STATE, 0, sizeof(CURRENT_STATE));
+	syscall_reset(TRUE);
+	if (!load_program()) {
+		return FALSE;
 	}
-	
-	/*load program*/
-	load_program();
-	
-	/*reset PC*/
 	INSTRUCTION_COUNT = 0;
-	CURRENT_STATE.PC =  MEM_TEXT_BEGIN;
+	CURRENT_STATE.PC = PROGRAM_ENTRY;
 	NEXT_STATE = CURRENT_STATE;
 	RUN_FLAG = TRUE;
+	MACHINE->ll_valid = FALSE;
+	/* the points are marked on pages that were just replaced */
+	debug_apply();
+	/* without the snapshot reset() loads the file again */
+	snapshot_save(SNAPSHOT_LOAD);
+	trace_sink_state(TRUE);
+	/* the other cores start from the same state */
+	return smp_start();
 }
 
 /***************************************************************/
-/* Allocate and set memory to zero                                                                            */
+/* Start with an empty address space, pages are created on first write */
 /***************************************************************/
 void init_memory() {                                           
 	int i;
-	for (i = 0; i < NUM_MEM_REGION; i++) {
-		uint32_t region_size = MEM_REGIONS[i].end - MEM_REGIONS[i].begin + 1;
-		MEM_REGIONS[i].mem = malloc(region_size);
-		memset(MEM_REGIONS[i].mem, 0, region_size);
+	MEM_PAGES = NULL;
+	MEM_DIRTY = NULL;
+	for (i = 0; i < MEM_DIR_SIZE; i++) {
+		MEM_PAGE_DIR[i] = NULL;
 	}
+	mem_tlb_flush();
+	FETCH_VPN = MEM_TLB_INVALID;
+	FETCH_PAGE = NULL;
+	/* the snapshot lived in the pages */
+	SNAPSHOT_STATE = SNAPSHOT_NONE;
 }
 
-/**************************************************************/
-/* load program into memory                                                                                      */
-/**************************************************************/
-void load_program() {                   
-	FILE * fp;
-	int i, word;
-	uint32_t address;
-
-	/* Open program file. */
-	fp = fopen(prog_file, "r");
-	if (fp == NULL) {
-		printf("Error: Can't open program file %s\n", prog_file);
-		exit(-1);
+/***************************************************************/
+/* Drop every load and store translation, on every core when the     */
+/* memory is shared                                                                                    */
+/***************************************************************/
+void mem_tlb_flush() {
+	int i;
+	for (i = 0; i < MEM_TLB_SIZE; i++) {
+		MEM_TLB[i].vpn = MEM_TLB_INVALID;
+		MEM_TLB[i].page = NULL;
+		MEM_WTLB[i].vpn = MEM_TLB_INVALID;
+		MEM_WTLB[i].page = NULL;
 	}
+	if (MACHINE->smp != NULL && MACHINE->core == 0) {
+		smp_tlb_flush();
+	}
+}
 
-	/* Read in the program. */
-
-	i = 0;
-	while( fscanf(fp, "%x\n", &word) != EOF ) {
-		address = MEM_TEXT_BEGIN + i;
-		mem_write_32(address, word);
-		printf("writing 0x%08x into address 0x%08x (%d)\n", word, address, address);
-		i += 4;
+/***************************************************************/
+/* Release every materialized page, memory reads as zero again      */
+/***************************************************************/
+void free_memory() {
+	int i;
+	mem_page_t *page, *next;
+	for (page = MEM_PAGES; page != NULL; page = next) {
+		next = page->next;
+		free(page->decoded);
+		free(page->profile);
+		free(page->saved);
+		free(page->breaks);
+		free(page);
 	}
-	PROGRAM_SIZE = i/4;
-	printf("Program loaded into memory.\n%d words written into memory.\n\n", PROGRAM_SIZE);
-	fclose(fp);
+	for (i = 0; i < MEM_DIR_SIZE; i++) {
+		free(MEM_PAGE_DIR[i]);
+	}
+	init_memory();
+	/* translations point into the pages just freed */
+	JIT_STALE = TRUE;
 }
 
 /************************************************************/
-/* decode and execute instruction                                                                     */ 
+/* Decode an instruction word into its cache entry                               */
 /************************************************************/
-void handle_instruction()
+void decode_instruction(uint32_t addr, uint32_t instruction, decoded_inst_t *d)
 {
-    printf("%X ", mem_read_32(CURRENT_STATE.PC));
-	/*IMPLEMENT THIS*/
-	/* execute one instruction at a time. Use/update CURRENT_STATE and and NEXT_STATE, as necessary.*/
-	uint32_t instruction, opcode, function, rs, rt, rd, sa, immediate, target;
-	uint64_t product, p1, p2;
-	
-	uint32_t addr, data;
-	
-	int branch_jump = FALSE;
-	
-	printf("[0x%x]\t", CURRENT_STATE.PC);
-	
-	instruction = mem_read_32(CURRENT_STATE.PC);
-	
+	uint32_t opcode, function, immediate;
+
 	opcode = (instruction & 0xFC000000) >> 26;
 	function = instruction & 0x0000003F;
-	rs = (instruction & 0x03E00000) >> 21;
-	rt = (instruction & 0x001F0000) >> 16;
-	rd = (instruction & 0x0000F800) >> 11;
-	sa = (instruction & 0x000007C0) >> 6;
 	immediate = instruction & 0x0000FFFF;
-	target = instruction & 0x03FFFFFF;
-	
+
+	d->word = instruction;
+	d->rs = (instruction & 0x03E00000) >> 21;
+	d->rt = (instruction & 0x001F0000) >> 16;
+	d->rd = (instruction & 0x0000F800) >> 11;
+	d->sa = (instruction & 0x000007C0) >> 6;
+	d->imm = (int32_t)(int16_t)immediate;
+	d->target = addr + (d->imm << 2);   /* branch target, overwritten for jumps */
+	d->op = OP_UNIMPLEMENTED;
+
 	if(opcode == 0x00){
 		switch(function){
-			case 0x00: //SLL
-				NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rt] << sa;
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x02: //SRL
-				NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rt] >> sa;
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x03: //SRA 
-				if ((CURRENT_STATE.REGS[rt] & 0x80000000) == 1)
-				{
-					NEXT_STATE.REGS[rd] =  ~(~CURRENT_STATE.REGS[rt] >> sa );
-				}
-				else{
-					NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rt] >> sa;
-				}
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x08: //JR
-				NEXT_STATE.PC = CURRENT_STATE.REGS[rs];
-				branch_jump = TRUE;
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x09: //JALR
-				NEXT_STATE.REGS[rd] = CURRENT_STATE.PC + 4;
-				NEXT_STATE.PC = CURRENT_STATE.REGS[rs];
-				branch_jump = TRUE;
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x0C: //SYSCALL
-				if(CURRENT_STATE.REGS[2] == 0xa){
-					RUN_FLAG = FALSE;
-					print_instruction(CURRENT_STATE.PC);
-				}
-				break;
-			case 0x10: //MFHI
-				NEXT_STATE.REGS[rd] = CURRENT_STATE.HI;
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x11: //MTHI
-				NEXT_STATE.HI = CURRENT_STATE.REGS[rs];
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x12: //MFLO
-				NEXT_STATE.REGS[rd] = CURRENT_STATE.LO;
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x13: //MTLO
-				NEXT_STATE.LO = CURRENT_STATE.REGS[rs];
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x18: //MULT
-				if ((CURRENT_STATE.REGS[rs] & 0x80000000) == 0x80000000){
-					p1 = 0xFFFFFFFF00000000 | CURRENT_STATE.REGS[rs];
-				}else{
-					p1 = 0x00000000FFFFFFFF & CURRENT_STATE.REGS[rs];
-				}
-				if ((CURRENT_STATE.REGS[rt] & 0x80000000) == 0x80000000){
-					p2 = 0xFFFFFFFF00000000 | CURRENT_STATE.REGS[rt];
-				}else{
-					p2 = 0x00000000FFFFFFFF & CURRENT_STATE.REGS[rt];
-				}
-				product = p1 * p2;
-				NEXT_STATE.LO = (product & 0X00000000FFFFFFFF);
-				NEXT_STATE.HI = (product & 0XFFFFFFFF00000000)>>32;
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x19: //MULTU
-				product = (uint64_t)CURRENT_STATE.REGS[rs] * (uint64_t)CURRENT_STATE.REGS[rt];
-				NEXT_STATE.LO = (product & 0X00000000FFFFFFFF);
-				NEXT_STATE.HI = (product & 0XFFFFFFFF00000000)>>32;
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x1A: //DIV 
-				if(CURRENT_STATE.REGS[rt] != 0)
-				{
-					NEXT_STATE.LO = (int32_t)CURRENT_STATE.REGS[rs] / (int32_t)CURRENT_STATE.REGS[rt];
-					NEXT_STATE.HI = (int32_t)CURRENT_STATE.REGS[rs] % (int32_t)CURRENT_STATE.REGS[rt];
-				}
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x1B: //DIVU
-				if(CURRENT_STATE.REGS[rt] != 0)
-				{
-					NEXT_STATE.LO = CURRENT_STATE.REGS[rs] / CURRENT_STATE.REGS[rt];
-					NEXT_STATE.HI = CURRENT_STATE.REGS[rs] % CURRENT_STATE.REGS[rt];
-				}
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x20: //ADD
-				NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rs] + CURRENT_STATE.REGS[rt];
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x21: //ADDU 
-				NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rt] + CURRENT_STATE.REGS[rs];
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x22: //SUB
-				NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rs] - CURRENT_STATE.REGS[rt];
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x23: //SUBU
-				NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rs] - CURRENT_STATE.REGS[rt];
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x24: //AND
-				NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rs] & CURRENT_STATE.REGS[rt];
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x25: //OR
-				NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rs] | CURRENT_STATE.REGS[rt];
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x26: //XOR
-				NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rs] ^ CURRENT_STATE.REGS[rt];
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x27: //NOR
-				NEXT_STATE.REGS[rd] = ~(CURRENT_STATE.REGS[rs] | CURRENT_STATE.REGS[rt]);
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x2A: //SLT
-				if(CURRENT_STATE.REGS[rs] < CURRENT_STATE.REGS[rt]){
-					NEXT_STATE.REGS[rd] = 0x1;
-				}
-				else{
-					NEXT_STATE.REGS[rd] = 0x0;
-				}
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			default:
-				printf("Instruction at 0x%x is not implemented!\n", CURRENT_STATE.PC);
-				break;
+			case 0x00: d->op = OP_SLL; break;
+			case 0x02: d->op = OP_SRL; break;
+			case 0x03: d->op = OP_SRA; break;
+			case 0x08: d->op = OP_JR; break;
+			case 0x09: d->op = OP_JALR; break;
+			case 0x0C: d->op = OP_SYSCALL; break;
+			case 0x10: d->op = OP_MFHI; break;
+			case 0x11: d->op = OP_MTHI; break;
+			case 0x12: d->op = OP_MFLO; break;
+			case 0x13: d->op = OP_MTLO; break;
+			case 0x18: d->op = OP_MULT; break;
+			case 0x19: d->op = OP_MULTU; break;
+			case 0x1A: d->op = OP_DIV; break;
+			case 0x1B: d->op = OP_DIVU; break;
+			case 0x20: d->op = OP_ADD; break;
+			case 0x21: d->op = OP_ADDU; break;
+			case 0x22: d->op = OP_SUB; break;
+			case 0x23: d->op = OP_SUBU; break;
+			case 0x24: d->op = OP_AND; break;
+			case 0x25: d->op = OP_OR; break;
+			case 0x26: d->op = OP_XOR; break;
+			case 0x27: d->op = OP_NOR; break;
+			case 0x2A: d->op = OP_SLT; break;
 		}
 	}
 	else{
 		switch(opcode){
 			case 0x01:
-				if(rt == 0x00000){ //BLTZ
-					if((CURRENT_STATE.REGS[rs] & 0x80000000) > 0){
-						NEXT_STATE.PC = CURRENT_STATE.PC + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000)<<2 : (immediate & 0x0000FFFF)<<2);
-						branch_jump = TRUE;
-					}
-					print_instruction(CURRENT_STATE.PC);
-				}
-				else if(rt == 0x00001){ //BGEZ
-					if((CURRENT_STATE.REGS[rs] & 0x80000000) == 0x0){
-						NEXT_STATE.PC = CURRENT_STATE.PC + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000)<<2 : (immediate & 0x0000FFFF)<<2);
-						branch_jump = TRUE;
-					}
-					print_instruction(CURRENT_STATE.PC);
-				}
-				break;
-			case 0x02: //J
-				NEXT_STATE.PC = (CURRENT_STATE.PC & 0xF0000000) | (target << 2);
-				branch_jump = TRUE;
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x03: //JAL
-				NEXT_STATE.PC = (CURRENT_STATE.PC & 0xF0000000) | (target << 2);
-				NEXT_STATE.REGS[31] = CURRENT_STATE.PC + 4;
-				branch_jump = TRUE;
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x04: //BEQ
-				if(CURRENT_STATE.REGS[rs] == CURRENT_STATE.REGS[rt]){
-					NEXT_STATE.PC = CURRENT_STATE.PC + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000)<<2 : (immediate & 0x0000FFFF)<<2);
-					branch_jump = TRUE;
-				}
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x05: //BNE
-				if(CURRENT_STATE.REGS[rs] != CURRENT_STATE.REGS[rt]){
-					NEXT_STATE.PC = CURRENT_STATE.PC + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000)<<2 : (immediate & 0x0000FFFF)<<2);
-					branch_jump = TRUE;
-				}
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x06: //BLEZ
-				if((CURRENT_STATE.REGS[rs] & 0x80000000) > 0 || CURRENT_STATE.REGS[rs] == 0){
-					NEXT_STATE.PC = CURRENT_STATE.PC +  ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000)<<2 : (immediate & 0x0000FFFF)<<2);
-					branch_jump = TRUE;
-				}
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x07: //BGTZ
-				if((CURRENT_STATE.REGS[rs] & 0x80000000) == 0x0 || CURRENT_STATE.REGS[rs] != 0){
-					NEXT_STATE.PC = CURRENT_STATE.PC +  ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000)<<2 : (immediate & 0x0000FFFF)<<2);
-					branch_jump = TRUE;
+				if(d->rt == 0x00){
+					d->op = OP_BLTZ;
+				}else if(d->rt == 0x01){
+					d->op = OP_BGEZ;
 				}
-				print_instruction(CURRENT_STATE.PC);
 				break;
-			case 0x08: //ADDI
-				NEXT_STATE.REGS[rt] = CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF));
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x09: //ADDIU
-				NEXT_STATE.REGS[rt] = CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF));
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x0A: //SLTI
-				if ( (  (int32_t)CURRENT_STATE.REGS[rs] - (int32_t)( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF))) < 0){
-					NEXT_STATE.REGS[rt] = 0x1;
-				}else{
-					NEXT_STATE.REGS[rt] = 0x0;
+			case 0x02: d->op = OP_J; d->target = (addr & 0xF0000000) | ((instruction & 0x03FFFFFF) << 2); break;
+			case 0x03: d->op = OP_JAL; d->target = (addr & 0xF0000000) | ((instruction & 0x03FFFFFF) << 2); break;
+			case 0x04: d->op = OP_BEQ; break;
+			case 0x05: d->op = OP_BNE; break;
+			case 0x06: d->op = OP_BLEZ; break;
+			case 0x07: d->op = OP_BGTZ; break;
+			case 0x08: d->op = OP_ADDI; break;
+			case 0x09: d->op = OP_ADDIU; break;
+			case 0x0A: d->op = OP_SLTI; break;
+			case 0x0C: d->op = OP_ANDI; d->imm = immediate; break;
+			case 0x0D: d->op = OP_ORI; d->imm = immediate; break;
+			case 0x0E: d->op = OP_XORI; d->imm = immediate; break;
+			case 0x0F: d->op = OP_LUI; d->imm = immediate << 16; break;
+			case 0x20: d->op = OP_LB; break;
+			case 0x21: d->op = OP_LH; break;
+			case 0x23: d->op = OP_LW; break;
+			case 0x24: d->op = OP_LBU; break;
+			case 0x25: d->op = OP_LHU; break;
+			case 0x28: d->op = OP_SB; break;
+			case 0x29: d->op = OP_SH; break;
+			case 0x2B: d->op = OP_SW; break;
+			case 0x30: d->op = OP_LL; break;
+			case 0x38: d->op = OP_SC; break;
+		}
+	}
+
+	/* the one GPR the instruction writes, committed by commit_state() */
+	switch(d->op){
+		case OP_SLL: case OP_SRL: case OP_SRA: case OP_JALR: case OP_MFHI: case OP_MFLO:
+		case OP_ADD: case OP_ADDU: case OP_SUB: case OP_SUBU:
+		case OP_AND: case OP_OR: case OP_XOR: case OP_NOR: case OP_SLT:
+			d->wb = d->rd;
+			break;
+		case OP_ADDI: case OP_ADDIU: case OP_SLTI: case OP_ANDI: case OP_ORI: case OP_XORI: case OP_LUI:
+		case OP_LB: case OP_LH: case OP_LW: case OP_LBU: case OP_LHU: case OP_LL: case OP_SC:
+			d->wb = d->rt;
+			break;
+		case OP_JAL:
+			d->wb = 31;
+			break;
+		case OP_SYSCALL:
+			d->wb = 2;   /* the result, see mu-mips-syscall.c */
+			break;
+		default:
+			d->wb = 0;   /* copying R0 onto itself is harmless */
+			break;
+	}
+	d->wb_args = d->op == OP_SYSCALL;
+}
+
+/************************************************************/
+/* Drop the cached decoding of the words a store may overwrite         */
+/************************************************************/
+void decode_invalidate(mem_page_t *page, uint32_t address)
+{
+	uint32_t offset = address & MEM_PAGE_MASK;
+
+	__atomic_store_n(&page->decoded[offset >> 2].op, OP_INVALID, __ATOMIC_RELAXED);
+	if (offset + 3 < MEM_PAGE_SIZE) {
+		__atomic_store_n(&page->decoded[(offset + 3) >> 2].op, OP_INVALID, __ATOMIC_RELAXED);
+	}
+	if (page->jit) {
+		JIT_STALE = TRUE;
+	}
+}
+
+/************************************************************/
+/* Decode into an entry of a shared page. Only one core fills it,     */
+/* the others see the op last, once the rest is in place                */
+/************************************************************/
+static void decode_shared(uint32_t addr, decoded_inst_t *d)
+{
+	decoded_inst_t e;
+
+	decode_instruction(addr, mem_peek(addr, 4), &e);
+	mem_lock();
+	if (d->op == OP_INVALID) {
+		d->rs = e.rs;
+		d->rt = e.rt;
+		d->rd = e.rd;
+		d->sa = e.sa;
+		d->wb = e.wb;
+		d->wb_args = e.wb_args;
+		d->imm = e.imm;
+		d->target = e.target;
+		d->word = e.word;
+		__atomic_store_n(&d->op, e.op, __ATOMIC_RELEASE);
+	}
+	mem_unlock();
+}
+
+/************************************************************/
+/* Give a page its decode cache                                                               */
+/************************************************************/
+static void decode_alloc(mem_page_t *page, uint32_t addr)
+{
+	decoded_inst_t *decoded;
+
+	mem_lock();
+	if (page->decoded == NULL) {
+		decoded = calloc(MEM_PAGE_SIZE / 4, sizeof(decoded_inst_t));
+		if (decoded == NULL) {
+			printf("Error: Can't allocate decode cache for address 0x%08x\n", addr);
+			exit(-1);
+		}
+		__atomic_store_n(&page->decoded, decoded, __ATOMIC_RELEASE);
+	}
+	mem_unlock();
+}
+
+/************************************************************/
+/* Fetch the decoded instruction at addr, decoding it on first use     */
+/************************************************************/
+decoded_inst_t *fetch_decoded(uint32_t addr)
+{
+	decoded_inst_t *d;
+	uint32_t word;
+
+	if ((addr >> MEM_PAGE_SHIFT) != FETCH_VPN) {
+		FETCH_PAGE = mem_page(addr, TRUE);
+		if (FETCH_PAGE == NULL || (addr & 0x3)) {
+			/* unmapped or misaligned fetch, decode it every time */
+			FETCH_VPN = MEM_TLB_INVALID;
+			decode_instruction(addr, mem_peek(addr, 4), &MACHINE->uncached);
+			return &MACHINE->uncached;
+		}
+		if (__atomic_load_n(&FETCH_PAGE->decoded, __ATOMIC_ACQUIRE) == NULL) {
+			decode_alloc(FETCH_PAGE, addr);
+			/* later stores into this page must take the invalidating slow path */
+			if (MEM_WTLB[FETCH_PAGE->vpn & (MEM_TLB_SIZE - 1)].vpn == FETCH_PAGE->vpn) {
+				MEM_WTLB[FETCH_PAGE->vpn & (MEM_TLB_SIZE - 1)].vpn = MEM_TLB_INVALID;
+			}
+		}
+		FETCH_VPN = addr >> MEM_PAGE_SHIFT;
+	}
+
+	word = (addr & MEM_PAGE_MASK) >> 2;
+	d = &FETCH_PAGE->decoded[word];
+	if (__atomic_load_n(&d->op, __ATOMIC_ACQUIRE) == OP_INVALID) {
+		if (MEM_LOCK != NULL) {
+			decode_shared(addr, d);
+		} else {
+			decode_instruction(addr, mem_peek(addr, 4), d);
+		}
+		if (FETCH_PAGE->breaks != NULL && (FETCH_PAGE->breaks[word >> 5] >> (word & 31)) & 1) {
+			/* the rest of the entry still describes the instruction, see debug_break() */
+			d->op = OP_BREAKPOINT;
+		}
+	}
+	return d;
+}
+
+/************************************************************/
+/* Append the record of an instruction that has executed but not yet  */
+/* committed, flushing when the buffer fills. See mu-mips-trace.h         */
+/************************************************************/
+static void trace_sink_write(const decoded_inst_t *d)
+{
+	uint32_t pc = CURRENT_STATE.PC, addr;
+	uint32_t *slot = TRACE_WORDS[(pc >> 2) & (TRACE_WORD_CACHE - 1)];
+	uint8_t *flags, *p;
+	decoded_inst_t e;
+	int size;
+
+	if (d->op == OP_BREAKPOINT) {
+		/* record the instruction that executed under the breakpoint */
+		decode_instruction(pc, d->word, &e);
+		d = &e;
+	}
+	if (TRACE_LEN + TRACE_RECORD_MAX > TRACE_BUFFER_SIZE) {
+		trace_sink_flush();
+	}
+	flags = TRACE_BUFFER + TRACE_LEN;
+	p = flags + 1;
+	*flags = 0;
+	if (pc != TRACE_PC + 4) {
+		*flags |= TRACE_JUMP;
+		p = trace_put_delta(p, pc - (TRACE_PC + 4));
+	}
+	TRACE_PC = pc;
+	if (slot[0] != pc || slot[1] != d->word) {
+		*flags |= TRACE_WORD;
+		p = trace_put32(p, d->word);
+		slot[0] = pc;
+		slot[1] = d->word;
+	}
+	if (d->wb != 0 && NEXT_STATE.REGS[d->wb] != CURRENT_STATE.REGS[d->wb]) {
+		*flags |= TRACE_REG;
+		*p++ = d->wb;
+		p = trace_put_delta(p, NEXT_STATE.REGS[d->wb] - CURRENT_STATE.REGS[d->wb]);
+	}
+	if (NEXT_STATE.HI != CURRENT_STATE.HI || NEXT_STATE.LO != CURRENT_STATE.LO) {
+		*flags |= TRACE_HILO;
+		p = trace_put_delta(p, NEXT_STATE.HI - CURRENT_STATE.HI);
+		p = trace_put_delta(p, NEXT_STATE.LO - CURRENT_STATE.LO);
+	}
+	size = trace_mem_size(d->op);
+	if (size != 0) {
+		/* memory holds the value loaded or just stored */
+		*flags |= TRACE_MEM;
+		addr = CURRENT_STATE.REGS[d->rs] + d->imm;
+		p = trace_put_delta(p, addr - TRACE_ADDR);
+		TRACE_ADDR = addr;
+		p = trace_put_varint(p, mem_peek(addr, size));
+	}
+	if (d->wb_args && (NEXT_STATE.REGS[4] != CURRENT_STATE.REGS[4] || NEXT_STATE.REGS[5] != CURRENT_STATE.REGS[5])) {
+		*flags |= TRACE_ARGS;
+		p = trace_put_delta(p, NEXT_STATE.REGS[4] - CURRENT_STATE.REGS[4]);
+		p = trace_put_delta(p, NEXT_STATE.REGS[5] - CURRENT_STATE.REGS[5]);
+	}
+	TRACE_LEN = p - TRACE_BUFFER;
+}
+
+/************************************************************/
+/* Print the trace line of an instruction about to execute                  */
+/************************************************************/
+static inline void trace_before(decoded_inst_t *d)
+{
+	if (TRACE) {
+		printf("%X ", d->word);
+		printf("[0x%x]\t", CURRENT_STATE.PC);
+	}
+}
+
+/************************************************************/
+/* Finish the trace line once the instruction has executed               */
+/************************************************************/
+static inline void trace_after(decoded_inst_t *d)
+{
+	if (DEBUG_HELD(d)) {
+		/* it executes, and is traced, when the run resumes */
+		if (TRACE) {
+			printf("breakpoint\n");
+		}
+		return;
+	}
+	if (TRACE_FILE != NULL) {
+		trace_sink_write(d);
+	}
+	if (PROFILE) {
+		profile_after(d);
+	}
+	if (TRACE && d->op != OP_UNIMPLEMENTED) {
+		print_instruction(CURRENT_STATE.PC);
+	}
+}
+
+/************************************************************/
+/* Handler table: one function per handler index                               */
+/************************************************************/
+typedef void (*exec_fn_t)(decoded_inst_t *d);
+
+#define X(name, ...) static void exec_##name(decoded_inst_t *d) { __VA_ARGS__ }
+MIPS_OPS(X)
+#undef X
+
+static const exec_fn_t EXEC_TABLE[NUM_OPS] = {
+	[OP_INVALID] = exec_UNIMPLEMENTED,
+#define X(name, ...) [OP_##name] = exec_##name,
+	MIPS_OPS(X)
+#undef X
+};
+
+#define ENGINE_TRACE 1
+#define ENGINE_SUFFIX _trace
+#include "mu-mips-engine.h"
+#undef ENGINE_TRACE
+#undef ENGINE_SUFFIX
+
+#define ENGINE_TRACE 0
+#define ENGINE_PROFILE 1
+#define ENGINE_SUFFIX _profile
+#include "mu-mips-engine.h"
+#undef ENGINE_PROFILE
+#undef ENGINE_SUFFIX
+
+#define ENGINE_PROFILE 0
+#define ENGINE_SUFFIX _quiet
+#include "mu-mips-engine.h"
+#undef ENGINE_TRACE
+#undef ENGINE_PROFILE
+#undef ENGINE_SUFFIX
+
+/************************************************************/
+/* Execute d as if it had decoded to op                                                     */
+/************************************************************/
+void execute_as(decoded_inst_t *d, uint8_t op)
+{
+	EXEC_TABLE[op](d);
+}
+
+/************************************************************/
+/* decode and execute instruction                                                                     */ 
+/************************************************************/
+void handle_instruction()
+{
+	/* execute one instruction at a time. Use/update CURRENT_STATE and and NEXT_STATE, as necessary.*/
+	step_switch_trace();
+}
+
+/************************************************************/
+/* Execute up to max instructions with the selected timing model,      */
+/* on every core of a multicore machine. Returns how many ran on      */
+/* core 0 before the program stopped                                                   */
+/************************************************************/
+uint32_t run_engine(uint32_t max)
+{
+	if (MACHINE->smp != NULL) {
+		return smp_run(max);
+	}
+	if (MACHINE->debug != NULL) {
+		return debug_run(max);
+	}
+	return run_core(max);
+}
+
+/************************************************************/
+/* Run the current core alone                                                                   */
+/************************************************************/
+uint32_t run_core(uint32_t max)
+{
+	uint32_t n;
+
+	switch (TIMING) {
+		case TIMING_PIPELINE:
+			n = pipe_run(max);
+			break;
+		case TIMING_SAMPLED:
+			n = sample_run(max);
+			break;
+		case TIMING_OOO:
+			n = ooo_run(max);
+			break;
+		default:
+			n = run_functional(max);
+			break;
+	}
+	/* console output goes out once per run, not once per syscall */
+	syscall_flush();
+	return n;
+}
+
+/************************************************************/
+/* Execute up to max instructions with the selected engine and no     */
+/* timing. The quiet engines are used whenever there is nothing to      */
+/* trace.                                                                                                    */
+/************************************************************/
+uint32_t run_functional(uint32_t max)
+{
+	uint32_t n;
+
+	if (PROFILE && !TRACE && TRACE_FILE == NULL) {
+		/* translated code is not profiled either */
+		switch (ENGINE) {
+			case ENGINE_TABLE:
+				return run_table_profile(max);
+			case ENGINE_SWITCH:
+				return run_switch_profile(max);
+			default:
+				return run_threaded_profile(max);
+		}
+	}
+	if (!TRACE && TRACE_FILE == NULL) {
+		switch (ENGINE) {
+			case ENGINE_TABLE:
+				return run_table_quiet(max);
+			case ENGINE_THREADED:
+				return run_threaded_quiet(max);
+			case ENGINE_JIT:
+				/* translated code has no breakpoints or watchpoints */
+				if (MACHINE->debug != NULL && MACHINE->debug->num_points > 0) {
+					return run_interpreter(max);
 				}
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x0C: //ANDI
-				NEXT_STATE.REGS[rt] = CURRENT_STATE.REGS[rs] & (immediate & 0x0000FFFF);
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x0D: //ORI
-				NEXT_STATE.REGS[rt] = CURRENT_STATE.REGS[rs] | (immediate & 0x0000FFFF);
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x0E: //XORI
-				NEXT_STATE.REGS[rt] = CURRENT_STATE.REGS[rs] ^ (immediate & 0x0000FFFF);
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x0F: //LUI
-				NEXT_STATE.REGS[rt] = immediate << 16;
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x20: //LB
-				data = mem_read_32( CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF)) );
-				NEXT_STATE.REGS[rt] = ((data & 0x000000FF) & 0x80) > 0 ? (data | 0xFFFFFF00) : (data & 0x000000FF);
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x21: //LH
-				data = mem_read_32( CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF)) );
-				NEXT_STATE.REGS[rt] = ((data & 0x0000FFFF) & 0x8000) > 0 ? (data | 0xFFFF0000) : (data & 0x0000FFFF);
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x23: //LW
-				NEXT_STATE.REGS[rt] = mem_read_32( CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF)) );
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x28: //SB
-				addr = CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF));
-				data = mem_read_32( addr);
-				data = (data & 0xFFFFFF00) | (CURRENT_STATE.REGS[rt] & 0x000000FF);
-				mem_write_32(addr, data);
-				print_instruction(CURRENT_STATE.PC);				
-				break;
-			case 0x29: //SH
-				addr = CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF));
-				data = mem_read_32( addr);
-				data = (data & 0xFFFF0000) | (CURRENT_STATE.REGS[rt] & 0x0000FFFF);
-				mem_write_32(addr, data);
-				print_instruction(CURRENT_STATE.PC);
-				break;
-			case 0x2B: //SW
-				addr = CURRENT_STATE.REGS[rs] + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF));
-				mem_write_32(addr, CURRENT_STATE.REGS[rt]);
-				print_instruction(CURRENT_STATE.PC);
-				break;
+				return jit_run(max);
 			default:
-				// put more things here
-				printf("Instruction at 0x%x is not implemented!\n", CURRENT_STATE.PC);
-				break;
+				return run_switch_quiet(max);
 		}
 	}
-	
-	if(!branch_jump){
-		NEXT_STATE.PC = CURRENT_STATE.PC + 4;
+
+	/* translated code cannot be traced, the JIT engine traces through the threaded interpreter */
+	switch (ENGINE) {
+		case ENGINE_TABLE:
+			n = run_table_trace(max);
+			break;
+		case ENGINE_THREADED:
+		case ENGINE_JIT:
+			n = run_threaded_trace(max);
+			break;
+		default:
+			n = run_switch_trace(max);
+			break;
+	}
+	trace_sink_flush();
+	return n;
+}
+
+/************************************************************/
+/* Execute and commit the instruction at PC on the reference engine,  */
+/* for the timing models                                                                          */
+/************************************************************/
+decoded_inst_t *execute_instruction()
+{
+	decoded_inst_t *d;
+
+	if (TRACE || TRACE_FILE != NULL) {
+		d = step_switch_trace();
+	} else if (PROFILE) {
+		d = step_switch_profile();
+	} else {
+		d = step_switch_quiet();
+	}
+	commit_state(d);
+	INSTRUCTION_COUNT++;
+	return d;
+}
+
+/************************************************************/
+/* Quiet interpreter used where translated code cannot run              */
+/************************************************************/
+uint32_t run_interpreter(uint32_t max)
+{
+	return run_threaded_quiet(max);
+}
+
+/************************************************************/
+/* Start recording executed instructions to a binary trace file,         */
+/* beginning with the current state                                                        */
+/************************************************************/
+int trace_sink_open(const char *path)
+{
+	uint8_t version[4];
+
+	trace_sink_close();
+	TRACE_FILE = fopen(path, "wb");
+	if (TRACE_FILE == NULL) {
+		printf("Error: Can't open trace file %s\n", path);
+		return FALSE;
+	}
+	TRACE_LEN = 0;
+	TRACE_ADDR = 0;
+	memset(TRACE_WORDS, 0, sizeof(TRACE_WORDS));
+	fwrite(TRACE_MAGIC, 1, 4, TRACE_FILE);
+	trace_put32(version, TRACE_VERSION);
+	fwrite(version, 1, 4, TRACE_FILE);
+	trace_sink_state(TRUE);
+	return TRUE;
+}
+
+/************************************************************/
+/* Record the registers after they changed outside execution. With     */
+/* reload set memory was reset too, to the program image as it is after */
+/* the current instruction count                                                             */
+/************************************************************/
+void trace_sink_state(int reload)
+{
+	uint8_t *p;
+	uint32_t len = strlen(prog_file);
+	int i;
+
+	if (TRACE_FILE == NULL) {
+		return;
+	}
+	if (TRACE_LEN + TRACE_RECORD_MAX + 2 * len > TRACE_BUFFER_SIZE) {
+		trace_sink_flush();
+	}
+	p = TRACE_BUFFER + TRACE_LEN;
+	if (reload) {
+		*p++ = TRACE_RELOAD;
+		p = trace_put_varint64(p, INSTRUCTION_COUNT);
+		p = trace_put_varint(p, len);
+		memcpy(p, prog_file, len);
+		p += len;
+	}
+	*p++ = TRACE_REGS;
+	p = trace_put32(p, (uint32_t)INSTRUCTION_COUNT);
+	p = trace_put32(p, (uint32_t)(INSTRUCTION_COUNT >> 32));
+	p = trace_put32(p, CURRENT_STATE.PC);
+	for (i = 0; i < MIPS_REGS; i++) {
+		p = trace_put32(p, CURRENT_STATE.REGS[i]);
+	}
+	p = trace_put32(p, CURRENT_STATE.HI);
+	p = trace_put32(p, CURRENT_STATE.LO);
+	TRACE_LEN = p - TRACE_BUFFER;
+	/* the next instruction is not a jump */
+	TRACE_PC = CURRENT_STATE.PC - 4;
+}
+
+/************************************************************/
+/* Record a memory word written outside execution                                */
+/************************************************************/
+void trace_sink_poke(uint32_t address, uint32_t value)
+{
+	uint8_t *p;
+
+	if (TRACE_FILE == NULL) {
+		return;
+	}
+	if (TRACE_LEN + TRACE_RECORD_MAX > TRACE_BUFFER_SIZE) {
+		trace_sink_flush();
+	}
+	p = TRACE_BUFFER + TRACE_LEN;
+	*p++ = TRACE_POKE;
+	p = trace_put32(p, address);
+	p = trace_put32(p, value);
+	TRACE_LEN = p - TRACE_BUFFER;
+}
+
+/************************************************************/
+/* Write out buffered trace records                                                         */
+/************************************************************/
+void trace_sink_flush()
+{
+	if (TRACE_FILE != NULL && TRACE_LEN > 0) {
+		fwrite(TRACE_BUFFER, 1, TRACE_LEN, TRACE_FILE);
+		fflush(TRACE_FILE);
+	}
+	TRACE_LEN = 0;
+}
+
+/************************************************************/
+/* Flush and close the binary trace                                                        */
+/************************************************************/
+void trace_sink_close()
+{
+	if (TRACE_FILE != NULL) {
+		trace_sink_flush();
+		fclose(TRACE_FILE);
+		TRACE_FILE = NULL;
 	}
 }
 
@@ -624,16 +1203,6 @@ uint32_t* translate_instruction(uint32_t instruction) {
 	return newInstruction;
 }
 
-/************************************************************/
-/* Initialize Memory                                                                                                    */ 
-/************************************************************/
-void initialize() { 
-	init_memory();
-	CURRENT_STATE.PC = MEM_TEXT_BEGIN;
-	NEXT_STATE = CURRENT_STATE;
-	RUN_FLAG = TRUE;
-}
-
 /************************************************************/
 /* Print the program loaded into memory (in MIPS assembly format)    */ 
 /************************************************************/
@@ -642,7 +1211,7 @@ void print_program(){
 	uint32_t addr;
 	
 	for(i=0; i<PROGRAM_SIZE; i++){
-		addr = MEM_TEXT_BEGIN + (i*4);
+		addr = PROGRAM_TEXT_BEGIN + (i*4);
 		printf("[0x%x]\t", addr);
 		print_instruction(addr);
 	}
@@ -654,7 +1223,7 @@ void print_program(){
 void print_instruction(uint32_t addr){
 	/*IMPLEMENT THIS*/
 	//printf("%x
-	uint32_t instruction = (mem_read_32(addr)); //reading in address from mem
+	uint32_t instruction = (mem_peek(addr, 4)); //reading in address from mem
 	//printf("address = 0x%x\n", instruction);
 	
 	//creating bit massk
@@ -665,7 +1234,7 @@ void print_instruction(uint32_t addr){
 	unsigned imm_mask = createMask(0,15);	
 	unsigned base_mask = createMask(21,25);
 	unsigned offset_mask = createMask(0,15);
-	unsigned target_mask = createMask(0,26);	
+	unsigned target_mask = createMask(0,25);	
 	unsigned sa_mask = createMask(6,10);
 	unsigned branch_mask = createMask(16,20);	
 	unsigned func_mask = createMask(0,5);
@@ -687,7 +1256,7 @@ void print_instruction(uint32_t addr){
 	
 	switch(opcode)
 	{
-		case 0x21000000: //add ADDI
+		case 0x20000000: //add ADDI
 		{
 			printf("ADDI ");
 			printf("$%x $%x 0x%x\n", rs, rt, immediate); 
@@ -717,7 +1286,7 @@ void print_instruction(uint32_t addr){
 			printf("$%x $%x 0x%x\n", rs, rt, immediate);
 			break; 
 		}
-		case 0x0A000000: //STLI set on less than immediate
+		case 0x28000000: //STLI set on less than immediate
 		{
 			printf("STLI ");
 			printf("$%x $%x 0x%x\n", rs, rt, immediate); 
@@ -729,18 +1298,30 @@ void print_instruction(uint32_t addr){
 			printf("$%x 0x%x $%x\n", rt, offset, base); 
 			break;
 		}
-		case 0x20000000: //Load Byte LB
+		case 0x80000000: //Load Byte LB
 		{
 			printf("LB ");
 			printf("$%x, 0x%x $%x)\n", rt, offset, base); 
 			break;
 		}
-		case 0x85000000: //Load halfword
+		case 0x84000000: //Load halfword
 		{
 			printf("LH ");
 			printf("$%x 0x%x $%x)\n", rt, offset, base); 
 			break;
 		}
+		case 0x90000000: //Load Byte Unsigned LBU
+		{
+			printf("LBU ");
+			printf("$%x 0x%x $%x\n", rt, offset, base); 
+			break;
+		}
+		case 0x94000000: //Load Halfword Unsigned LHU
+		{
+			printf("LHU ");
+			printf("$%x 0x%x $%x\n", rt, offset, base); 
+			break;
+		}
 		case 0x3C000000: //LUI Load Upper Immediate, was 0F
 		{
 			printf("LUI ");
@@ -753,16 +1334,28 @@ void print_instruction(uint32_t addr){
 			printf("$%x 0x%x $%x\n", rt, offset, base); 
 			break;
 		}
-		case 0x28000000: //SB Store Byte CHECK FORMAT
+		case 0xA0000000: //SB Store Byte
 		{
 			printf("SB ");
 			printf("$%x 0x%x $%x\n", rt, offset, base); 
 			break;
 		}
-		case 0x29000000: //SH Store Halfword CHECK FORMAT
+		case 0xA4000000: //SH Store Halfword
 		{
 			printf("SH ");
-			printf("$%x 0x%x $%x)\n", rt, offset, base); 
+			printf("$%x 0x%x $%x)\n", rt, offset, base);
+			break;
+		}
+		case 0xC0000000: //LL Load Linked
+		{
+			printf("LL ");
+			printf("$%x 0x%x $%x\n", rt, offset, base);
+			break;
+		}
+		case 0xE0000000: //SC Store Conditional
+		{
+			printf("SC ");
+			printf("$%x 0x%x $%x\n", rt, offset, base);
 			break;
 		}
 		case 0x10000000: //BEQ Branch if equal - start of branching instructions
@@ -812,13 +1405,13 @@ void print_instruction(uint32_t addr){
 		case 0x08000000: //Jump J (bum bum bummmm bum, RIP Eddie VanHalen)
 		{
 			printf("J ");
-			printf("0x%x\n", (addr & 0xF0000000) | (target));
+			printf("0x%x\n", (addr & 0xF0000000) | (target << 2));
 			break;
 		}
-		case 0x03000000: //JAL Jump and Link
+		case 0x0C000000: //JAL Jump and Link
 		{
 			printf("JAL ");
-			printf("0x%x\n", (addr & 0xF0000000) | (target));
+			printf("0x%x\n", (addr & 0xF0000000) | (target << 2));
 			break;
 		}
 		case 0x00000000: //special case when first six bits are 000000, function operations
@@ -995,26 +1588,3 @@ unsigned applyMask(unsigned mask, uint32_t instruction)
 {
 	return mask & instruction;
 }
-
-/***************************************************************/
-/* main                                                                                                                                   */
-/***************************************************************/
-int main(int argc, char *argv[]) {                              
-	printf("\n**************************\n");
-	printf("Welcome to MU-MIPS SIM...\n");
-	printf("**************************\n\n");
-	
-	if (argc < 2) {
-		printf("Error: You should provide input file.\nUsage: %s <input program> \n\n",  argv[0]);
-		exit(1);
-	}
-
-	strcpy(prog_file, argv[1]);
-	initialize();
-	load_program();
-	help();
-	while (1){
-		handle_command();
-	}
-	return 0;
-}
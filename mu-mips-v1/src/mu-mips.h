@@ -1,8 +1,13 @@
 #include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
 
 #define FALSE 0
 #define TRUE  1
 
+/* per-thread variables: the current machine and scratch space */
+#define MACHINE_LOCAL __thread
+
 /******************************************************************************/
 /* MIPS memory layout                                                                                                                                      */
 /******************************************************************************/
@@ -22,18 +27,103 @@
 #define MEM_STACK_BEGIN 0x7FFFFFFF
 #define MEM_STACK_END  0x10010000
 
+/* guest memory is materialized one page at a time, on first write */
+#define MEM_PAGE_SHIFT 12
+#define MEM_PAGE_SIZE  (1 << MEM_PAGE_SHIFT)
+#define MEM_PAGE_MASK  (MEM_PAGE_SIZE - 1)
+
+/* two-level page directory: the top 10 address bits select a page table, the next 10 a page */
+#define MEM_DIR_SHIFT   22
+#define MEM_DIR_SIZE    (1 << (32 - MEM_DIR_SHIFT))
+#define MEM_TABLE_SIZE  (1 << (MEM_DIR_SHIFT - MEM_PAGE_SHIFT))
+
+/* accesses a page's watchpoints look at, see mu-mips-debug.h */
+#define MEM_WATCH_READ  1
+#define MEM_WATCH_WRITE 2
+
+/* direct-mapped software TLB over materialized pages */
+#define MEM_TLB_SIZE    64
+#define MEM_TLB_INVALID 0xFFFFFFFF
+
+/***************************************************************/
+/* Pre-decoded instructions                                                                                      */
+/***************************************************************/
+
+/* handler index, OP_INVALID marks an entry that still has to be decoded */
+enum {
+	OP_INVALID = 0,
+	OP_SLL, OP_SRL, OP_SRA, OP_JR, OP_JALR, OP_SYSCALL,
+	OP_MFHI, OP_MTHI, OP_MFLO, OP_MTLO, OP_MULT, OP_MULTU, OP_DIV, OP_DIVU,
+	OP_ADD, OP_ADDU, OP_SUB, OP_SUBU, OP_AND, OP_OR, OP_XOR, OP_NOR, OP_SLT,
+	OP_BLTZ, OP_BGEZ, OP_J, OP_JAL, OP_BEQ, OP_BNE, OP_BLEZ, OP_BGTZ,
+	OP_ADDI, OP_ADDIU, OP_SLTI, OP_ANDI, OP_ORI, OP_XORI, OP_LUI,
+	OP_LB, OP_LH, OP_LW, OP_LBU, OP_LHU, OP_LL, OP_SB, OP_SH, OP_SW, OP_SC,
+	OP_BREAKPOINT,                       /* stands in for the instruction under a breakpoint */
+	OP_UNIMPLEMENTED,
+	NUM_OPS
+};
+
+typedef struct {
+	uint8_t op;                          /* handler index */
+	uint8_t rs, rt, rd, sa;
+	uint8_t wb;                          /* destination GPR, 0 if none */
+	uint8_t wb_args;                     /* SYSCALL: $a0 and $a1 are destinations too */
+	int32_t imm;                         /* sign-extended; zero-extended for logic ops, shifted for LUI */
+	uint32_t target;                     /* branch or jump destination */
+	uint32_t word;                       /* raw instruction */
+} decoded_inst_t;
+
+/* per-word execution counts, see mu-mips-profile.h */
+typedef struct {
+	uint64_t count;
+	uint64_t taken;                      /* executions that did not fall through to pc + 4 */
+} profile_count_t;
+
+typedef struct mem_page_struct {
+	uint8_t data[MEM_PAGE_SIZE];
+	uint32_t vpn;                        /* guest page number (address >> MEM_PAGE_SHIFT) */
+	decoded_inst_t *decoded;             /* one entry per word once the page is executed */
+	profile_count_t *profile;            /* one entry per word once executed while profiling */
+	int jit;                             /* translated code was built from this page */
+	int dirty;                           /* written since the last snapshot */
+	uint32_t *breaks;                    /* breakpoint bitmap, one bit per word, NULL if none */
+	int watch;                           /* MEM_WATCH_* kinds watched here, kept out of the TLBs */
+	uint8_t *saved;                      /* contents at the last snapshot, NULL if all zero */
+	struct mem_page_struct *next;        /* next materialized page, for reset */
+	struct mem_page_struct *dirty_next;  /* next page on MEM_DIRTY */
+} mem_page_t;
+
+typedef struct {
+	uint32_t vpn;
+	mem_page_t *page;
+} mem_tlb_entry_t;
+
+/* guest memory, shared by the cores of a multicore machine */
+typedef struct {
+	mem_page_t **page_dir[MEM_DIR_SIZE];  /* page tables are allocated on demand */
+	mem_page_t *pages;                   /* every materialized page */
+	mem_page_t *dirty;                   /* pages written since the last snapshot */
+	pthread_mutex_t *lock;               /* set while several cores run on it */
+} mem_t;
+
+/* what a program's syscalls change besides memory and registers, shared by the cores */
+#define SYS_MAX_FILES   16                /* guest descriptors, 0-2 are the console */
+#define SYS_OUTPUT_SIZE 8192              /* console output buffered per core */
+
+typedef struct {
+	uint32_t heap_begin;                 /* first break, above the loaded data */
+	uint32_t brk;                        /* program break, sbrk moves it */
+	FILE *files[SYS_MAX_FILES];          /* host files behind descriptors 3 and up, NULL if closed */
+	int exited;                          /* the program stopped with exit2 */
+	int exit_code;
+} sys_proc_t;
+
 typedef struct {
 	uint32_t begin, end;
-	uint8_t *mem;
 } mem_region_t;
 
-/* memory will be dynamically allocated at initialization */
-mem_region_t MEM_REGIONS[] = {
-	{ MEM_TEXT_BEGIN, MEM_TEXT_END, NULL },
-	{ MEM_DATA_BEGIN, MEM_DATA_END, NULL },
-	{ MEM_KDATA_BEGIN, MEM_KDATA_END, NULL },
-	{ MEM_KTEXT_BEGIN, MEM_KTEXT_END, NULL }
-};
+/* only consulted when a page is materialized, never on the access path */
+extern mem_region_t MEM_REGIONS[];
 
 #define NUM_MEM_REGION 4
 #define MIPS_REGS 32
@@ -45,40 +135,186 @@ typedef struct CPU_State_Struct {
   uint32_t HI, LO;                          /* special regs for mult/div. */
 } CPU_State;
 
+/* program file formats, see mu-mips-loader.c */
+enum { FORMAT_AUTO, FORMAT_HEX, FORMAT_BIN, FORMAT_BINLE, FORMAT_ELF };
+extern int PROGRAM_FORMAT;
 
+/* in-memory snapshot, see mu-mips-snapshot.c */
+enum { SNAPSHOT_NONE, SNAPSHOT_LOAD, SNAPSHOT_USER };
+#define SNAPSHOT_MAGIC "MUSN"
+#define SNAPSHOT_VERSION 3
+
+#define PROG_FILE_SIZE 4096
+
+/* execution engine selected at startup */
+enum { ENGINE_SWITCH, ENGINE_TABLE, ENGINE_THREADED, ENGINE_JIT };
+extern int ENGINE;
+
+/* per-instruction tracing, off for full-speed runs */
+#define TRACE_BUFFER_SIZE (64 * 1024)
+#define TRACE_WORD_CACHE 4096             /* instruction words the binary trace remembers, see mu-mips-trace.h */
+extern int TRACE;                         /* print every executed instruction */
+
+extern int VERBOSE;                       /* progress messages such as the loader's */
 
 /***************************************************************/
-/* CPU State info.                                                                                                               */
+/* Machine context. Everything a simulated machine changes lives in  */
+/* one machine_t, so a process can hold any number of them. MACHINE */
+/* is the calling thread's current machine; the state names below   */
+/* stand for its fields. Settings such as the engine and the timing  */
+/* models' options are shared and copied in when a machine is set up. */
 /***************************************************************/
+typedef struct machine_struct {
+	/* CPU State info */
+	CPU_State current, next;
+	int run_flag;
+	uint64_t instruction_count;
+	/* memory */
+	mem_t *mem;                          /* own_mem, or core 0's on the other cores */
+	mem_t own_mem;
+	mem_tlb_entry_t tlb[MEM_TLB_SIZE];   /* loads */
+	mem_tlb_entry_t wtlb[MEM_TLB_SIZE];  /* stores, only maps dirty pages without decoded code */
+	uint32_t fetch_vpn;                  /* page of the last instruction fetch */
+	mem_page_t *fetch_page;
+	decoded_inst_t uncached;             /* unmapped or misaligned fetch */
+	/* LL/SC link, SC succeeds if the linked word still holds ll_value */
+	int ll_valid;
+	uint32_t ll_addr, ll_value;
+	/* syscall emulation, see mu-mips-syscall.h */
+	sys_proc_t *proc;                    /* own_proc, or core 0's on the other cores */
+	sys_proc_t own_proc;
+	uint32_t output_len;                 /* console output not yet written */
+	char output[SYS_OUTPUT_SIZE];
+	/* loaded program */
+	char prog_file[PROG_FILE_SIZE];
+	uint32_t program_size;               /* in words */
+	uint32_t program_text_begin;         /* first word of the loaded text */
+	uint32_t program_entry;              /* PC after load and reset */
+	/* in-memory snapshot */
+	int snapshot_state;                  /* what the snapshot holds */
+	CPU_State snapshot_cpu;
+	uint64_t snapshot_count;
+	int snapshot_run_flag;
+	uint32_t snapshot_brk;
+	/* binary trace sink, NULL when not recording */
+	FILE *trace_file;
+	uint8_t trace_buffer[TRACE_BUFFER_SIZE];
+	uint32_t trace_len;
+	uint32_t trace_pc;                   /* PC of the last record */
+	uint32_t trace_addr;                 /* address of the last load or store recorded */
+	uint32_t trace_words[TRACE_WORD_CACHE][2];  /* (pc, word) last recorded in each slot */
+	/* profiler counts for fetches outside materialized pages */
+	profile_count_t profile_other;
+	/* translator and timing models, set up by their modules */
+	int jit_stale;
+	struct jit_struct *jit;
+	struct pipe_struct *pipe;
+	struct cache_struct *l1i, *l1d;
+	struct bpred_struct *bpred;
+	struct dram_struct *dram;
+	struct sample_struct *sample;
+	struct ooo_struct *ooo;
+	/* multicore: the cores share memory, see mu-mips-smp.h */
+	struct smp_struct *smp;              /* NULL for a single core */
+	uint32_t core;                       /* this core's number, 0 owns the memory */
+	/* breakpoints and watchpoints, NULL until the first is set */
+	struct debug_struct *debug;
+} machine_t;
 
-CPU_State CURRENT_STATE, NEXT_STATE;
-int RUN_FLAG;	/* run flag*/
-uint32_t INSTRUCTION_COUNT;
-uint32_t PROGRAM_SIZE; /*in words*/
+extern MACHINE_LOCAL machine_t *MACHINE;
 
-char prog_file[32];
+#define CURRENT_STATE      (MACHINE->current)
+#define NEXT_STATE         (MACHINE->next)
+#define RUN_FLAG           (MACHINE->run_flag)
+#define INSTRUCTION_COUNT  (MACHINE->instruction_count)
+#define MEM_PAGE_DIR       (MACHINE->mem->page_dir)
+#define MEM_PAGES          (MACHINE->mem->pages)
+#define MEM_LOCK           (MACHINE->mem->lock)
+#define MEM_TLB            (MACHINE->tlb)
+#define MEM_WTLB           (MACHINE->wtlb)
+#define MEM_DIRTY          (MACHINE->mem->dirty)
+#define FETCH_VPN          (MACHINE->fetch_vpn)
+#define FETCH_PAGE         (MACHINE->fetch_page)
+#define prog_file          (MACHINE->prog_file)
+#define PROGRAM_SIZE       (MACHINE->program_size)
+#define PROGRAM_TEXT_BEGIN (MACHINE->program_text_begin)
+#define PROGRAM_ENTRY      (MACHINE->program_entry)
+#define SNAPSHOT_STATE     (MACHINE->snapshot_state)
+#define TRACE_FILE         (MACHINE->trace_file)
+#define TRACE_BUFFER       (MACHINE->trace_buffer)
+#define TRACE_LEN          (MACHINE->trace_len)
+#define TRACE_PC           (MACHINE->trace_pc)
+#define TRACE_ADDR         (MACHINE->trace_addr)
+#define TRACE_WORDS        (MACHINE->trace_words)
 
 
+/***************************************************************/
+/* Commit an executed instruction. CURRENT_STATE and NEXT_STATE      */
+/* only ever differ in PC, HI, LO and the instruction's destination  */
+/* register, so copying those keeps them equal without copying the */
+/* whole register file.                                                                                       */
+/***************************************************************/
+static inline void commit_state(const decoded_inst_t *d)
+{
+	CURRENT_STATE.PC = NEXT_STATE.PC;
+	CURRENT_STATE.REGS[d->wb] = NEXT_STATE.REGS[d->wb];
+	CURRENT_STATE.HI = NEXT_STATE.HI;
+	CURRENT_STATE.LO = NEXT_STATE.LO;
+	if (d->wb_args) {
+		/* the time comes back in $a0 and $a1 */
+		CURRENT_STATE.REGS[4] = NEXT_STATE.REGS[4];
+		CURRENT_STATE.REGS[5] = NEXT_STATE.REGS[5];
+	}
+}
+
 /***************************************************************/
 /* Function Declerations.                                                                                                */
 /***************************************************************/
-void help();
 uint32_t* translate_instruction(uint32_t instruction);
+uint8_t mem_read_8(uint32_t address);
+uint16_t mem_read_16(uint32_t address);
 uint32_t mem_read_32(uint32_t address);
+void mem_write_8(uint32_t address, uint8_t value);
+void mem_write_16(uint32_t address, uint16_t value);
 void mem_write_32(uint32_t address, uint32_t value);
+int mem_write_block(uint32_t address, const uint8_t *buf, uint32_t len, int swap);
+uint32_t mem_peek(uint32_t address, uint32_t size);
+uint32_t mem_load_linked(uint32_t address);
+uint32_t mem_store_conditional(uint32_t address, uint32_t value);
+void syscall_emulate(CPU_State *current, CPU_State *next);
+void debug_break(decoded_inst_t *d);
+void debug_watch(uint32_t address, uint32_t size, int write);
 void cycle();
-void run(int num_cycles);
-void runAll();
-void mdump(uint32_t start, uint32_t stop) ;
-void rdump();
-void handle_command();
+uint32_t run_engine(uint32_t max);
+uint32_t run_core(uint32_t max);
+uint32_t run_functional(uint32_t max);
+uint32_t run_interpreter(uint32_t max);
+decoded_inst_t *execute_instruction();
+void execute_as(decoded_inst_t *d, uint8_t op);
+int trace_sink_open(const char *path);
+void trace_sink_flush();
+void trace_sink_close();
+void trace_sink_state(int reload);
+void trace_sink_poke(uint32_t address, uint32_t value);
 void reset();
 void init_memory();
+void free_memory();
+mem_page_t *mem_page(uint32_t address, int create);
 unsigned createMask(unsigned a, unsigned b);
 unsigned applyMask(unsigned mask, uint32_t instruction);
-void load_program();
+int load_program();
+machine_t *machine_create();
+void machine_destroy(machine_t *m);
+int machine_load(const char *path);
+int snapshot_save(int kind);
+void snapshot_restore();
+int snapshot_write(const char *path);
+int snapshot_read(const char *path);
+void mem_tlb_flush();
+void decode_instruction(uint32_t addr, uint32_t instruction, decoded_inst_t *d);
+void decode_invalidate(mem_page_t *page, uint32_t address);
+decoded_inst_t *fetch_decoded(uint32_t addr);
 void handle_instruction(); /*IMPLEMENT THIS*/
-void initialize();
 void print_program(); /*IMPLEMENT THIS*/
 void print_instruction(uint32_t);
 unsigned returnReg(unsigned rt);
\ No newline at end of file
@@ -0,0 +1,47 @@
+#ifndef MUMIPS_H
+#define MUMIPS_H
+
+#include <stdint.h>
+
+/***************************************************************/
+/* libmumips, the simulator as a library.                                                 */
+/* A context is a whole machine: registers, sparse memory, code     */
+/* caches and the timing model. Any number of contexts can live in  */
+/* one process, each used by one thread at a time. Options are      */
+/* process-wide and apply to the contexts created after them.         */
+/* Functions returning int give 0 on success and -1 on error, and    */
+/* mumips_create NULL; each error prints an "Error:" line on stdout. */
+/* Besides those, only "Warning:" lines and the program's console    */
+/* syscalls are printed. A process out of host memory mid-run, for  */
+/* decode caches, profile counters or threads, still exits.                */
+/***************************************************************/
+
+#define MUMIPS_API __attribute__((visibility("default")))
+
+typedef struct machine_struct mumips_t;
+
+/* registers past the 32 GPRs */
+enum { MUMIPS_HI = 32, MUMIPS_LO, MUMIPS_PC };
+
+/* engine=, model=, format= or a timing model option (see -o) */
+MUMIPS_API int mumips_option(const char *opt);
+
+MUMIPS_API mumips_t *mumips_create(void);
+MUMIPS_API int mumips_load(mumips_t *m, const char *path);
+MUMIPS_API void mumips_reset(mumips_t *m);
+MUMIPS_API void mumips_destroy(mumips_t *m);
+
+/* execute one instruction, or up to max (cycles under the pipeline model, 0 = until halted) */
+MUMIPS_API uint64_t mumips_step(mumips_t *m);
+MUMIPS_API uint64_t mumips_run(mumips_t *m, uint64_t max);
+MUMIPS_API int mumips_halted(mumips_t *m);
+MUMIPS_API uint64_t mumips_instructions(mumips_t *m);
+
+MUMIPS_API uint32_t mumips_read_reg(mumips_t *m, int reg);
+MUMIPS_API int mumips_write_reg(mumips_t *m, int reg, uint32_t value);
+/* reads don't touch the TLB or trip watchpoints, unmapped bytes read 0 */
+MUMIPS_API void mumips_read_mem(mumips_t *m, uint32_t addr, void *buf, uint32_t len);
+/* writes outside simulated memory are dropped, -1 if any were */
+MUMIPS_API int mumips_write_mem(mumips_t *m, uint32_t addr, const void *buf, uint32_t len);
+
+#endif